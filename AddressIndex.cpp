@@ -0,0 +1,51 @@
+#include "AddressIndex.h"
+#include <algorithm>
+// Value of one hex digit, -1 when it is not one.
+static int nibble(char c) {
+	if (c >= '0' && c <= '9') return c - '0';
+	if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+	if (c >= 'A' && c <= 'F') return c - 'A' + 10;
+	return -1;
+}
+// Hex digits into bytes, digits past the given ones take the fill value.
+static std::array<unsigned char, AddressIndex::width> pack(std::string_view hex, int fill) {
+	std::array<unsigned char, AddressIndex::width> bytes;
+	for (std::size_t i = 0; i < AddressIndex::width; i++) {
+		int high = 2 * i < hex.size() ? nibble(hex[2 * i]) : fill;
+		int low = 2 * i + 1 < hex.size() ? nibble(hex[2 * i + 1]) : fill;
+		bytes[i] = static_cast<unsigned char>((high << 4) | low);
+	}
+	return bytes;
+}
+void AddressIndex::build(const std::vector<std::pair<std::string, std::string>>& source) {
+	entries.clear();
+	entries.reserve(source.size());
+	for (const auto& [key, address] : source) {
+		std::string hex;
+		if (!normalize_address(address, hex) || hex.size() != 2 * width) continue;
+		entries.push_back({pack(hex, 0), key});
+	}
+	std::sort(entries.begin(), entries.end(), [](const Entry& a, const Entry& b) { return a.bytes < b.bytes; });
+}
+// Every address with the prefix sits between the prefix padded with zeros and the prefix padded with ones.
+std::vector<std::string> AddressIndex::starting_with(std::string_view hex) const {
+	std::vector<std::string> keys;
+	if (hex.size() > 2 * width) return keys;
+	auto lowest = pack(hex, 0x0);
+	auto highest = pack(hex, 0xf);
+	auto first = std::lower_bound(entries.begin(), entries.end(), lowest, [](const Entry& entry, const auto& bytes) { return entry.bytes < bytes; });
+	auto last = std::upper_bound(first, entries.end(), highest, [](const auto& bytes, const Entry& entry) { return bytes < entry.bytes; });
+	for (auto it = first; it != last; ++it) keys.push_back(it->key);
+	return keys;
+}
+bool normalize_address(std::string_view text, std::string& hex) {
+	if (text.size() >= 2 && text[0] == '0' && (text[1] == 'x' || text[1] == 'X')) text.remove_prefix(2);
+	if (text.size() > 2 * AddressIndex::width) return false;
+	hex.clear();
+	for (char c : text) {
+		int value = nibble(c);
+		if (value < 0) return false;
+		hex.push_back("0123456789abcdef"[value]);
+	}
+	return true;
+}
@@ -0,0 +1,25 @@
+#pragma once
+#include <array>
+#include <string>
+#include <string_view>
+#include <vector>
+// Character addresses as sorted fixed-width bytes, exact and prefix lookups are two binary searches.
+class AddressIndex {
+	// Public Members
+	public:
+		static constexpr std::size_t width = 20; // Bytes in a wallet address
+		// Keys with their addresses as lower case hex, addresses of any other width are left out.
+		void build(const std::vector<std::pair<std::string, std::string>>& entries);
+		// Keys whose address starts with the hex digits, a full width of digits is an exact match.
+		std::vector<std::string> starting_with(std::string_view hex) const;
+		std::size_t size() const { return entries.size(); }
+	// Private Members
+	private:
+		struct Entry {
+			std::array<unsigned char, width> bytes;
+			std::string key;
+		};
+		std::vector<Entry> entries; // Sorted by bytes
+};
+// Strip 0x and lower the case, false when what is left is not hex or is longer than an address.
+bool normalize_address(std::string_view text, std::string& hex);
@@ -0,0 +1,363 @@
+#include "AsyncQuery.h"
+#include "QueryCatalog.h"
+#include "Env.h"
+#include "Routes.h" // for get_pool_connection_string
+#include <iostream>
+#include <chrono>
+#include <memory>
+#include <algorithm>
+#include <unistd.h> // For dup
+// Sets the timeout for the current transaction only, so it holds through PgBouncer's transaction pooling.
+static const char* const timeout_statement = "async_statement_timeout";
+// How long a cancelled query gets to come back before its connection is given up on.
+static const std::chrono::seconds cancel_grace(5);
+// One statement in flight, kept alive by the handlers waiting on its socket. It is sent as a pipeline of
+// the timeout and the statement followed by a sync, the implicit transaction ending at the sync.
+struct AsyncQuery : std::enable_shared_from_this<AsyncQuery> {
+	AsyncQuery(AsyncQueryPool& pool, asio::io_context& io, std::string statement, std::vector<std::string> params, AsyncDone done,
+			std::chrono::steady_clock::time_point deadline)
+		: pool(pool), socket(io), timer(io), statement(std::move(statement)), params(std::move(params)), done(std::move(done)), deadline(deadline) {}
+	// Start the deadline on the query's own io_context thread.
+	void arm() {
+		timer.expires_at(deadline);
+		timer.async_wait([self = shared_from_this()](const asio::error_code& ec) {
+			if (!ec) self->expire();
+		});
+	}
+	// Still queued, it leaves the queue and fails. A query handed a connection meanwhile finds the deadline passed when it runs.
+	// A running one is cancelled, so the connection is free again well before the server's own timeout.
+	void expire() {
+		if (finished) return;
+		if (!conn) {
+			if (pool.withdraw(this)) finish(AsyncQueryPool::busy, false);
+			return;
+		}
+		// Cancelled and still nothing back, the connection is closed instead.
+		if (cancelling) {
+			finish("Query did not stop after it was cancelled", true);
+			return;
+		}
+		cancelling = true;
+		cancel_pending = true;
+		pool.cancel(conn, [self = shared_from_this()] {
+			asio::post(self->socket.get_executor(), [self] { self->cancel_sent(); });
+		});
+	}
+	// The result normally follows as a cancellation error, a connection held back for the request is handed on now.
+	void cancel_sent() {
+		cancel_pending = false;
+		if (finished) {
+			if (held) pool.release(held, false);
+			held = nullptr;
+			return;
+		}
+		timer.expires_after(cancel_grace);
+		timer.async_wait([self = shared_from_this()](const asio::error_code& ec) {
+			if (!ec) self->expire();
+		});
+	}
+	// Send the statement on a leased connection, a null one means the pool has none left.
+	void run(PGconn* leased) {
+		conn = leased;
+		start = std::chrono::steady_clock::now();
+		if (!conn || start >= deadline) {
+			finish(AsyncQueryPool::busy, false);
+			return;
+		}
+		// The socket is duplicated so closing it here never closes libpq's own descriptor.
+		asio::error_code ec;
+		socket.assign(::dup(PQsocket(conn)), ec);
+		if (ec) {
+			finish(ec.message(), true);
+			return;
+		}
+		// Whatever is left of the deadline, the wait for a connection already used the rest.
+		auto remaining = std::chrono::duration_cast<std::chrono::milliseconds>(deadline - start);
+		std::string timeout = std::to_string(std::max<long long>(1, remaining.count()));
+		const char* timeout_value = timeout.c_str();
+		std::vector<const char*> values;
+		values.reserve(params.size());
+		for (const auto& param : params) values.push_back(param.c_str());
+		if (!PQsendQueryPrepared(conn, timeout_statement, 1, &timeout_value, nullptr, nullptr, 0)
+				|| !PQsendQueryPrepared(conn, statement.c_str(), static_cast<int>(values.size()), values.data(), nullptr, nullptr, 0)
+				|| !PQpipelineSync(conn)) {
+			finish(PQerrorMessage(conn), true);
+			return;
+		}
+		flush();
+	}
+	// Push the rest of the query out, waiting for the socket to drain when libpq could not.
+	void flush() {
+		int pending = PQflush(conn);
+		if (pending < 0) {
+			finish(PQerrorMessage(conn), true);
+		} else if (pending > 0) {
+			socket.async_wait(asio::posix::stream_descriptor::wait_write, [self = shared_from_this()](const asio::error_code& ec) {
+				if (ec) {
+					self->finish(ec.message(), true);
+				} else {
+					self->flush();
+				}
+			});
+		} else {
+			read();
+		}
+	}
+	// Take whatever arrived, each statement's results end with a null and the pipeline with its sync.
+	void read() {
+		socket.async_wait(asio::posix::stream_descriptor::wait_read, [self = shared_from_this()](const asio::error_code& ec) {
+			if (ec) {
+				self->finish(ec.message(), true);
+				return;
+			}
+			if (!PQconsumeInput(self->conn)) {
+				self->finish(PQerrorMessage(self->conn), true);
+				return;
+			}
+			while (!PQisBusy(self->conn)) {
+				PGresult* res = PQgetResult(self->conn);
+				if (!res) {
+					self->stage++;
+					continue;
+				}
+				if (PQresultStatus(res) == PGRES_PIPELINE_SYNC) {
+					PQclear(res);
+					self->finish(self->error, false);
+					return;
+				}
+				self->keep(res);
+			}
+			self->read();
+		});
+	}
+	// Keep the statement's rows, remember the first error. Whatever followed an error comes back aborted.
+	void keep(PGresult* res) {
+		ExecStatusType status = PQresultStatus(res);
+		if ((status == PGRES_TUPLES_OK || status == PGRES_COMMAND_OK) && stage == 1) {
+			result = PgResult(res);
+			return;
+		}
+		if (status != PGRES_TUPLES_OK && status != PGRES_COMMAND_OK && error.empty()) {
+			error = status == PGRES_PIPELINE_ABORTED ? "Pipeline aborted" : PQresultErrorMessage(res);
+		}
+		PQclear(res);
+	}
+	// Hand the connection back before calling out, a query that failed midway leaves it for a reset.
+	void finish(std::string message, bool broken) {
+		if (finished) return;
+		finished = true;
+		error = std::move(message);
+		timer.cancel();
+		asio::error_code ignored;
+		socket.close(ignored);
+		record_statement(statement, std::chrono::steady_clock::now() - start, !error.empty());
+		// A cancel request still on its way could hit the next query, so the connection waits for it.
+		if (conn && cancel_pending && !broken) {
+			held = conn;
+		} else if (conn) {
+			pool.release(conn, broken);
+		}
+		conn = nullptr;
+		done(std::move(result), std::move(error));
+	}
+	AsyncQueryPool& pool;
+	asio::posix::stream_descriptor socket;
+	asio::steady_timer timer;
+	std::string statement;
+	std::vector<std::string> params;
+	AsyncDone done;
+	std::chrono::steady_clock::time_point deadline;
+	bool finished = false;
+	bool cancelling = false;
+	bool cancel_pending = false; // Cancel request not sent yet
+	PGconn* conn = nullptr;
+	PGconn* held = nullptr; // Finished while its cancel request was pending
+	int stage = 0; // Statements of the pipeline read so far
+	std::chrono::steady_clock::time_point start;
+	PgResult result;
+	std::string error;
+};
+const char* const AsyncQueryPool::busy = "No database connection available";
+// Connections are opened by open()
+AsyncQueryPool::AsyncQueryPool(std::string connection_string, std::size_t capacity, std::size_t queue_limit, long long statement_timeout_ms)
+	: connection_string(std::move(connection_string)), capacity(capacity == 0 ? 1 : capacity), queue_limit(queue_limit),
+		statement_timeout_ms(statement_timeout_ms) {}
+AsyncQueryPool::~AsyncQueryPool() {
+	{
+		std::lock_guard<std::mutex> lock(pool_mutex);
+		stopping = true;
+	}
+	maintenance_wake.notify_all();
+	if (maintenance.joinable()) maintenance.join();
+	for (PGconn* conn : idle) PQfinish(conn);
+}
+// Blocking connect with the catalog prepared, null when the server cannot be reached.
+PGconn* AsyncQueryPool::connect() {
+	PGconn* conn = PQconnectdb(connection_string.c_str());
+	if (PQstatus(conn) != CONNECTION_OK) {
+		std::cerr << "Error: Async connection failed: " << PQerrorMessage(conn) << std::endl;
+		PQfinish(conn);
+		return nullptr;
+	}
+	// Slow statements are cancelled by the server, nothing else would stop them once sent. A session SET
+	// would stay on whichever server connection PgBouncer lent, so every query sets its own, local to it.
+	std::vector<std::pair<std::string, std::string>> statements = statement_catalog();
+	statements.emplace_back(timeout_statement, "SELECT set_config('statement_timeout', $1, true)");
+	for (const auto& [name, sql] : statements) {
+		PGresult* res = PQprepare(conn, name.c_str(), sql.c_str(), 0, nullptr);
+		if (PQresultStatus(res) != PGRES_COMMAND_OK) {
+			std::cerr << "Error: Preparing " << name << " failed: " << PQresultErrorMessage(res) << std::endl;
+		}
+		PQclear(res);
+	}
+	PQsetnonblocking(conn, 1);
+	if (!PQenterPipelineMode(conn)) {
+		std::cerr << "Error: Async connection cannot pipeline: " << PQerrorMessage(conn) << std::endl;
+		PQfinish(conn);
+		return nullptr;
+	}
+	return conn;
+}
+// Fill every slot before taking traffic.
+void AsyncQueryPool::open() {
+	std::size_t connected = 0;
+	while (true) {
+		{
+			std::lock_guard<std::mutex> lock(pool_mutex);
+			if (opened >= capacity) break;
+		}
+		PGconn* conn = connect();
+		if (!conn) break;
+		std::lock_guard<std::mutex> lock(pool_mutex);
+		opened++;
+		idle.push_back(conn);
+		connected++;
+	}
+	std::cout << "Async query pool opened " << connected << " of " << capacity << " connections." << std::endl;
+	maintenance = std::thread([this] { maintain(); });
+}
+// Keep the pool full, backing off while the server stays unreachable.
+void AsyncQueryPool::maintain() {
+	static const std::chrono::milliseconds backoff_min(500);
+	static const std::chrono::milliseconds backoff_max(30000);
+	std::chrono::milliseconds backoff = backoff_min;
+	std::unique_lock<std::mutex> lock(pool_mutex);
+	while (!stopping) {
+		if (!chores.empty()) {
+			auto chore = std::move(chores.front());
+			chores.pop_front();
+			lock.unlock();
+			chore();
+			lock.lock();
+			continue;
+		}
+		if (opened >= capacity) {
+			maintenance_wake.wait(lock);
+			continue;
+		}
+		kicked = false;
+		lock.unlock();
+		PGconn* conn = connect();
+		lock.lock();
+		if (conn) {
+			opened++;
+			backoff = backoff_min;
+			lock.unlock();
+			hand_over(conn);
+			lock.lock();
+			continue;
+		}
+		// Nothing open to wait for, everyone queued fails now rather than after the backoff.
+		if (opened == 0 && !waiting.empty()) {
+			std::deque<std::pair<const AsyncQuery*, std::function<void(PGconn*)>>> failed;
+			failed.swap(waiting);
+			lock.unlock();
+			for (auto& waiter : failed) waiter.second(nullptr);
+			lock.lock();
+		}
+		maintenance_wake.wait_for(lock, backoff, [this] { return stopping || kicked || !chores.empty(); });
+		backoff = std::min(backoff * 2, backoff_max);
+	}
+}
+// Lease a connection or queue for the next one released, either way the query starts on its own io_context.
+// A full queue turns the query away at once.
+void AsyncQueryPool::exec(asio::io_context& io, const std::string& statement, std::vector<std::string> params, AsyncDone done,
+		std::chrono::milliseconds timeout) {
+	if (timeout.count() <= 0) timeout = std::chrono::milliseconds(statement_timeout_ms);
+	auto query = std::make_shared<AsyncQuery>(*this, io, statement, std::move(params), std::move(done), std::chrono::steady_clock::now() + timeout);
+	auto start = [&io, query](PGconn* conn) { asio::post(io, [query, conn] { query->run(conn); }); };
+	asio::post(io, [query] { query->arm(); });
+	std::unique_lock<std::mutex> lock(pool_mutex);
+	if (!idle.empty()) {
+		PGconn* conn = idle.back();
+		idle.pop_back();
+		lock.unlock();
+		start(conn);
+	} else if (waiting.size() >= queue_limit) {
+		lock.unlock();
+		start(nullptr);
+	} else {
+		// With nothing open the query waits on the next reconnect attempt, which is started now.
+		waiting.emplace_back(query.get(), std::move(start));
+		if (opened == 0) {
+			kicked = true;
+			lock.unlock();
+			maintenance_wake.notify_all();
+		}
+	}
+}
+// A broken connection is closed and its slot reopened by the maintenance thread, never on the io thread.
+void AsyncQueryPool::release(PGconn* conn, bool broken) {
+	if (broken || PQstatus(conn) != CONNECTION_OK) {
+		PQfinish(conn);
+		{
+			std::lock_guard<std::mutex> lock(pool_mutex);
+			opened--;
+		}
+		maintenance_wake.notify_all();
+		return;
+	}
+	hand_over(conn);
+}
+void AsyncQueryPool::hand_over(PGconn* conn) {
+	std::unique_lock<std::mutex> lock(pool_mutex);
+	if (waiting.empty()) {
+		idle.push_back(conn);
+		return;
+	}
+	auto start = std::move(waiting.front().second);
+	waiting.pop_front();
+	lock.unlock();
+	start(conn);
+}
+// PQcancel opens a connection of its own, so it runs on the maintenance thread.
+void AsyncQueryPool::cancel(PGconn* conn, std::function<void()> sent) {
+	PGcancel* request = PQgetCancel(conn);
+	{
+		std::lock_guard<std::mutex> lock(pool_mutex);
+		chores.emplace_back([request, sent = std::move(sent)] {
+			char message[256] = "";
+			if (request && !PQcancel(request, message, sizeof(message))) {
+				std::cerr << "Error: Cancel request failed: " << message << std::endl;
+			}
+			if (request) PQfreeCancel(request);
+			sent();
+		});
+	}
+	maintenance_wake.notify_all();
+}
+bool AsyncQueryPool::withdraw(const AsyncQuery* query) {
+	std::lock_guard<std::mutex> lock(pool_mutex);
+	auto it = std::find_if(waiting.begin(), waiting.end(), [query](const auto& waiter) { return waiter.first == query; });
+	if (it == waiting.end()) return false;
+	waiting.erase(it);
+	return true;
+}
+// Process wide pool
+AsyncQueryPool& async_queries() {
+	static AsyncQueryPool pool(get_pool_connection_string(),
+		env_size("PG_ASYNC_POOL_SIZE", 8),
+		env_size("PG_ASYNC_QUEUE_SIZE", 256),
+		static_cast<long long>(env_size("PG_ASYNC_STATEMENT_TIMEOUT_MS", 30000)));
+	return pool;
+}
@@ -0,0 +1,61 @@
+#pragma once
+#include <asio.hpp>
+#include <libpq-fe.h>
+#include <string>
+#include <vector>
+#include <chrono>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <condition_variable>
+#include <functional>
+#include "PgResult.h"
+// Result or error message of one asynchronous statement, the error is empty on success.
+using AsyncDone = std::function<void(PgResult result, std::string error)>;
+struct AsyncQuery;
+// Raw libpq connections driven in non-blocking mode from the caller's io_context. A query is sent with
+// PQsendQueryPrepared, then the connection's socket is watched by asio until the result is in, so the
+// worker thread serves other requests meanwhile instead of blocking inside libpq.
+class AsyncQueryPool {
+	// Public Members
+	public:
+		AsyncQueryPool(std::string connection_string, std::size_t capacity, std::size_t queue_limit, long long statement_timeout_ms);
+		~AsyncQueryPool();
+		// Open and prepare every connection, blocking, once at startup. Slots that fail are filled in the background.
+		void open();
+		// Run a catalog statement with text parameters, done always runs later on the io_context's thread. The query
+		// gives up once the timeout has passed, counted from now including any wait for a connection, and the
+		// server cancels it by then too. Zero means the pool's statement timeout.
+		void exec(asio::io_context& io, const std::string& statement, std::vector<std::string> params, AsyncDone done,
+			std::chrono::milliseconds timeout = std::chrono::milliseconds(0));
+		// Error of a query that got no connection, the queue was full, the wait ran out or none could be opened.
+		static const char* const busy;
+	// Private Members
+	private:
+		friend struct AsyncQuery;
+		PGconn* connect();
+		void release(PGconn* conn, bool broken);
+		// Take a query out of the queue when its deadline passes, false once a connection is already on its way.
+		bool withdraw(const AsyncQuery* query);
+		// Ask the server to cancel what the connection is running, sent is called once the request went out.
+		void cancel(PGconn* conn, std::function<void()> sent);
+		// Next queued query gets the connection, otherwise it goes idle.
+		void hand_over(PGconn* conn);
+		// Background thread reopening lost slots and sending cancel requests, so the io threads never wait on either.
+		void maintain();
+		std::string connection_string;
+		std::size_t capacity;
+		std::size_t queue_limit;
+		long long statement_timeout_ms;
+		std::mutex pool_mutex;
+		std::vector<PGconn*> idle;
+		std::deque<std::pair<const AsyncQuery*, std::function<void(PGconn*)>>> waiting; // Queries queued for a free connection
+		std::size_t opened = 0;
+		std::deque<std::function<void()>> chores; // Cancel requests for the maintenance thread
+		std::thread maintenance;
+		std::condition_variable maintenance_wake;
+		bool kicked = false; // A query is waiting with nothing open, retry without the backoff
+		bool stopping = false;
+};
+// Process wide pool, sized from PG_ASYNC_POOL_SIZE and PG_ASYNC_QUEUE_SIZE with PG_ASYNC_STATEMENT_TIMEOUT_MS.
+AsyncQueryPool& async_queries();
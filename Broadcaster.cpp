@@ -0,0 +1,489 @@
+#include "Broadcaster.h"
+#include "AddressIndex.h"
+#include "Env.h"
+#include <nlohmann/json.hpp>
+#include <iostream>
+#include <algorithm>
+#include <iterator>
+#include <cctype>
+#include <cstdlib> // For getenv
+// Senders start right away and wait for work.
+Broadcaster::Broadcaster(std::size_t queue_limit, QueueFullPolicy policy, std::size_t sender_count, std::size_t log_limit)
+	: queue_limit(queue_limit == 0 ? 1 : queue_limit), policy(policy), log_limit(log_limit == 0 ? 1 : log_limit) {
+	for (std::size_t i = 0; i < std::max<std::size_t>(1, sender_count); i++) {
+		senders.emplace_back(&Broadcaster::sender_loop, this);
+	}
+}
+// Let the senders finish what they hold and exit.
+Broadcaster::~Broadcaster() {
+	{
+		std::lock_guard<std::mutex> lock(ready_mutex);
+		stopping = true;
+	}
+	ready_cv.notify_all();
+	for (auto& sender : senders) {
+		if (sender.joinable()) sender.join();
+	}
+}
+// New /mails connection
+void Broadcaster::subscribe(crow::websocket::connection* conn, WireFormat format) {
+	auto subscriber = std::make_shared<Subscriber>();
+	subscriber->conn = conn;
+	subscriber->format = format;
+	std::unique_lock<std::shared_mutex> lock(subscribers_mutex);
+	auto& slot = subscribers[conn];
+	if (slot) {
+		format_subscribers[static_cast<std::size_t>(slot->format)].fetch_sub(1, std::memory_order_relaxed);
+		everything.erase(slot.get());
+		unindex_filter(slot.get(), slot->filter);
+	}
+	slot = std::move(subscriber);
+	everything.emplace(slot.get(), slot);
+	format_subscribers[static_cast<std::size_t>(format)].fetch_add(1, std::memory_order_relaxed);
+}
+// Connection is going away, after this returns no sender touches it again.
+void Broadcaster::unsubscribe(crow::websocket::connection* conn) {
+	std::shared_ptr<Subscriber> subscriber;
+	{
+		std::unique_lock<std::shared_mutex> lock(subscribers_mutex);
+		auto it = subscribers.find(conn);
+		if (it == subscribers.end()) return;
+		subscriber = std::move(it->second);
+		subscribers.erase(it);
+		format_subscribers[static_cast<std::size_t>(subscriber->format)].fetch_sub(1, std::memory_order_relaxed);
+		everything.erase(subscriber.get());
+		unindex_filter(subscriber.get(), subscriber->filter);
+	}
+	std::lock_guard<std::mutex> lock(subscriber->queue_mutex);
+	subscriber->closed = true;
+	queue_depth.fetch_sub(static_cast<long long>(subscriber->queue.size()), std::memory_order_relaxed);
+	subscriber->queue.clear();
+	subscriber->replay.clear();
+}
+// Frames already queued keep the format they were queued in.
+void Broadcaster::set_format(crow::websocket::connection* conn, WireFormat format) {
+	std::unique_lock<std::shared_mutex> lock(subscribers_mutex);
+	auto it = subscribers.find(conn);
+	if (it == subscribers.end()) return;
+	std::lock_guard<std::mutex> queue_lock(it->second->queue_mutex);
+	format_subscribers[static_cast<std::size_t>(it->second->format)].fetch_sub(1, std::memory_order_relaxed);
+	it->second->format = format;
+	format_subscribers[static_cast<std::size_t>(format)].fetch_add(1, std::memory_order_relaxed);
+}
+bool Broadcaster::wants(WireFormat format) const {
+	return format_subscribers[static_cast<std::size_t>(format)].load(std::memory_order_relaxed) > 0;
+}
+// Index every key of the filter under the subscriber.
+void Broadcaster::index_filter(const std::shared_ptr<Subscriber>& subscriber, const IncidentFilter& filter) {
+	for (long long system : filter.systems) by_system[system].emplace(subscriber.get(), subscriber);
+	for (const std::string& tribe : filter.tribes) by_tribe[tribe].emplace(subscriber.get(), subscriber);
+	for (const std::string& character : filter.characters) by_character[character].emplace(subscriber.get(), subscriber);
+	for (int loss_type : filter.loss_types) by_loss_type[loss_type].emplace(subscriber.get(), subscriber);
+}
+// Take the subscriber out from under each key, keys nobody wants any more go too.
+template <typename Index, typename Key, typename Pointer>
+static void unindex(Index& index, const Key& key, Pointer subscriber) {
+	auto it = index.find(key);
+	if (it == index.end()) return;
+	it->second.erase(subscriber);
+	if (it->second.empty()) index.erase(it);
+}
+void Broadcaster::unindex_filter(Subscriber* subscriber, const IncidentFilter& filter) {
+	for (long long system : filter.systems) unindex(by_system, system, subscriber);
+	for (const std::string& tribe : filter.tribes) unindex(by_tribe, tribe, subscriber);
+	for (const std::string& character : filter.characters) unindex(by_character, character, subscriber);
+	for (int loss_type : filter.loss_types) unindex(by_loss_type, loss_type, subscriber);
+}
+// The first filter takes a subscriber off the everything list.
+bool Broadcaster::add_filter(crow::websocket::connection* conn, const IncidentFilter& filter, std::size_t limit) {
+	std::unique_lock<std::shared_mutex> lock(subscribers_mutex);
+	auto it = subscribers.find(conn);
+	if (it == subscribers.end()) return false;
+	const std::shared_ptr<Subscriber>& subscriber = it->second;
+	IncidentFilter added;
+	for (long long system : filter.systems) if (!subscriber->filter.systems.count(system)) added.systems.insert(system);
+	for (const std::string& tribe : filter.tribes) if (!subscriber->filter.tribes.count(tribe)) added.tribes.insert(tribe);
+	for (const std::string& character : filter.characters) if (!subscriber->filter.characters.count(character)) added.characters.insert(character);
+	for (int loss_type : filter.loss_types) if (!subscriber->filter.loss_types.count(loss_type)) added.loss_types.insert(loss_type);
+	if (subscriber->filter.size() + added.size() > limit) return false;
+	subscriber->everything = false;
+	everything.erase(subscriber.get());
+	subscriber->filter.systems.insert(added.systems.begin(), added.systems.end());
+	subscriber->filter.tribes.insert(added.tribes.begin(), added.tribes.end());
+	subscriber->filter.characters.insert(added.characters.begin(), added.characters.end());
+	subscriber->filter.loss_types.insert(added.loss_types.begin(), added.loss_types.end());
+	index_filter(subscriber, added);
+	return true;
+}
+// Removing the last filter leaves a subscriber matching nothing, match_all is the way back.
+void Broadcaster::remove_filter(crow::websocket::connection* conn, const IncidentFilter& filter) {
+	std::unique_lock<std::shared_mutex> lock(subscribers_mutex);
+	auto it = subscribers.find(conn);
+	if (it == subscribers.end() || it->second->everything) return;
+	Subscriber* subscriber = it->second.get();
+	IncidentFilter removed;
+	for (long long system : filter.systems) if (subscriber->filter.systems.erase(system)) removed.systems.insert(system);
+	for (const std::string& tribe : filter.tribes) if (subscriber->filter.tribes.erase(tribe)) removed.tribes.insert(tribe);
+	for (const std::string& character : filter.characters) if (subscriber->filter.characters.erase(character)) removed.characters.insert(character);
+	for (int loss_type : filter.loss_types) if (subscriber->filter.loss_types.erase(loss_type)) removed.loss_types.insert(loss_type);
+	unindex_filter(subscriber, removed);
+}
+void Broadcaster::match_all(crow::websocket::connection* conn) {
+	std::unique_lock<std::shared_mutex> lock(subscribers_mutex);
+	auto it = subscribers.find(conn);
+	if (it == subscribers.end() || it->second->everything) return;
+	unindex_filter(it->second.get(), it->second->filter);
+	it->second->filter = IncidentFilter();
+	it->second->everything = true;
+	everything.emplace(it->second.get(), it->second);
+}
+std::size_t Broadcaster::filter_size(crow::websocket::connection* conn) const {
+	std::shared_lock<std::shared_mutex> lock(subscribers_mutex);
+	auto it = subscribers.find(conn);
+	return it == subscribers.end() ? 0 : it->second->filter.size();
+}
+// Everyone on the everything list plus whoever the incident's keys lead to, each once.
+void Broadcaster::publish(const BroadcastFrames& frames, const IncidentRecord& incident) {
+	published.fetch_add(1, std::memory_order_relaxed);
+	std::lock_guard<std::mutex> log_lock(log_mutex);
+	// A backfill may have logged it already, it moves to where it was committed and still goes out live to everyone
+	// who has not been replayed it.
+	if (!backfilled.erase(incident.id)) {
+		log.push_back(LoggedIncident{incident.id, frames});
+		trim_log();
+	} else {
+		auto logged = std::find_if(log.begin(), log.end(), [&incident](const LoggedIncident& entry) { return entry.id == incident.id; });
+		if (logged != log.end()) {
+			LoggedIncident entry = std::move(*logged);
+			log.erase(logged);
+			log.push_back(std::move(entry));
+		}
+	}
+	// Keys the incident can be matched on
+	std::string tribes[] = {tribe_filter_key(incident.victim_tribe_name), tribe_filter_key(incident.killer_tribe_name)};
+	std::vector<std::string> characters;
+	std::pair<CharacterKey, const std::string*> fields[] = {
+		{CharacterKey::Id, &incident.victim_id}, {CharacterKey::Name, &incident.victim_name}, {CharacterKey::Address, &incident.victim_address},
+		{CharacterKey::Id, &incident.killer_id}, {CharacterKey::Name, &incident.killer_name}, {CharacterKey::Address, &incident.killer_address}};
+	for (const auto& [kind, text] : fields) {
+		if (text->empty()) continue;
+		std::string key = character_filter_key(kind, *text);
+		if (!key.empty()) characters.push_back(std::move(key));
+	}
+	// Snapshot the matches so connects and disconnects never wait on the fan out.
+	std::vector<std::shared_ptr<Subscriber>> targets;
+	std::size_t subscriber_count = 0;
+	{
+		std::shared_lock<std::shared_mutex> lock(subscribers_mutex);
+		subscriber_count = subscribers.size();
+		targets.reserve(everything.size());
+		for (const auto& entry : everything) targets.push_back(entry.second);
+		std::size_t unfiltered = targets.size();
+		auto collect = [&targets](const auto& index, const auto& key) {
+			auto it = index.find(key);
+			if (it == index.end()) return;
+			for (const auto& entry : it->second) targets.push_back(entry.second);
+		};
+		collect(by_system, incident.solar_system_id);
+		collect(by_loss_type, incident.loss_type);
+		for (const std::string& tribe : tribes) {
+			if (!tribe.empty()) collect(by_tribe, tribe);
+		}
+		for (const std::string& character : characters) collect(by_character, character);
+		// A subscriber can match on several keys, but gets the incident once.
+		if (targets.size() > unfiltered) {
+			std::sort(targets.begin() + unfiltered, targets.end());
+			targets.erase(std::unique(targets.begin() + unfiltered, targets.end()), targets.end());
+		}
+	}
+	filtered.fetch_add(subscriber_count - targets.size(), std::memory_order_relaxed);
+	for (const auto& subscriber : targets) {
+		enqueue(subscriber, frames, incident.id);
+	}
+}
+// Oldest first, whatever leaves the log can only be replayed from the database again.
+void Broadcaster::trim_log() {
+	while (log.size() > log_limit) {
+		floor = std::max(floor, log.front().id);
+		backfilled.erase(log.front().id);
+		log.pop_front();
+	}
+}
+// Subscribe under the log lock, so every incident is either in the replay or arrives live after it.
+std::optional<long long> Broadcaster::resume(crow::websocket::connection* conn, WireFormat format, long long since) {
+	std::lock_guard<std::mutex> log_lock(log_mutex);
+	subscribe(conn, format);
+	std::shared_ptr<Subscriber> subscriber;
+	{
+		std::shared_lock<std::shared_mutex> lock(subscribers_mutex);
+		subscriber = subscribers.at(conn);
+	}
+	if (floor_known && since >= floor) {
+		release(subscriber, since, true);
+		return std::nullopt;
+	}
+	{
+		std::lock_guard<std::mutex> lock(subscriber->queue_mutex);
+		subscriber->held = true;
+	}
+	awaiting.push_back(Awaiting{subscriber, since});
+	// One backfill at a time, the ones arriving meanwhile with an older since are picked up when it lands.
+	if (backfilling) return std::nullopt;
+	backfilling = true;
+	backfill_since = since;
+	return since;
+}
+// Merge newest incidents, then everything above the oldest of them is in the log or still to be published.
+std::optional<long long> Broadcaster::backfill(long long since, std::vector<LoggedIncident> incidents, bool succeeded) {
+	std::lock_guard<std::mutex> log_lock(log_mutex);
+	backfills.fetch_add(1, std::memory_order_relaxed);
+	if (succeeded) {
+		// Reading fewer than asked for means nothing after since is missing.
+		long long complete_above = since;
+		if (incidents.size() >= log_limit) {
+			complete_above = incidents.front().id;
+			for (const auto& incident : incidents) complete_above = std::min(complete_above, incident.id);
+			complete_above -= 1;
+		}
+		std::unordered_set<long long> logged;
+		for (const auto& entry : log) logged.insert(entry.id);
+		// Their commit order is unknown, so they go ahead of everything published, in id order.
+		std::vector<LoggedIncident> older;
+		for (auto& incident : incidents) {
+			if (logged.count(incident.id)) continue;
+			backfilled.insert(incident.id);
+			older.push_back(std::move(incident));
+		}
+		std::sort(older.begin(), older.end(), [](const LoggedIncident& a, const LoggedIncident& b) { return a.id < b.id; });
+		log.insert(log.begin(), std::make_move_iterator(older.begin()), std::make_move_iterator(older.end()));
+		floor = floor_known ? std::min(floor, complete_above) : complete_above;
+		floor_known = true;
+		trim_log();
+	}
+	// Covered now, or asked for more than any backfill can give. Older ones that came in meanwhile wait for the next.
+	std::optional<long long> next;
+	std::vector<Awaiting> still_waiting;
+	for (auto& entry : awaiting) {
+		if (floor_known && entry.since >= floor) {
+			release(entry.subscriber, entry.since, true);
+		} else if (succeeded && entry.since < since) {
+			next = next ? std::min(*next, entry.since) : entry.since;
+			still_waiting.push_back(std::move(entry));
+		} else {
+			release(entry.subscriber, entry.since, false);
+		}
+	}
+	awaiting.swap(still_waiting);
+	backfilling = next.has_value();
+	if (next) backfill_since = *next;
+	return next;
+}
+// Logged incidents after since that are not already queued live, then a summary, ahead of anything live. Ids are
+// handed out before commit, so while since is still logged everything published after it goes, lower ids included.
+// Backfilled incidents not published yet have no commit position and go by id.
+void Broadcaster::release(const std::shared_ptr<Subscriber>& subscriber, long long since, bool complete) {
+	bool wake = false;
+	{
+		std::lock_guard<std::mutex> lock(subscriber->queue_mutex);
+		if (subscriber->closed) return;
+		std::unordered_set<long long> queued;
+		for (const Frame& frame : subscriber->queue) queued.insert(frame.id);
+		std::size_t index = static_cast<std::size_t>(subscriber->format);
+		auto last_seen = std::find_if(log.rbegin(), log.rend(), [since](const LoggedIncident& entry) { return entry.id == since; });
+		std::size_t start = static_cast<std::size_t>(log.rend() - last_seen);
+		long long first = 0;
+		for (std::size_t position = 0; position < log.size(); position++) {
+			LoggedIncident& entry = log[position];
+			bool after = (last_seen == log.rend() || backfilled.count(entry.id)) ? entry.id > since : position >= start;
+			if (!after || queued.count(entry.id)) continue;
+			// Formats nobody read when it was published are encoded now, once.
+			Frame frame{entry.frames[index], subscriber->format != WireFormat::Json, entry.id};
+			if (!frame.payload) {
+				try {
+					entry.frames[index] = std::make_shared<const std::string>(transcode_json(*entry.frames[0], subscriber->format));
+					frame.payload = entry.frames[index];
+				} catch (const std::exception& e) {
+					std::cerr << "Error: Replay frame not re-encoded: " << e.what() << std::endl;
+					frame = Frame{entry.frames[0], false, entry.id};
+				}
+			}
+			first = first ? std::min(first, entry.id) : entry.id;
+			if (backfilled.count(entry.id)) subscriber->replayed.insert(entry.id);
+			subscriber->replay.push_back(std::move(frame));
+		}
+		replayed.fetch_add(subscriber->replay.size(), std::memory_order_relaxed);
+		// Summary as a JSON text frame, an incomplete replay names where the database has to fill in.
+		std::string summary = "{\"replay\":{\"since\":" + std::to_string(since)
+			+ ",\"replayed\":" + std::to_string(subscriber->replay.size())
+			+ ",\"complete\":" + (complete ? "true" : "false");
+		if (!complete) summary += ",\"first_id\":" + (first ? std::to_string(first) : std::string("null"));
+		summary += "}}";
+		subscriber->replay.push_back(Frame{std::make_shared<const std::string>(std::move(summary)), false, 0});
+		subscriber->held = false;
+		if (!subscriber->scheduled) {
+			subscriber->scheduled = true;
+			wake = true;
+		}
+	}
+	if (wake) schedule(subscriber);
+}
+// Queue for one subscriber and apply the queue full policy when the senders have fallen behind it.
+void Broadcaster::enqueue(const std::shared_ptr<Subscriber>& subscriber, const BroadcastFrames& frames, long long id) {
+	bool wake = false;
+	{
+		std::lock_guard<std::mutex> lock(subscriber->queue_mutex);
+		if (subscriber->closed) return;
+		// Already sent by its replay
+		if (!subscriber->replayed.empty() && subscriber->replayed.erase(id)) return;
+		// A subscriber that switched after the frames were encoded gets JSON for this one.
+		Frame frame{frames[static_cast<std::size_t>(subscriber->format)], subscriber->format != WireFormat::Json, id};
+		if (!frame.payload) frame = Frame{frames[static_cast<std::size_t>(WireFormat::Json)], false, id};
+		if (subscriber->queue.size() >= queue_limit) {
+			if (policy == QueueFullPolicy::Disconnect) {
+				// Stop feeding it, Crow's close handler unsubscribes it for good.
+				subscriber->closed = true;
+				dropped.fetch_add(subscriber->queue.size() + 1, std::memory_order_relaxed);
+				queue_depth.fetch_sub(static_cast<long long>(subscriber->queue.size()), std::memory_order_relaxed);
+				subscriber->queue.clear();
+				disconnected.fetch_add(1, std::memory_order_relaxed);
+				subscriber->conn->close("Incident queue overflowed.");
+				return;
+			}
+			subscriber->queue.pop_front();
+			queue_depth.fetch_sub(1, std::memory_order_relaxed);
+			dropped.fetch_add(1, std::memory_order_relaxed);
+		}
+		subscriber->queue.push_back(std::move(frame));
+		long long depth = static_cast<long long>(subscriber->queue.size());
+		long long seen = queue_depth_max.load(std::memory_order_relaxed);
+		while (depth > seen && !queue_depth_max.compare_exchange_weak(seen, depth, std::memory_order_relaxed)) {}
+		queue_depth.fetch_add(1, std::memory_order_relaxed);
+		// A held subscriber is scheduled once its replay is in place.
+		if (!subscriber->scheduled && !subscriber->held) {
+			subscriber->scheduled = true;
+			wake = true;
+		}
+	}
+	if (wake) schedule(subscriber);
+}
+// Each subscriber is in the ready list at most once, so its payloads stay in order.
+void Broadcaster::schedule(const std::shared_ptr<Subscriber>& subscriber) {
+	{
+		std::lock_guard<std::mutex> lock(ready_mutex);
+		ready.push_back(subscriber);
+	}
+	ready_cv.notify_one();
+}
+// Drain ready subscribers one payload at a time, Crow writes each one on the connection's own I/O thread.
+void Broadcaster::sender_loop() {
+	while (true) {
+		std::shared_ptr<Subscriber> subscriber;
+		{
+			std::unique_lock<std::mutex> lock(ready_mutex);
+			ready_cv.wait(lock, [this] { return stopping || !ready.empty(); });
+			if (ready.empty()) return;
+			subscriber = std::move(ready.front());
+			ready.pop_front();
+		}
+		while (true) {
+			std::lock_guard<std::mutex> lock(subscriber->queue_mutex);
+			if (subscriber->closed || subscriber->held || (subscriber->replay.empty() && subscriber->queue.empty())) {
+				subscriber->scheduled = false;
+				break;
+			}
+			Frame frame;
+			if (!subscriber->replay.empty()) {
+				frame = std::move(subscriber->replay.front());
+				subscriber->replay.pop_front();
+			} else {
+				frame = std::move(subscriber->queue.front());
+				subscriber->queue.pop_front();
+				queue_depth.fetch_sub(1, std::memory_order_relaxed);
+			}
+			if (frame.binary) {
+				subscriber->conn->send_binary(*frame.payload);
+			} else {
+				subscriber->conn->send_text(*frame.payload);
+			}
+			delivered.fetch_add(1, std::memory_order_relaxed);
+		}
+	}
+}
+// Encode once per format someone reads, every subscriber of that format shares it.
+BroadcastFrames Broadcaster::frames(const IncidentRecord& incident) const {
+	nlohmann::ordered_json document;
+	document["id"] = incident.id;
+	document["victim_tribe_name"] = incident.victim_tribe_name;
+	document["victim_name"] = incident.victim_name;
+	document["victim_address"] = incident.victim_address;
+	// Hard write "ship" if loss_type is 0
+	document["loss_type"] = (incident.loss_type == 0) ? "ship/structure" : std::to_string(incident.loss_type);
+	document["killer_tribe_name"] = incident.killer_tribe_name;
+	document["killer_name"] = incident.killer_name;
+	document["killer_address"] = incident.killer_address;
+	document["time_stamp"] = incident.time_stamp;
+	document["solar_system_id"] = incident.solar_system_id;
+	document["solar_system_name"] = incident.solar_system_name;
+	BroadcastFrames encoded;
+	encoded[static_cast<std::size_t>(WireFormat::Json)] = std::make_shared<const std::string>(encode_document(document, WireFormat::Json));
+	for (WireFormat format : {WireFormat::MsgPack, WireFormat::Cbor}) {
+		if (!wants(format)) continue;
+		encoded[static_cast<std::size_t>(format)] = std::make_shared<const std::string>(encode_document(document, format));
+	}
+	return encoded;
+}
+// Copy the counters out
+BroadcastStats Broadcaster::stats() const {
+	BroadcastStats snapshot;
+	{
+		std::shared_lock<std::shared_mutex> lock(subscribers_mutex);
+		snapshot.subscribers = subscribers.size();
+	}
+	snapshot.published = published.load(std::memory_order_relaxed);
+	snapshot.delivered = delivered.load(std::memory_order_relaxed);
+	snapshot.dropped = dropped.load(std::memory_order_relaxed);
+	snapshot.filtered = filtered.load(std::memory_order_relaxed);
+	snapshot.disconnected = disconnected.load(std::memory_order_relaxed);
+	snapshot.queue_depth = static_cast<unsigned long long>(std::max(0LL, queue_depth.load(std::memory_order_relaxed)));
+	snapshot.queue_depth_max = static_cast<unsigned long long>(queue_depth_max.load(std::memory_order_relaxed));
+	snapshot.replayed = replayed.load(std::memory_order_relaxed);
+	snapshot.backfills = backfills.load(std::memory_order_relaxed);
+	{
+		std::lock_guard<std::mutex> lock(log_mutex);
+		snapshot.log_size = log.size();
+	}
+	return snapshot;
+}
+// Lower case copy
+static std::string lowered(std::string_view text) {
+	std::string lower(text);
+	std::transform(lower.begin(), lower.end(), lower.begin(), [](unsigned char c) { return std::tolower(c); });
+	return lower;
+}
+std::string tribe_filter_key(std::string_view name) {
+	return lowered(name);
+}
+// Prefixed with the kind so an id, a name and an address can never collide.
+std::string character_filter_key(CharacterKey kind, std::string_view text) {
+	switch (kind) {
+		case CharacterKey::Id: return "i:" + std::string(text);
+		case CharacterKey::Name: return "n:" + lowered(text);
+		case CharacterKey::Address: {
+			std::string hex;
+			if (!normalize_address(text, hex) || hex.size() != 2 * AddressIndex::width) return "";
+			return "a:" + hex;
+		}
+	}
+	return "";
+}
+// Process wide broadcaster, drop oldest unless told to disconnect.
+Broadcaster& mail_broadcaster() {
+	static Broadcaster broadcaster(env_size("WEBSOCKET_QUEUE_SIZE", 256),
+		[] {
+			const char* value = std::getenv("WEBSOCKET_QUEUE_FULL");
+			return (value && std::string(value) == "disconnect") ? QueueFullPolicy::Disconnect : QueueFullPolicy::DropOldest;
+		}(),
+		env_size("WEBSOCKET_SENDERS", 2),
+		env_size("WEBSOCKET_REPLAY_SIZE", 10000));
+	return broadcaster;
+}
@@ -0,0 +1,177 @@
+#pragma once
+#include "crow.h"
+#include <memory>
+#include <mutex>
+#include <shared_mutex>
+#include <condition_variable>
+#include <deque>
+#include <vector>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <atomic>
+#include <unordered_map>
+#include <unordered_set>
+#include <array>
+#include <optional>
+#include "WireFormat.h"
+#include "IncidentRing.h"
+// What to do with a subscriber whose queue is full. The queue only holds incidents waiting for a sender
+// thread, Crow buffers whatever it is handed without a limit and reports no flush, so this is not
+// backpressure from the subscriber's socket and a slow reader is not detected by it.
+enum class QueueFullPolicy {
+	DropOldest,
+	Disconnect
+};
+// Snapshot of broadcast counters for health and metrics.
+struct BroadcastStats {
+	unsigned long long subscribers = 0;
+	unsigned long long published = 0;
+	unsigned long long delivered = 0;
+	unsigned long long dropped = 0;
+	unsigned long long filtered = 0;
+	unsigned long long disconnected = 0;
+	unsigned long long queue_depth = 0;
+	unsigned long long queue_depth_max = 0;
+	unsigned long long replayed = 0;
+	unsigned long long backfills = 0;
+	unsigned long long log_size = 0;
+};
+// Incidents a subscriber asked for, any one key matching is enough. Keys are normalized with the helpers below.
+struct IncidentFilter {
+	std::unordered_set<long long> systems;
+	std::unordered_set<std::string> tribes;
+	std::unordered_set<std::string> characters;
+	std::unordered_set<int> loss_types;
+	std::size_t size() const { return systems.size() + tribes.size() + characters.size() + loss_types.size(); }
+};
+// One incident encoded once per format, JSON is always present and the others only when someone asked for them.
+using BroadcastFrames = std::array<std::shared_ptr<const std::string>, wire_format_count>;
+// A published incident kept for replay, or one read back from the database to fill the log.
+struct LoggedIncident {
+	long long id = 0;
+	BroadcastFrames frames;
+};
+// Fans one serialized payload out to every /mails subscriber through bounded per-connection hand-off queues.
+class Broadcaster {
+	// Public Members
+	public:
+		Broadcaster(std::size_t queue_limit, QueueFullPolicy policy, std::size_t sender_count, std::size_t log_limit);
+		~Broadcaster();
+		Broadcaster(const Broadcaster&) = delete;
+		Broadcaster& operator=(const Broadcaster&) = delete;
+		void subscribe(crow::websocket::connection* conn, WireFormat format = WireFormat::Json);
+		void unsubscribe(crow::websocket::connection* conn);
+		// Switch the frames a subscriber gets from its next incident on.
+		void set_format(crow::websocket::connection* conn, WireFormat format);
+		// Any subscriber reading this format, so the publisher can skip encodings nobody reads.
+		bool wants(WireFormat format) const;
+		// Live and replayed incidents are both framed here, so they carry the same keys and value types.
+		BroadcastFrames frames(const IncidentRecord& incident) const;
+		// Narrow a subscriber to its filters plus these, false and unchanged when it would hold more than the limit.
+		bool add_filter(crow::websocket::connection* conn, const IncidentFilter& filter, std::size_t limit);
+		void remove_filter(crow::websocket::connection* conn, const IncidentFilter& filter);
+		// Back to every incident, the filters are dropped.
+		void match_all(crow::websocket::connection* conn);
+		// Keys a subscriber filters on, 0 for one getting everything.
+		std::size_t filter_size(crow::websocket::connection* conn) const;
+		// Queue the matching subscribers their format's frame, never blocks on a client.
+		void publish(const BroadcastFrames& frames, const IncidentRecord& incident);
+		// Subscribe and replay every incident logged after since ahead of the live ones, without gaps or repeats.
+		// When the log does not reach back that far the subscriber is held until a backfill covers it, and the
+		// since to backfill from is returned if no backfill already running will do.
+		std::optional<long long> resume(crow::websocket::connection* conn, WireFormat format, long long since);
+		// Merge the newest incidents after since read from the database and release the held subscribers.
+		// Returns the since of one more backfill when subscribers arrived wanting older incidents meanwhile.
+		std::optional<long long> backfill(long long since, std::vector<LoggedIncident> incidents, bool succeeded);
+		// Most incidents a backfill should read, the log keeps no more than this.
+		std::size_t log_capacity() const { return log_limit; }
+		BroadcastStats stats() const;
+	// Private Members
+	private:
+		struct Frame {
+			std::shared_ptr<const std::string> payload;
+			bool binary = false;
+			long long id = 0;
+		};
+		struct Subscriber {
+			crow::websocket::connection* conn = nullptr;
+			// Matching state, kept with subscribers_mutex held.
+			bool everything = true;
+			IncidentFilter filter;
+			std::mutex queue_mutex; // Also held while handing a payload to Crow, so unsubscribe waits it out.
+			std::deque<Frame> queue;
+			std::deque<Frame> replay; // Drained before the queue and outside its limit.
+			std::unordered_set<long long> replayed; // Backfilled ids it was sent that may still be published live.
+			WireFormat format = WireFormat::Json;
+			bool held = false; // Live frames queue up but are not sent until its replay is in place.
+			bool scheduled = false;
+			bool closed = false;
+		};
+		// Resume waiting on a backfill
+		struct Awaiting {
+			std::shared_ptr<Subscriber> subscriber;
+			long long since = 0;
+		};
+		void enqueue(const std::shared_ptr<Subscriber>& subscriber, const BroadcastFrames& frames, long long id);
+		void schedule(const std::shared_ptr<Subscriber>& subscriber);
+		// Hand a subscriber the logged incidents after since, log_mutex held.
+		void release(const std::shared_ptr<Subscriber>& subscriber, long long since, bool complete);
+		void trim_log();
+		// Add or take a subscriber's keys out of the index.
+		void index_filter(const std::shared_ptr<Subscriber>& subscriber, const IncidentFilter& filter);
+		void unindex_filter(Subscriber* subscriber, const IncidentFilter& filter);
+		void sender_loop();
+		std::size_t queue_limit;
+		QueueFullPolicy policy;
+		mutable std::shared_mutex subscribers_mutex;
+		std::unordered_map<crow::websocket::connection*, std::shared_ptr<Subscriber>> subscribers;
+		std::array<std::atomic<long long>, wire_format_count> format_subscribers{}; // Per format, kept with subscribers_mutex held.
+		// Subscription index, so an incident only visits the subscribers it matches.
+		template <typename Key>
+		using SubscriberIndex = std::unordered_map<Key, std::unordered_map<Subscriber*, std::shared_ptr<Subscriber>>>;
+		std::unordered_map<Subscriber*, std::shared_ptr<Subscriber>> everything;
+		SubscriberIndex<long long> by_system;
+		SubscriberIndex<std::string> by_tribe;
+		SubscriberIndex<std::string> by_character;
+		SubscriberIndex<int> by_loss_type;
+		// Replay log in publish order, which is commit order, with backfilled incidents ahead in id order.
+		// Ids at or below floor may be missing from it.
+		mutable std::mutex log_mutex; // Held through publish, so a resume sees each incident either in the log or live.
+		std::deque<LoggedIncident> log;
+		std::size_t log_limit;
+		long long floor = 0;
+		bool floor_known = false; // Nothing is known to be complete until the first backfill.
+		std::unordered_set<long long> backfilled; // Logged from the database, not yet published live.
+		std::vector<Awaiting> awaiting;
+		bool backfilling = false;
+		long long backfill_since = 0;
+		// Subscribers with queued payloads, waiting for a sender.
+		std::mutex ready_mutex;
+		std::condition_variable ready_cv;
+		std::deque<std::shared_ptr<Subscriber>> ready;
+		bool stopping = false;
+		std::vector<std::thread> senders;
+		// Counters
+		std::atomic<unsigned long long> published{0};
+		std::atomic<unsigned long long> delivered{0};
+		std::atomic<unsigned long long> dropped{0};
+		std::atomic<unsigned long long> filtered{0};
+		std::atomic<unsigned long long> disconnected{0};
+		std::atomic<long long> queue_depth{0};
+		std::atomic<long long> queue_depth_max{0};
+		std::atomic<unsigned long long> replayed{0};
+		std::atomic<unsigned long long> backfills{0};
+};
+// How a character filter names its character, the kind is always stated and never guessed from the text.
+enum class CharacterKey {
+	Id,
+	Name,
+	Address
+};
+// Filter keys: tribe names ignore case, characters match by id, name ignoring case, or address with or without 0x.
+std::string tribe_filter_key(std::string_view name);
+// Empty when an address is not a full width of hex digits.
+std::string character_filter_key(CharacterKey kind, std::string_view text);
+// Process wide /mails broadcaster, configured from WEBSOCKET_QUEUE_SIZE, WEBSOCKET_QUEUE_FULL, WEBSOCKET_SENDERS and WEBSOCKET_REPLAY_SIZE.
+Broadcaster& mail_broadcaster();
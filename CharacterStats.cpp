@@ -0,0 +1,101 @@
+#include "CharacterStats.h"
+#include "QueryCatalog.h"
+#include <algorithm>
+#include <iostream>
+#include <mutex>
+#include <functional>
+// One aggregate pass over the incident history.
+void CharacterStats::seed(pqxx::transaction_base& txn) {
+	pqxx::result res = exec_statement(txn, "character_stats");
+	std::unique_lock<std::shared_mutex> lock(stats_mutex);
+	stats.clear();
+	stats.reserve(res.size());
+	for (const auto& row : res) {
+		CharacterTotals totals;
+		totals.id = row["id"].as<std::string>();
+		totals.name = row["name"].is_null() ? "" : row["name"].as<std::string>();
+		totals.kills = row["kills"].as<long long>();
+		totals.losses = row["losses"].as<long long>();
+		totals.first_seen = row["first_seen"].as<long long>();
+		totals.last_seen = row["last_seen"].as<long long>();
+		std::string id = totals.id;
+		stats.emplace(std::move(id), std::move(totals));
+	}
+	seeded = true;
+	std::cout << "Character stats seeded." << std::endl;
+}
+// Both sides of one incident.
+void CharacterStats::record(const IncidentRecord& incident) {
+	std::unique_lock<std::shared_mutex> lock(stats_mutex);
+	if (!seeded) return;
+	if (!incident.killer_id.empty()) count(incident.killer_id, incident.killer_name, 1, 0, incident.time_stamp);
+	if (!incident.victim_id.empty()) count(incident.victim_id, incident.victim_name, 0, 1, incident.time_stamp);
+}
+// Caller holds the write lock, a name from the stream replaces an older one.
+void CharacterStats::count(const std::string& id, const std::string& name, long long kills, long long losses, long long time_stamp) {
+	auto [it, inserted] = stats.try_emplace(id);
+	CharacterTotals& totals = it->second;
+	if (inserted) {
+		totals.id = id;
+		totals.first_seen = time_stamp;
+		totals.last_seen = time_stamp;
+	}
+	if (!name.empty()) totals.name = name;
+	totals.kills += kills;
+	totals.losses += losses;
+	totals.first_seen = std::min(totals.first_seen, time_stamp);
+	totals.last_seen = std::max(totals.last_seen, time_stamp);
+}
+bool CharacterStats::ready() const {
+	std::shared_lock<std::shared_mutex> lock(stats_mutex);
+	return seeded;
+}
+// Highest counts and latest times first, names alphabetical, ties settled by id so pages are stable.
+static std::function<bool(const CharacterTotals*, const CharacterTotals*)> totals_order(const std::string& sort) {
+	auto by = [](auto score) {
+		return [score](const CharacterTotals* a, const CharacterTotals* b) {
+			auto score_a = score(*a);
+			auto score_b = score(*b);
+			if (score_a != score_b) return score_a > score_b;
+			return a->id < b->id;
+		};
+	};
+	if (sort == "kills") return by([](const CharacterTotals& row) { return std::make_pair(row.kills, row.losses); });
+	if (sort == "losses") return by([](const CharacterTotals& row) { return std::make_pair(row.losses, row.kills); });
+	if (sort == "last_seen") return by([](const CharacterTotals& row) { return row.last_seen; });
+	if (sort == "first_seen") return by([](const CharacterTotals& row) { return row.first_seen; });
+	if (sort == "name") {
+		return [](const CharacterTotals* a, const CharacterTotals* b) {
+			if (a->name != b->name) return a->name < b->name;
+			return a->id < b->id;
+		};
+	}
+	return nullptr;
+}
+// Sort pointers under the read lock, only the rows kept are copied out.
+bool CharacterStats::ranking(const std::vector<std::string>* ids, const char* sort_param, std::size_t limit, std::vector<CharacterTotals>& out) const {
+	auto before = totals_order(sort_param ? sort_param : "kills");
+	if (!before) return false;
+	std::shared_lock<std::shared_mutex> lock(stats_mutex);
+	std::vector<const CharacterTotals*> rows;
+	if (ids) {
+		for (const auto& id : *ids) {
+			auto it = stats.find(id);
+			if (it != stats.end()) rows.push_back(&it->second);
+		}
+	} else {
+		rows.reserve(stats.size());
+		for (const auto& [id, totals] : stats) rows.push_back(&totals);
+	}
+	std::size_t keep = std::min(limit, rows.size());
+	std::partial_sort(rows.begin(), rows.begin() + keep, rows.end(), before);
+	out.clear();
+	out.reserve(keep);
+	for (std::size_t i = 0; i < keep; i++) out.push_back(*rows[i]);
+	return true;
+}
+// Process wide character stats
+CharacterStats& character_stats() {
+	static CharacterStats stats;
+	return stats;
+}
@@ -0,0 +1,35 @@
+#pragma once
+#include <pqxx/pqxx>
+#include <string>
+#include <vector>
+#include <unordered_map>
+#include <shared_mutex>
+#include "IncidentRing.h"
+// All-time activity of one character.
+struct CharacterTotals {
+	std::string id;
+	std::string name;
+	long long kills = 0;
+	long long losses = 0;
+	long long first_seen = 0;
+	long long last_seen = 0;
+};
+// Kills, losses and first/last seen per character, kept current from the listener for /totals?name=.
+class CharacterStats {
+	// Public Members
+	public:
+		void seed(pqxx::transaction_base& txn);
+		void record(const IncidentRecord& incident);
+		bool ready() const;
+		// Best ranked characters among the ids, or among everyone seen in an incident when ids is null.
+		// Sorts by kills (the default), losses, name, first_seen or last_seen, false for any other sort.
+		bool ranking(const std::vector<std::string>* ids, const char* sort_param, std::size_t limit, std::vector<CharacterTotals>& out) const;
+	// Private Members
+	private:
+		void count(const std::string& id, const std::string& name, long long kills, long long losses, long long time_stamp);
+		mutable std::shared_mutex stats_mutex;
+		std::unordered_map<std::string, CharacterTotals> stats;
+		bool seeded = false;
+};
+// Process wide character stats
+CharacterStats& character_stats();
@@ -0,0 +1,112 @@
+#include "Compression.h"
+#include "Env.h"
+#include "HeaderList.h"
+#include <zlib.h>
+#include <stdexcept>
+// Walk the comma separated codings and keep the best one with a non zero q.
+ContentEncoding negotiate_encoding(const std::string& accept_encoding) {
+	double gzip_q = -1.0;
+	double deflate_q = -1.0;
+	double any_q = -1.0;
+	for (const WeightedToken& entry : weighted_tokens(accept_encoding)) {
+		if (entry.token == "gzip" || entry.token == "x-gzip") gzip_q = entry.q;
+		else if (entry.token == "deflate") deflate_q = entry.q;
+		else if (entry.token == "*") any_q = entry.q;
+	}
+	if (gzip_q < 0) gzip_q = any_q;
+	if (deflate_q < 0) deflate_q = any_q;
+	if (gzip_q <= 0 && deflate_q <= 0) return ContentEncoding::Identity;
+	return gzip_q >= deflate_q ? ContentEncoding::Gzip : ContentEncoding::Deflate;
+}
+const char* encoding_name(ContentEncoding encoding) {
+	switch (encoding) {
+		case ContentEncoding::Gzip: return "gzip";
+		case ContentEncoding::Deflate: return "deflate";
+		default: return "identity";
+	}
+}
+// One deflate pass over the whole body.
+std::string compress_body(const std::string& body, ContentEncoding encoding) {
+	z_stream stream{};
+	// 15 window bits is zlib framing, plus 16 asks for a gzip header instead.
+	int window_bits = (encoding == ContentEncoding::Gzip) ? 15 + 16 : 15;
+	if (deflateInit2(&stream, Z_DEFAULT_COMPRESSION, Z_DEFLATED, window_bits, 8, Z_DEFAULT_STRATEGY) != Z_OK) {
+		throw std::runtime_error("deflateInit2 failed");
+	}
+	std::string compressed;
+	compressed.resize(deflateBound(&stream, static_cast<uLong>(body.size())));
+	stream.next_in = reinterpret_cast<Bytef*>(const_cast<char*>(body.data()));
+	stream.avail_in = static_cast<uInt>(body.size());
+	stream.next_out = reinterpret_cast<Bytef*>(&compressed[0]);
+	stream.avail_out = static_cast<uInt>(compressed.size());
+	int result = deflate(&stream, Z_FINISH);
+	deflateEnd(&stream);
+	if (result != Z_STREAM_END) {
+		throw std::runtime_error("deflate failed");
+	}
+	compressed.resize(stream.total_out);
+	return compressed;
+}
+// At least some room to remember things
+CompressionMemo::CompressionMemo(std::size_t byte_limit) : byte_limit(byte_limit == 0 ? 1 : byte_limit) {}
+// Shared LRU for every converted body, the work itself happens outside the lock.
+std::shared_ptr<const std::string> CompressionMemo::remember(const std::string& key, const std::function<std::string()>& produce, bool& fresh) {
+	fresh = false;
+	{
+		std::lock_guard<std::mutex> lock(memo_mutex);
+		auto it = entries.find(key);
+		if (it != entries.end()) {
+			recent.splice(recent.begin(), recent, it->second.recent);
+			counters.reused++;
+			return it->second.body;
+		}
+	}
+	auto produced = std::make_shared<const std::string>(produce());
+	fresh = true;
+	std::lock_guard<std::mutex> lock(memo_mutex);
+	// Another thread may have beaten us to it.
+	if (entries.count(key)) return produced;
+	recent.push_front(key);
+	entries.emplace(key, Entry{produced, recent.begin()});
+	counters.memo_bytes += produced->size();
+	// Least recently used goes first.
+	while (counters.memo_bytes > byte_limit && !recent.empty()) {
+		auto oldest = entries.find(recent.back());
+		counters.memo_bytes -= oldest->second.body->size();
+		entries.erase(oldest);
+		recent.pop_back();
+	}
+	return produced;
+}
+// Memoized compress
+std::shared_ptr<const std::string> CompressionMemo::encode(const std::string& hash, const std::string& body, ContentEncoding encoding) {
+	bool fresh = false;
+	auto compressed = remember(hash + encoding_name(encoding), [&] { return compress_body(body, encoding); }, fresh);
+	if (fresh) {
+		std::lock_guard<std::mutex> lock(memo_mutex);
+		counters.compressed++;
+		counters.bytes_in += body.size();
+		counters.bytes_out += compressed->size();
+	}
+	return compressed;
+}
+// Memoized re-encode, a cached body is parsed once per format however often it is served.
+std::shared_ptr<const std::string> CompressionMemo::transcode(const std::string& hash, const std::string& body, WireFormat format) {
+	bool fresh = false;
+	auto encoded = remember(hash + format_name(format), [&] { return transcode_json(body, format); }, fresh);
+	if (fresh) {
+		std::lock_guard<std::mutex> lock(memo_mutex);
+		counters.transcoded++;
+	}
+	return encoded;
+}
+// Copy the counters out
+CompressionStats CompressionMemo::stats() const {
+	std::lock_guard<std::mutex> lock(memo_mutex);
+	return counters;
+}
+// Process wide memo
+CompressionMemo& compression_memo() {
+	static CompressionMemo memo(env_size("COMPRESSION_CACHE_BYTES", std::size_t(64) * 1024 * 1024));
+	return memo;
+}
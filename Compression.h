@@ -0,0 +1,55 @@
+#pragma once
+#include <string>
+#include <memory>
+#include <mutex>
+#include <list>
+#include <unordered_map>
+#include <functional>
+#include "WireFormat.h"
+// Encodings we can send, best first.
+enum class ContentEncoding {
+	Identity,
+	Gzip,
+	Deflate
+};
+// Snapshot of compression counters for health and metrics.
+struct CompressionStats {
+	unsigned long long compressed = 0;
+	unsigned long long reused = 0;
+	unsigned long long transcoded = 0;
+	unsigned long long bytes_in = 0;
+	unsigned long long bytes_out = 0;
+	unsigned long long memo_bytes = 0;
+};
+// Pick gzip or deflate from an Accept-Encoding header, honouring q=0.
+ContentEncoding negotiate_encoding(const std::string& accept_encoding);
+// Content-Encoding header value
+const char* encoding_name(ContentEncoding encoding);
+// Compressed and re-encoded bodies by content hash, so identical responses are only converted once.
+class CompressionMemo {
+	// Public Members
+	public:
+		explicit CompressionMemo(std::size_t byte_limit);
+		// Body in the encoding, the hash is the body's ETag.
+		std::shared_ptr<const std::string> encode(const std::string& hash, const std::string& body, ContentEncoding encoding);
+		// JSON body as MessagePack or CBOR, the hash is the JSON body's ETag.
+		std::shared_ptr<const std::string> transcode(const std::string& hash, const std::string& body, WireFormat format);
+		CompressionStats stats() const;
+	// Private Members
+	private:
+		struct Entry {
+			std::shared_ptr<const std::string> body;
+			std::list<std::string>::iterator recent;
+		};
+		// Memoized result of produce under key, produce runs outside the lock.
+		std::shared_ptr<const std::string> remember(const std::string& key, const std::function<std::string()>& produce, bool& fresh);
+		mutable std::mutex memo_mutex;
+		std::unordered_map<std::string, Entry> entries;
+		std::list<std::string> recent; // Most recently used first
+		std::size_t byte_limit;
+		CompressionStats counters;
+};
+// zlib in one shot, gzip or zlib framing for deflate like HTTP expects.
+std::string compress_body(const std::string& body, ContentEncoding encoding);
+// Process wide memo, bounded by COMPRESSION_CACHE_BYTES.
+CompressionMemo& compression_memo();
@@ -0,0 +1,168 @@
+#include "ConnectionPool.h"
+#include "Routes.h" // for get_pool_connection_string
+#include "QueryCatalog.h"
+#include "Metrics.h"
+#include "Env.h"
+#include <iostream>
+#include <thread>
+#include <atomic>
+#include <stdexcept>
+#include <algorithm>
+// Take a lease, the connection is returned to the pool on destruction.
+PooledConnection::PooledConnection(ConnectionPool& pool, std::unique_ptr<pqxx::connection> conn)
+	: pool(&pool), conn(std::move(conn)) {}
+// Move the lease along, the old handle gives nothing back.
+PooledConnection::PooledConnection(PooledConnection&& other) noexcept
+	: pool(other.pool), conn(std::move(other.conn)), broken(other.broken) {
+	other.pool = nullptr;
+}
+// Return to the pool
+PooledConnection::~PooledConnection() {
+	if (pool && conn) {
+		pool->release(std::move(conn), broken);
+	}
+}
+// Pool setup, connections are opened lazily or by warm_up.
+ConnectionPool::ConnectionPool(std::string connection_string, std::size_t capacity, std::chrono::milliseconds acquire_timeout,
+	std::function<void(pqxx::connection&)> on_connect)
+	: connection_string(std::move(connection_string)), capacity(capacity == 0 ? 1 : capacity), acquire_timeout(acquire_timeout),
+	on_connect(std::move(on_connect)) {
+	idle.reserve(this->capacity);
+	counters.capacity = this->capacity;
+}
+// Open a brand new connection to PgBouncer and run the setup hook once.
+std::unique_ptr<pqxx::connection> ConnectionPool::connect() {
+	auto start = std::chrono::steady_clock::now();
+	auto conn = std::make_unique<pqxx::connection>(connection_string);
+	if (on_connect) on_connect(*conn);
+	observe_db_connect(std::chrono::steady_clock::now() - start);
+	std::lock_guard<std::mutex> lock(pool_mutex);
+	counters.connects++;
+	return conn;
+}
+// Borrow a connection, waiting up to the acquire timeout when all are leased.
+PooledConnection ConnectionPool::acquire() {
+	auto start = std::chrono::steady_clock::now();
+	auto deadline = start + acquire_timeout;
+	bool waited = false;
+	std::unique_lock<std::mutex> lock(pool_mutex);
+	// Helper to record how long the caller had to wait.
+	auto record_wait = [&]() {
+		auto waited_for = std::chrono::steady_clock::now() - start;
+		double wait_ms = std::chrono::duration<double, std::milli>(waited_for).count();
+		observe_db_acquire(waited_for);
+		counters.leases++;
+		counters.wait_total_ms += wait_ms;
+		if (wait_ms > counters.wait_max_ms) counters.wait_max_ms = wait_ms;
+	};
+	while (true) {
+		// Reuse the most recently returned connection first.
+		while (!idle.empty()) {
+			std::unique_ptr<pqxx::connection> conn = std::move(idle.back());
+			idle.pop_back();
+			// Connection went away while idle, drop it and try again.
+			if (!conn->is_open()) {
+				open--;
+				counters.broken++;
+				lock.unlock();
+				conn.reset();
+				lock.lock();
+				continue;
+			}
+			record_wait();
+			return PooledConnection(*this, std::move(conn));
+		}
+		// Room to grow, connect outside of the lock.
+		if (open < capacity) {
+			open++;
+			lock.unlock();
+			try {
+				auto conn = connect();
+				lock.lock();
+				record_wait();
+				return PooledConnection(*this, std::move(conn));
+			} catch (...) {
+				lock.lock();
+				open--;
+				available.notify_one();
+				throw;
+			}
+		}
+		// Everything is leased, wait for a return.
+		if (!waited) {
+			counters.waits++;
+			waited = true;
+		}
+		if (available.wait_until(lock, deadline) == std::cv_status::timeout && idle.empty() && open >= capacity) {
+			counters.timeouts++;
+			throw std::runtime_error("Timed out waiting for a pooled database connection.");
+		}
+	}
+}
+// Hand a connection back, broken ones are closed and their slot freed.
+void ConnectionPool::release(std::unique_ptr<pqxx::connection> conn, bool broken) {
+	std::unique_lock<std::mutex> lock(pool_mutex);
+	if (broken || !conn->is_open()) {
+		open--;
+		counters.broken++;
+		lock.unlock();
+		conn.reset();
+		available.notify_one();
+		return;
+	}
+	idle.push_back(std::move(conn));
+	lock.unlock();
+	available.notify_one();
+}
+// Open every slot up front so the first requests do not pay for the connect.
+void ConnectionPool::warm_up() {
+	std::size_t missing;
+	{
+		std::lock_guard<std::mutex> lock(pool_mutex);
+		missing = capacity - open;
+		open = capacity;
+	}
+	std::size_t opened = 0;
+	try {
+		for (; opened < missing; opened++) {
+			auto conn = connect();
+			{
+				std::lock_guard<std::mutex> lock(pool_mutex);
+				idle.push_back(std::move(conn));
+			}
+			available.notify_one();
+		}
+	} catch (const std::exception& e) {
+		std::cerr << "Error: Connection pool warm up stopped after " << opened << " connections: " << e.what() << std::endl;
+	}
+	// Give back the slots we could not fill.
+	{
+		std::lock_guard<std::mutex> lock(pool_mutex);
+		open -= missing - opened;
+	}
+	available.notify_all();
+	std::cout << "Connection pool warmed up with " << opened << " of " << missing << " connections." << std::endl;
+}
+// Copy the counters out
+PoolStats ConnectionPool::stats() const {
+	std::lock_guard<std::mutex> lock(pool_mutex);
+	PoolStats snapshot = counters;
+	snapshot.open = open;
+	snapshot.idle = idle.size();
+	return snapshot;
+}
+// Workers the server runs, one per hardware thread until told otherwise.
+static std::atomic<std::size_t> request_workers{0};
+void size_connection_pool(std::size_t workers) {
+	request_workers.store(workers, std::memory_order_relaxed);
+}
+// One connection per request worker, plus one for the listener.
+ConnectionPool& get_connection_pool() {
+	static ConnectionPool pool(get_pool_connection_string(),
+		env_size("PGBOUNCER_POOL_SIZE", (request_workers.load(std::memory_order_relaxed) > 0
+			? request_workers.load(std::memory_order_relaxed)
+			: std::max(1u, std::thread::hardware_concurrency())) + 1),
+		std::chrono::milliseconds(env_size("PGBOUNCER_POOL_TIMEOUT_MS", 5000)),
+		prepare_statements);
+	return pool;
+}
@@ -0,0 +1,71 @@
+#pragma once
+#include <pqxx/pqxx>
+#include <memory>
+#include <mutex>
+#include <condition_variable>
+#include <vector>
+#include <string>
+#include <chrono>
+#include <functional>
+// Snapshot of pool counters for health and metrics.
+struct PoolStats {
+	unsigned long long capacity = 0;
+	unsigned long long open = 0;
+	unsigned long long idle = 0;
+	unsigned long long leases = 0;
+	unsigned long long waits = 0;
+	unsigned long long timeouts = 0;
+	unsigned long long connects = 0;
+	unsigned long long broken = 0;
+	double wait_total_ms = 0.0;
+	double wait_max_ms = 0.0;
+};
+class ConnectionPool;
+// Leased connection, handed back to the pool when it goes out of scope.
+class PooledConnection {
+	// Public Members
+	public:
+		PooledConnection(ConnectionPool& pool, std::unique_ptr<pqxx::connection> conn);
+		PooledConnection(PooledConnection&& other) noexcept;
+		PooledConnection(const PooledConnection&) = delete;
+		PooledConnection& operator=(const PooledConnection&) = delete;
+		PooledConnection& operator=(PooledConnection&&) = delete;
+		~PooledConnection();
+		pqxx::connection& operator*() { return *conn; }
+		pqxx::connection* operator->() { return conn.get(); }
+		// Force the connection to be discarded instead of reused.
+		void mark_broken() { broken = true; }
+	// Private Members
+	private:
+		ConnectionPool* pool;
+		std::unique_ptr<pqxx::connection> conn;
+		bool broken = false;
+};
+// Fixed capacity pool of PgBouncer connections shared by the routes and the listener.
+class ConnectionPool {
+	// Public Members
+	public:
+		ConnectionPool(std::string connection_string, std::size_t capacity, std::chrono::milliseconds acquire_timeout,
+			std::function<void(pqxx::connection&)> on_connect = nullptr);
+		PooledConnection acquire();
+		void warm_up();
+		PoolStats stats() const;
+	// Private Members
+	private:
+		friend class PooledConnection;
+		std::unique_ptr<pqxx::connection> connect();
+		void release(std::unique_ptr<pqxx::connection> conn, bool broken);
+		std::string connection_string;
+		std::size_t capacity;
+		std::chrono::milliseconds acquire_timeout;
+		std::function<void(pqxx::connection&)> on_connect;
+		mutable std::mutex pool_mutex;
+		std::condition_variable available;
+		std::vector<std::unique_ptr<pqxx::connection>> idle;
+		std::size_t open = 0;
+		PoolStats counters;
+};
+// Process wide pool with the query catalog prepared on every connection, sized from PGBOUNCER_POOL_SIZE or one per Crow worker plus the listener.
+ConnectionPool& get_connection_pool();
+// Request workers across every shard, the default pool size follows it. Call before the pool is first used.
+void size_connection_pool(std::size_t workers);
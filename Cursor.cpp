@@ -0,0 +1,92 @@
+#include "Cursor.h"
+#include <vector>
+#include <charconv>
+// URL safe alphabet so tokens pass through query strings untouched.
+static const char alphabet[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789-_";
+// Base64url without padding
+static std::string to_base64url(std::string_view bytes) {
+	std::string text;
+	text.reserve((bytes.size() + 2) / 3 * 4);
+	std::size_t i = 0;
+	for (; i + 2 < bytes.size(); i += 3) {
+		unsigned int chunk = (static_cast<unsigned char>(bytes[i]) << 16) | (static_cast<unsigned char>(bytes[i + 1]) << 8) | static_cast<unsigned char>(bytes[i + 2]);
+		text.push_back(alphabet[(chunk >> 18) & 0x3F]);
+		text.push_back(alphabet[(chunk >> 12) & 0x3F]);
+		text.push_back(alphabet[(chunk >> 6) & 0x3F]);
+		text.push_back(alphabet[chunk & 0x3F]);
+	}
+	// One or two bytes left over
+	if (i < bytes.size()) {
+		unsigned int chunk = static_cast<unsigned char>(bytes[i]) << 16;
+		if (i + 1 < bytes.size()) chunk |= static_cast<unsigned char>(bytes[i + 1]) << 8;
+		text.push_back(alphabet[(chunk >> 18) & 0x3F]);
+		text.push_back(alphabet[(chunk >> 12) & 0x3F]);
+		if (i + 1 < bytes.size()) text.push_back(alphabet[(chunk >> 6) & 0x3F]);
+	}
+	return text;
+}
+// Reverse of to_base64url, false on characters outside the alphabet.
+static bool from_base64url(std::string_view text, std::string& bytes) {
+	if (text.size() % 4 == 1) return false;
+	bytes.clear();
+	unsigned int chunk = 0;
+	int bits = 0;
+	for (char c : text) {
+		int digit;
+		if (c >= 'A' && c <= 'Z') digit = c - 'A';
+		else if (c >= 'a' && c <= 'z') digit = c - 'a' + 26;
+		else if (c >= '0' && c <= '9') digit = c - '0' + 52;
+		else if (c == '-') digit = 62;
+		else if (c == '_') digit = 63;
+		else return false;
+		chunk = (chunk << 6) | static_cast<unsigned int>(digit);
+		bits += 6;
+		if (bits >= 8) {
+			bits -= 8;
+			bytes.push_back(static_cast<char>((chunk >> bits) & 0xFF));
+		}
+	}
+	return true;
+}
+// Split a payload into exactly count fields, the last one keeps any remaining separators.
+static bool split_fields(std::string_view payload, std::size_t count, std::vector<std::string_view>& fields) {
+	fields.clear();
+	while (fields.size() + 1 < count) {
+		std::size_t bar = payload.find('|');
+		if (bar == std::string_view::npos) return false;
+		fields.push_back(payload.substr(0, bar));
+		payload.remove_prefix(bar + 1);
+	}
+	fields.push_back(payload);
+	return true;
+}
+// Whole field as a number
+static bool parse_number(std::string_view text, long long& number) {
+	if (text.empty()) return false;
+	auto result = std::from_chars(text.data(), text.data() + text.size(), number);
+	return result.ec == std::errc() && result.ptr == text.data() + text.size();
+}
+// Incident tokens: i|time_stamp|id
+std::string encode_cursor(const IncidentCursor& cursor) {
+	return to_base64url("i|" + std::to_string(cursor.time_stamp) + "|" + std::to_string(cursor.id));
+}
+bool decode_cursor(std::string_view token, IncidentCursor& cursor) {
+	std::string payload;
+	std::vector<std::string_view> fields;
+	if (!from_base64url(token, payload) || !split_fields(payload, 3, fields)) return false;
+	if (fields[0] != "i") return false;
+	return parse_number(fields[1], cursor.time_stamp) && parse_number(fields[2], cursor.id);
+}
+// Tribe tokens: t|tribe_id|member_id|member_name, the name goes last since it may contain anything.
+std::string encode_cursor(const TribeCursor& cursor) {
+	return to_base64url("t|" + std::to_string(cursor.tribe_id) + "|" + cursor.member_id + "|" + cursor.member_name);
+}
+bool decode_cursor(std::string_view token, TribeCursor& cursor) {
+	std::string payload;
+	std::vector<std::string_view> fields;
+	if (!from_base64url(token, payload) || !split_fields(payload, 4, fields)) return false;
+	if (fields[0] != "t" || !parse_number(fields[1], cursor.tribe_id)) return false;
+	cursor.member_id = std::string(fields[2]);
+	cursor.member_name = std::string(fields[3]);
+	return true;
+}
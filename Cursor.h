@@ -0,0 +1,19 @@
+#pragma once
+#include <string>
+#include <string_view>
+// Position after the last incident of a page, in (time_stamp, id) descending order.
+struct IncidentCursor {
+	long long time_stamp = 0;
+	long long id = 0;
+};
+// Position after the last member row of a tribe page, in (tribe_id, member_name, member_id) order.
+struct TribeCursor {
+	long long tribe_id = 0;
+	std::string member_name;
+	std::string member_id;
+};
+// Opaque base64url tokens handed out as next_cursor, false on anything we did not issue.
+std::string encode_cursor(const IncidentCursor& cursor);
+std::string encode_cursor(const TribeCursor& cursor);
+bool decode_cursor(std::string_view token, IncidentCursor& cursor);
+bool decode_cursor(std::string_view token, TribeCursor& cursor);
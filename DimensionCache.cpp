@@ -0,0 +1,259 @@
+#include "DimensionCache.h"
+#include "QueryCatalog.h"
+#include "StarMap.h"
+#include "Leaderboard.h"
+#include <algorithm>
+#include <iostream>
+// Character by id, null when unknown.
+const CharacterDim* DimensionSnapshot::character(const std::string& id) const {
+	auto it = characters->find(id);
+	return it == characters->end() ? nullptr : it->second.get();
+}
+// Same window test as the incident queries' membership joins.
+std::string DimensionSnapshot::tribe_at(const CharacterDim& character, long long time_stamp) const {
+	for (const auto& membership : character.memberships) {
+		if (membership.joined_at <= time_stamp && (membership.current || membership.left_at > time_stamp)) {
+			auto it = tribes->find(membership.tribe_id);
+			return it == tribes->end() ? "" : it->second->name;
+		}
+	}
+	return "";
+}
+// Positions follow the maps' iteration order, the key carries the id.
+void DimensionSnapshot::index_characters() {
+	index_character_names();
+	index_character_addresses();
+}
+void DimensionSnapshot::index_character_names() {
+	std::vector<std::pair<std::string, std::string>> entries;
+	entries.reserve(characters->size());
+	for (const auto& [id, character] : *characters) entries.emplace_back(id, character->name);
+	auto names = std::make_shared<NameIndex>();
+	names->build(entries);
+	character_names = std::move(names);
+}
+void DimensionSnapshot::index_character_addresses() {
+	std::vector<std::pair<std::string, std::string>> addresses;
+	addresses.reserve(characters->size());
+	for (const auto& [id, character] : *characters) addresses.emplace_back(id, character->address);
+	auto address_index = std::make_shared<AddressIndex>();
+	address_index->build(addresses);
+	character_addresses = std::move(address_index);
+}
+void DimensionSnapshot::index_tribes() {
+	std::vector<std::pair<std::string, std::string>> entries;
+	entries.reserve(tribes->size());
+	for (const auto& [id, tribe] : *tribes) entries.emplace_back(std::to_string(id), tribe->name);
+	auto names = std::make_shared<NameIndex>();
+	names->build(entries);
+	tribe_names = std::move(names);
+}
+// Substring match on name, like ILIKE '%text%'.
+std::vector<std::string> DimensionSnapshot::search_characters(const std::string& text) const {
+	std::vector<std::string> ids;
+	for (std::size_t position : character_names->search(text)) ids.push_back(character_names->key(position));
+	return ids;
+}
+std::vector<long long> DimensionSnapshot::search_tribes(const std::string& text) const {
+	std::vector<long long> ids;
+	for (std::size_t position : tribe_names->search(text)) ids.push_back(std::stoll(tribe_names->key(position)));
+	return ids;
+}
+// Rank every match, then keep the top few.
+std::vector<CharacterSuggestion> DimensionSnapshot::suggest_characters(const std::string& text, std::size_t limit) const {
+	std::vector<std::size_t> positions = character_names->search(text);
+	std::vector<std::string> names;
+	names.reserve(positions.size());
+	for (std::size_t position : positions) names.push_back(character_names->name(position));
+	std::vector<std::pair<long long, long long>> scores = leaderboards().activity(names);
+	std::vector<std::size_t> order(positions.size());
+	for (std::size_t i = 0; i < order.size(); i++) order[i] = i;
+	auto better = [&](std::size_t a, std::size_t b) {
+		long long activity_a = scores[a].first + scores[a].second;
+		long long activity_b = scores[b].first + scores[b].second;
+		if (activity_a != activity_b) return activity_a > activity_b;
+		bool prefix_a = character_names->starts_with(positions[a], text);
+		bool prefix_b = character_names->starts_with(positions[b], text);
+		if (prefix_a != prefix_b) return prefix_a;
+		return names[a] < names[b];
+	};
+	std::size_t keep = std::min(limit, order.size());
+	std::partial_sort(order.begin(), order.begin() + keep, order.end(), better);
+	std::vector<CharacterSuggestion> suggestions;
+	suggestions.reserve(keep);
+	for (std::size_t i = 0; i < keep; i++) {
+		CharacterSuggestion suggestion;
+		suggestion.id = character_names->key(positions[order[i]]);
+		suggestion.character = character(suggestion.id);
+		suggestion.kills = scores[order[i]].first;
+		suggestion.losses = scores[order[i]].second;
+		suggestions.push_back(std::move(suggestion));
+	}
+	return suggestions;
+}
+// Character rows with their memberships attached.
+static void read_characters(const pqxx::result& resCharacters, const pqxx::result& resMemberships, CharacterMap& characters) {
+	std::unordered_map<std::string, CharacterDim> built;
+	for (const auto& row : resCharacters) {
+		CharacterDim& character = built[row["id"].as<std::string>()];
+		character.name = row["name"].is_null() ? "" : row["name"].as<std::string>();
+		character.address = row["address"].is_null() ? "" : row["address"].as<std::string>();
+	}
+	for (const auto& row : resMemberships) {
+		auto it = built.find(row["character_id"].as<std::string>());
+		if (it == built.end()) continue;
+		MembershipDim membership;
+		membership.tribe_id = row["tribe_id"].as<long long>();
+		membership.joined_at = row["joined_at"].as<long long>();
+		membership.current = row["left_at"].is_null();
+		membership.left_at = membership.current ? 0 : row["left_at"].as<long long>();
+		it->second.memberships.push_back(membership);
+	}
+	for (auto& [id, character] : built) {
+		characters[id] = std::make_shared<const CharacterDim>(std::move(character));
+	}
+}
+static void read_tribes(const pqxx::result& resTribes, TribeMap& tribes) {
+	for (const auto& row : resTribes) {
+		auto tribe = std::make_shared<TribeDim>();
+		tribe->name = row["name"].is_null() ? "" : row["name"].as<std::string>();
+		tribe->url = row["url"].is_null() ? "" : row["url"].as<std::string>();
+		tribes[row["tribe_id"].as<long long>()] = std::move(tribe);
+	}
+}
+// Read all three tables once.
+void DimensionCache::load(pqxx::connection& conn) {
+	pqxx::work txn(conn);
+	pqxx::result resCharacters = exec_statement(txn, "dimension_characters");
+	pqxx::result resMemberships = exec_statement(txn, "dimension_memberships");
+	pqxx::result resTribes = exec_statement(txn, "dimension_tribes");
+	txn.commit();
+	auto characters = std::make_shared<CharacterMap>();
+	auto tribes = std::make_shared<TribeMap>();
+	read_characters(resCharacters, resMemberships, *characters);
+	read_tribes(resTribes, *tribes);
+	std::cout << "Dimension cache loaded with " << characters->size() << " characters and " << tribes->size() << " tribes." << std::endl;
+	auto next = std::make_shared<DimensionSnapshot>();
+	next->characters = std::move(characters);
+	next->tribes = std::move(tribes);
+	next->index_characters();
+	next->index_tribes();
+	std::lock_guard<std::mutex> lock(writer_mutex);
+	publish(std::move(next));
+}
+// Copy the current character map and replace the changed characters, removed ones disappear. Tribes are shared,
+// and an index is only rebuilt when a name or address actually changed, membership changes rebuild nothing.
+void DimensionCache::refresh_characters(pqxx::connection& conn, const std::vector<std::string>& ids) {
+	if (ids.empty()) return;
+	pqxx::work txn(conn);
+	pqxx::result resCharacters = exec_statement(txn, "dimension_characters_by_id", ids);
+	pqxx::result resMemberships = exec_statement(txn, "dimension_memberships_by_id", ids);
+	txn.commit();
+	std::lock_guard<std::mutex> lock(writer_mutex);
+	std::shared_ptr<const DimensionSnapshot> base = snapshot();
+	if (!base) return;
+	auto characters = std::make_shared<CharacterMap>(*base->characters);
+	for (const auto& id : ids) characters->erase(id);
+	read_characters(resCharacters, resMemberships, *characters);
+	bool names_changed = false;
+	bool addresses_changed = false;
+	for (const auto& id : ids) {
+		const CharacterDim* before = base->character(id);
+		auto after = characters->find(id);
+		if (!before || after == characters->end()) {
+			if (before || after != characters->end()) names_changed = addresses_changed = true;
+			continue;
+		}
+		if (before->name != after->second->name) names_changed = true;
+		if (before->address != after->second->address) addresses_changed = true;
+	}
+	auto next = std::make_shared<DimensionSnapshot>(*base);
+	next->characters = std::move(characters);
+	if (names_changed) next->index_character_names();
+	if (addresses_changed) next->index_character_addresses();
+	publish(std::move(next));
+}
+void DimensionCache::refresh_tribes(pqxx::connection& conn, const std::vector<long long>& ids) {
+	if (ids.empty()) return;
+	pqxx::work txn(conn);
+	pqxx::result resTribes = exec_statement(txn, "dimension_tribes_by_id", ids);
+	txn.commit();
+	std::lock_guard<std::mutex> lock(writer_mutex);
+	std::shared_ptr<const DimensionSnapshot> base = snapshot();
+	if (!base) return;
+	auto tribes = std::make_shared<TribeMap>(*base->tribes);
+	for (long long id : ids) tribes->erase(id);
+	read_tribes(resTribes, *tribes);
+	auto next = std::make_shared<DimensionSnapshot>(*base);
+	next->tribes = std::move(tribes);
+	next->index_tribes();
+	publish(std::move(next));
+}
+// Swap in the new snapshot, the old one goes when its last reader lets go. Caller holds writer_mutex.
+void DimensionCache::publish(std::shared_ptr<const DimensionSnapshot> next) {
+	std::atomic_store(&current, std::move(next));
+	generation.fetch_add(1, std::memory_order_release);
+}
+// The generation is read before the pointer, so a copy is never labelled newer than it is.
+std::shared_ptr<const DimensionSnapshot> DimensionCache::snapshot() const {
+	struct ThreadCopy {
+		const DimensionCache* owner = nullptr;
+		std::uint64_t generation = 0;
+		std::shared_ptr<const DimensionSnapshot> snapshot;
+	};
+	thread_local ThreadCopy copy;
+	std::uint64_t seen = generation.load(std::memory_order_acquire);
+	if (copy.owner != this || copy.generation != seen || !copy.snapshot) {
+		copy.snapshot = std::atomic_load(&current);
+		copy.generation = seen;
+		copy.owner = this;
+	}
+	return copy.snapshot;
+}
+bool DimensionCache::resolve(IncidentRecord& record) const {
+	std::shared_ptr<const DimensionSnapshot> view = snapshot();
+	return view && view->resolve(record);
+}
+// Names for an incident from this snapshot and the star map.
+bool DimensionSnapshot::resolve(IncidentRecord& record) const {
+	const CharacterDim* victim = character(record.victim_id);
+	const CharacterDim* killer = character(record.killer_id);
+	if (victim) {
+		record.victim_name = victim->name;
+		record.victim_address = victim->address;
+		record.victim_tribe_name = tribe_at(*victim, record.time_stamp);
+	}
+	if (killer) {
+		record.killer_name = killer->name;
+		record.killer_address = killer->address;
+		record.killer_tribe_name = tribe_at(*killer, record.time_stamp);
+	}
+	std::size_t index;
+	if (star_map().loaded() && star_map().find(record.solar_system_id, index)) {
+		record.solar_system_name = star_map().names[index];
+	}
+	return victim && killer;
+}
+// Slim rows carry ids only, everything else comes from the cache.
+std::vector<IncidentRecord> DimensionCache::resolve_rows(const pqxx::result& res) const {
+	std::shared_ptr<const DimensionSnapshot> view = snapshot();
+	std::vector<IncidentRecord> incidents;
+	incidents.reserve(res.size());
+	for (const auto& row : res) {
+		IncidentRecord record;
+		record.id = row["id"].as<long long>();
+		record.victim_id = row["victim_id"].is_null() ? "" : row["victim_id"].as<std::string>();
+		record.killer_id = row["killer_id"].is_null() ? "" : row["killer_id"].as<std::string>();
+		record.solar_system_id = row["solar_system_id"].as<long long>();
+		record.loss_type = row["loss_type"].as<int>();
+		record.time_stamp = row["time_stamp"].as<long long>();
+		if (view) view->resolve(record);
+		incidents.push_back(std::move(record));
+	}
+	return incidents;
+}
+// Process wide dimension cache
+DimensionCache& dimensions() {
+	static DimensionCache cache;
+	return cache;
+}
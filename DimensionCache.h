@@ -0,0 +1,87 @@
+#pragma once
+#include <pqxx/pqxx>
+#include <string>
+#include <vector>
+#include <memory>
+#include <mutex>
+#include <atomic>
+#include <cstdint>
+#include <unordered_map>
+#include "IncidentRing.h"
+#include "NameIndex.h"
+#include "AddressIndex.h"
+// A tribe membership window of one character.
+struct MembershipDim {
+	long long tribe_id = 0;
+	long long joined_at = 0;
+	long long left_at = 0;
+	bool current = false;
+};
+struct CharacterDim {
+	std::string name;
+	std::string address;
+	std::vector<MembershipDim> memberships;
+};
+struct TribeDim {
+	std::string name;
+	std::string url;
+};
+// A character matched by /characters/suggest with its all-time activity.
+struct CharacterSuggestion {
+	std::string id;
+	const CharacterDim* character = nullptr;
+	long long kills = 0;
+	long long losses = 0;
+};
+using CharacterMap = std::unordered_map<std::string, std::shared_ptr<const CharacterDim>>;
+using TribeMap = std::unordered_map<long long, std::shared_ptr<const TribeDim>>;
+// Immutable view of the dimension tables. Each map and index is shared with the previous
+// snapshot until a change touches it, so a tribe change never copies the characters.
+struct DimensionSnapshot {
+	std::shared_ptr<const CharacterMap> characters = std::make_shared<const CharacterMap>();
+	std::shared_ptr<const TribeMap> tribes = std::make_shared<const TribeMap>();
+	// Name indexes, rebuilt by the writer before the snapshot is published.
+	std::shared_ptr<const NameIndex> character_names = std::make_shared<const NameIndex>();
+	std::shared_ptr<const NameIndex> tribe_names = std::make_shared<const NameIndex>();
+	std::shared_ptr<const AddressIndex> character_addresses = std::make_shared<const AddressIndex>();
+	void index_characters();
+	void index_character_names();
+	void index_character_addresses();
+	void index_tribes();
+	const CharacterDim* character(const std::string& id) const;
+	// Fill names, addresses and tribes from the ids, false when either character is unknown.
+	bool resolve(IncidentRecord& record) const;
+	// Tribe name the character belonged to at the time, empty when none.
+	std::string tribe_at(const CharacterDim& character, long long time_stamp) const;
+	// Ids of characters or tribes whose name contains the text, ignoring case.
+	std::vector<std::string> search_characters(const std::string& text) const;
+	std::vector<long long> search_tribes(const std::string& text) const;
+	// Best matches for autocomplete, most active first, then names starting with the text.
+	std::vector<CharacterSuggestion> suggest_characters(const std::string& text, std::size_t limit) const;
+};
+// Characters, tribes and memberships held in memory, systems come from the star map.
+class DimensionCache {
+	// Public Members
+	public:
+		void load(pqxx::connection& conn);
+		bool loaded() const { return snapshot() != nullptr; }
+		// Current snapshot, valid for as long as the caller holds it. Each thread keeps its own copy and only
+		// goes to the shared pointer, which std::atomic_load guards with a lock, after a refresh published a new one.
+		std::shared_ptr<const DimensionSnapshot> snapshot() const;
+		// Re-read some rows after a change notification.
+		void refresh_characters(pqxx::connection& conn, const std::vector<std::string>& ids);
+		void refresh_tribes(pqxx::connection& conn, const std::vector<long long>& ids);
+		// One record against the current snapshot, false when either character is unknown.
+		bool resolve(IncidentRecord& record) const;
+		// Incidents from a slim catalog query, every row resolved against the same snapshot.
+		std::vector<IncidentRecord> resolve_rows(const pqxx::result& res) const;
+	// Private Members
+	private:
+		void publish(std::shared_ptr<const DimensionSnapshot> next);
+		// Only ever read and replaced with std::atomic_load and std::atomic_store, the last holder frees it.
+		std::shared_ptr<const DimensionSnapshot> current;
+		std::atomic<std::uint64_t> generation{0}; // Bumped after every publish, tells readers their copy is old.
+		std::mutex writer_mutex; // One writer at a time, readers never take it.
+};
+// Process wide dimension cache
+DimensionCache& dimensions();
@@ -0,0 +1,15 @@
+#include "Env.h"
+#include <cstdlib> // For getenv
+#include <string>
+#include <exception>
+// Anything unset, unreadable or not above zero takes the fallback.
+std::size_t env_size(const char* name, std::size_t fallback) {
+	const char* value = std::getenv(name);
+	if (!value) return fallback;
+	try {
+		long long parsed = std::stoll(value);
+		return parsed > 0 ? static_cast<std::size_t>(parsed) : fallback;
+	} catch (const std::exception&) {
+		return fallback;
+	}
+}
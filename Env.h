@@ -0,0 +1,4 @@
+#pragma once
+#include <cstddef>
+// Read a positive number from the environment, or fall back.
+std::size_t env_size(const char* name, std::size_t fallback);
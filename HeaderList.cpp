@@ -0,0 +1,37 @@
+#include "HeaderList.h"
+#include <algorithm>
+#include <cctype>
+#include <cstdlib>
+// Trim spaces and tabs from both ends.
+static std::string trim(const std::string& text) {
+	std::size_t first = text.find_first_not_of(" \t");
+	if (first == std::string::npos) return "";
+	std::size_t last = text.find_last_not_of(" \t");
+	return text.substr(first, last - first + 1);
+}
+// Token and optional ;q=, other parameters are skipped.
+std::vector<WeightedToken> weighted_tokens(const std::string& header) {
+	std::vector<WeightedToken> tokens;
+	std::size_t start = 0;
+	while (start <= header.size()) {
+		std::size_t end = header.find(',', start);
+		if (end == std::string::npos) end = header.size();
+		std::string item = header.substr(start, end - start);
+		start = end + 1;
+		std::size_t semicolon = item.find(';');
+		WeightedToken entry;
+		entry.token = trim(item.substr(0, semicolon));
+		if (entry.token.empty()) continue;
+		std::transform(entry.token.begin(), entry.token.end(), entry.token.begin(), [](unsigned char c) { return std::tolower(c); });
+		while (semicolon != std::string::npos) {
+			std::size_t next = item.find(';', semicolon + 1);
+			std::string parameter = trim(item.substr(semicolon + 1, next == std::string::npos ? std::string::npos : next - semicolon - 1));
+			if (parameter.size() > 2 && (parameter[0] == 'q' || parameter[0] == 'Q') && parameter[1] == '=') {
+				entry.q = std::strtod(parameter.c_str() + 2, nullptr);
+			}
+			semicolon = next;
+		}
+		tokens.push_back(std::move(entry));
+	}
+	return tokens;
+}
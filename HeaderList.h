@@ -0,0 +1,10 @@
+#pragma once
+#include <string>
+#include <vector>
+// One entry of a comma separated header like Accept or Accept-Encoding.
+struct WeightedToken {
+	std::string token; // Lower cased, parameters stripped
+	double q = 1.0;
+};
+// Every non empty entry with its q, walking all parameters so q may come anywhere after the token.
+std::vector<WeightedToken> weighted_tokens(const std::string& header);
@@ -0,0 +1,167 @@
+#include "IncidentRing.h"
+#include "QueryCatalog.h"
+#include "Env.h"
+#include <algorithm>
+#include <iostream>
+#include <mutex>
+#include <ctime>
+// Newest first, ties broken by id like the incident queries.
+static bool newer(const IncidentRecord& a, const IncidentRecord& b) {
+	if (a.time_stamp != b.time_stamp) return a.time_stamp > b.time_stamp;
+	return a.id > b.id;
+}
+// Copy a catalog incident row.
+IncidentRecord record_from_row(const pqxx::row& row) {
+	IncidentRecord record;
+	record.id = row["id"].as<long long>();
+	record.victim_id = row["victim_id"].as<std::string>();
+	record.victim_name = row["victim_name"].as<std::string>();
+	record.victim_address = row["victim_address"].as<std::string>();
+	record.victim_tribe_name = row["victim_tribe_name"].as<std::string>();
+	record.killer_id = row["killer_id"].as<std::string>();
+	record.killer_name = row["killer_name"].as<std::string>();
+	record.killer_address = row["killer_address"].as<std::string>();
+	record.killer_tribe_name = row["killer_tribe_name"].as<std::string>();
+	record.solar_system_id = row["solar_system_id"].as<long long>();
+	record.solar_system_name = row["solar_system_name"].as<std::string>();
+	record.loss_type = row["loss_type"].as<int>();
+	record.time_stamp = row["time_stamp"].as<long long>();
+	return record;
+}
+// Empty until seeded
+IncidentRing::IncidentRing(std::size_t capacity) : capacity(capacity == 0 ? 1 : capacity) {}
+// Load the newest incidents, the ring holds all history when the table is smaller than the ring.
+std::vector<long long> IncidentRing::seed(pqxx::transaction_base& txn) {
+	pqxx::result res = exec_statement(txn, "incident_recent", static_cast<long long>(capacity));
+	std::unique_lock<std::shared_mutex> lock(ring_mutex);
+	// Anything the listener delivered in the meantime stays.
+	std::vector<long long> ids;
+	ids.reserve(res.size());
+	for (const auto& row : res) {
+		IncidentRecord record = record_from_row(row);
+		ids.push_back(record.id);
+		insert(std::move(record));
+	}
+	complete = res.size() < static_cast<int>(capacity);
+	seeded = true;
+	std::cout << "Incident ring seeded with " << records.size() << " incidents." << std::endl;
+	return ids;
+}
+// Add an incident from the listener.
+bool IncidentRing::push(IncidentRecord record) {
+	std::unique_lock<std::shared_mutex> lock(ring_mutex);
+	return insert(std::move(record));
+}
+// Sorted insert, almost always at the front. Caller holds the lock.
+bool IncidentRing::insert(IncidentRecord record) {
+	auto position = std::lower_bound(records.begin(), records.end(), record, newer);
+	// Already have it
+	if (position != records.end() && position->id == record.id) return false;
+	// Older than everything in a full ring, it was never ours to keep.
+	if (position == records.end() && records.size() >= capacity) {
+		complete = false;
+		return false;
+	}
+	records.insert(position, std::move(record));
+	// Drop the oldest, we no longer hold all of history.
+	if (records.size() > capacity) {
+		records.pop_back();
+		complete = false;
+	}
+	return true;
+}
+// Incidents at or after since form a prefix of the ring, this is its length. Caller holds the lock.
+std::size_t IncidentRing::window(long long since) const {
+	if (since <= 0) return records.size();
+	IncidentRecord boundary;
+	boundary.time_stamp = since;
+	boundary.id = -1;
+	return std::lower_bound(records.begin(), records.end(), boundary, newer) - records.begin();
+}
+// Copy limit incidents from first, false when the ring cannot answer exactly. Caller holds the lock.
+bool IncidentRing::copy(std::size_t first, long long limit, std::size_t matches, std::vector<IncidentRecord>& out) const {
+	// Either the page fits inside the ring or the ring reaches past the window.
+	bool window_covered = complete || (matches < records.size());
+	std::size_t last = first + static_cast<std::size_t>(limit);
+	if (!window_covered && last > matches) return false;
+	out.clear();
+	if (first >= matches) return true;
+	last = std::min(last, matches);
+	out.reserve(last - first);
+	for (std::size_t i = first; i < last; i++) {
+		out.push_back(records[i]);
+	}
+	return true;
+}
+// Copy out a page of incidents at or after since. False when the ring cannot answer it exactly.
+bool IncidentRing::page(long long since, long long limit, long long offset, std::vector<IncidentRecord>& out) const {
+	if (limit < 0 || offset < 0) return false;
+	std::shared_lock<std::shared_mutex> lock(ring_mutex);
+	if (!seeded) return false;
+	return copy(static_cast<std::size_t>(offset), limit, window(since), out);
+}
+// Keyset page strictly older than (time_stamp, id), same contract as page.
+bool IncidentRing::after(long long since, long long time_stamp, long long id, long long limit, std::vector<IncidentRecord>& out) const {
+	if (limit < 0) return false;
+	std::shared_lock<std::shared_mutex> lock(ring_mutex);
+	if (!seeded) return false;
+	IncidentRecord boundary;
+	boundary.time_stamp = time_stamp;
+	boundary.id = id;
+	std::size_t first = std::upper_bound(records.begin(), records.end(), boundary, newer) - records.begin();
+	return copy(first, limit, window(since), out);
+}
+// How many incidents are held
+std::size_t IncidentRing::size() const {
+	std::shared_lock<std::shared_mutex> lock(ring_mutex);
+	return records.size();
+}
+// Days since 1970-01-01 of a UTC calendar date, and back.
+static long long days_from_civil(long long year, long long month, long long day) {
+	year -= month <= 2;
+	long long era = (year >= 0 ? year : year - 399) / 400;
+	long long year_of_era = year - era * 400;
+	long long day_of_year = (153 * (month + (month > 2 ? -3 : 9)) + 2) / 5 + day - 1;
+	long long day_of_era = year_of_era * 365 + year_of_era / 4 - year_of_era / 100 + day_of_year;
+	return era * 146097 + day_of_era - 719468;
+}
+static void civil_from_days(long long days, long long& year, long long& month, long long& day) {
+	days += 719468;
+	long long era = (days >= 0 ? days : days - 146096) / 146097;
+	long long day_of_era = days - era * 146097;
+	long long year_of_era = (day_of_era - day_of_era / 1460 + day_of_era / 36524 - day_of_era / 146096) / 365;
+	long long day_of_year = day_of_era - (365 * year_of_era + year_of_era / 4 - year_of_era / 100);
+	long long shifted_month = (5 * day_of_year + 2) / 153;
+	day = day_of_year - (153 * shifted_month + 2) / 5 + 1;
+	month = shifted_month < 10 ? shifted_month + 3 : shifted_month - 9;
+	year = year_of_era + era * 400 + (month <= 2);
+}
+// Same windows as the catalog's day/week/month statements, which count in UTC.
+long long filter_cutoff(const char* filter_param) {
+	if (!filter_param) return 0;
+	std::string filter = filter_param;
+	long long now = static_cast<long long>(std::time(nullptr));
+	if (filter == "day") return now - 24 * 60 * 60;
+	if (filter == "week") return now - 7 * 24 * 60 * 60;
+	if (filter == "month") {
+		// Calendar month like interval '1 month', the day is clamped to the end of a shorter month.
+		long long days = (now >= 0 ? now : now - 86399) / 86400;
+		long long seconds = now - days * 86400;
+		long long year, month, day;
+		civil_from_days(days, year, month, day);
+		if (--month == 0) {
+			month = 12;
+			year--;
+		}
+		long long next_year = month == 12 ? year + 1 : year;
+		long long next_month = month == 12 ? 1 : month + 1;
+		long long month_length = days_from_civil(next_year, next_month, 1) - days_from_civil(year, month, 1);
+		return days_from_civil(year, month, std::min(day, month_length)) * 86400 + seconds;
+	}
+	return 0;
+}
+// Process wide ring
+IncidentRing& recent_incidents() {
+	static IncidentRing ring(env_size("INCIDENT_RING_SIZE", 10000));
+	return ring;
+}
@@ -0,0 +1,51 @@
+#pragma once
+#include <pqxx/pqxx>
+#include <string>
+#include <vector>
+#include <deque>
+#include <shared_mutex>
+// Incident with its names resolved, as served by /incident and /mails.
+struct IncidentRecord {
+	long long id = 0;
+	std::string victim_id;
+	std::string victim_name;
+	std::string victim_address;
+	std::string victim_tribe_name;
+	std::string killer_id;
+	std::string killer_name;
+	std::string killer_address;
+	std::string killer_tribe_name;
+	long long solar_system_id = 0;
+	std::string solar_system_name;
+	int loss_type = 0;
+	long long time_stamp = 0;
+};
+// Incident from a catalog row carrying the names and both character ids.
+IncidentRecord record_from_row(const pqxx::row& row);
+// Bounded, newest first window over the incident table.
+class IncidentRing {
+	// Public Members
+	public:
+		explicit IncidentRing(std::size_t capacity);
+		// Ids of the incidents read, newest first.
+		std::vector<long long> seed(pqxx::transaction_base& txn);
+		// False when the ring did not keep it, already held or older than everything in a full ring.
+		bool push(IncidentRecord record);
+		bool page(long long since, long long limit, long long offset, std::vector<IncidentRecord>& out) const;
+		bool after(long long since, long long time_stamp, long long id, long long limit, std::vector<IncidentRecord>& out) const;
+		std::size_t size() const;
+	// Private Members
+	private:
+		bool insert(IncidentRecord record);
+		std::size_t window(long long since) const;
+		bool copy(std::size_t first, long long limit, std::size_t matches, std::vector<IncidentRecord>& out) const;
+		mutable std::shared_mutex ring_mutex;
+		std::deque<IncidentRecord> records;
+		std::size_t capacity;
+		bool seeded = false;
+		bool complete = false;
+};
+// Epoch seconds at the start of a day/week/month filter window, 0 when unfiltered.
+long long filter_cutoff(const char* filter_param);
+// Process wide ring, sized from INCIDENT_RING_SIZE.
+IncidentRing& recent_incidents();
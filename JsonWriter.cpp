@@ -0,0 +1,118 @@
+#include "JsonWriter.h"
+#include <charconv>
+#include <cmath>
+// Writer appends to whatever the buffer already holds.
+JsonWriter::JsonWriter(std::string& buffer, bool pretty) : out(buffer), pretty(pretty) {
+	empty_scope.reserve(8);
+}
+// Four spaces per level like dump(4)
+void JsonWriter::indent(std::size_t depth) {
+	out.push_back('\n');
+	out.append(depth * 4, ' ');
+}
+// Separator and indentation ahead of an array element or object key.
+void JsonWriter::before_value() {
+	if (after_key) {
+		after_key = false;
+		return;
+	}
+	if (empty_scope.empty()) return;
+	if (!empty_scope.back()) out.push_back(',');
+	empty_scope.back() = false;
+	if (pretty) indent(empty_scope.size());
+}
+void JsonWriter::begin_object() {
+	before_value();
+	out.push_back('{');
+	empty_scope.push_back(true);
+}
+void JsonWriter::end_object() {
+	bool was_empty = empty_scope.back();
+	empty_scope.pop_back();
+	if (pretty && !was_empty) indent(empty_scope.size());
+	out.push_back('}');
+}
+void JsonWriter::begin_array() {
+	before_value();
+	out.push_back('[');
+	empty_scope.push_back(true);
+}
+void JsonWriter::end_array() {
+	bool was_empty = empty_scope.back();
+	empty_scope.pop_back();
+	if (pretty && !was_empty) indent(empty_scope.size());
+	out.push_back(']');
+}
+// Object key, the next value belongs to it.
+void JsonWriter::key(std::string_view name) {
+	value(name);
+	out.append(pretty ? ": " : ":");
+	after_key = true;
+}
+// Quoted string with the same escapes nlohmann emits.
+void JsonWriter::value(std::string_view text) {
+	before_value();
+	static const char hex[] = "0123456789abcdef";
+	out.push_back('"');
+	std::size_t run = 0;
+	for (std::size_t i = 0; i < text.size(); i++) {
+		unsigned char c = static_cast<unsigned char>(text[i]);
+		if (c >= 0x20 && c != '"' && c != '\\') continue;
+		// Flush the plain run before the escape.
+		out.append(text.data() + run, i - run);
+		run = i + 1;
+		switch (c) {
+			case '"': out.append("\\\""); break;
+			case '\\': out.append("\\\\"); break;
+			case '\b': out.append("\\b"); break;
+			case '\f': out.append("\\f"); break;
+			case '\n': out.append("\\n"); break;
+			case '\r': out.append("\\r"); break;
+			case '\t': out.append("\\t"); break;
+			default:
+				out.append("\\u00");
+				out.push_back(hex[c >> 4]);
+				out.push_back(hex[c & 0x0F]);
+		}
+	}
+	out.append(text.data() + run, text.size() - run);
+	out.push_back('"');
+}
+void JsonWriter::value(long long number) {
+	before_value();
+	char digits[24];
+	auto result = std::to_chars(digits, digits + sizeof(digits), number);
+	out.append(digits, result.ptr);
+}
+void JsonWriter::value(unsigned long long number) {
+	before_value();
+	char digits[24];
+	auto result = std::to_chars(digits, digits + sizeof(digits), number);
+	out.append(digits, result.ptr);
+}
+// Shortest round trip form, whole numbers keep a ".0" and non finite values become null like nlohmann.
+void JsonWriter::value(double number) {
+	if (!std::isfinite(number)) {
+		null();
+		return;
+	}
+	before_value();
+	char digits[32];
+	auto result = std::to_chars(digits, digits + sizeof(digits), number);
+	std::string_view text(digits, result.ptr - digits);
+	out.append(text);
+	if (text.find_first_of(".e") == std::string_view::npos) out.append(".0");
+}
+void JsonWriter::value(bool flag) {
+	before_value();
+	out.append(flag ? "true" : "false");
+}
+void JsonWriter::null() {
+	before_value();
+	out.append("null");
+}
+// One buffer per thread, emptied by each user.
+std::string& response_buffer() {
+	thread_local std::string buffer;
+	return buffer;
+}
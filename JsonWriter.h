@@ -0,0 +1,42 @@
+#pragma once
+#include <string>
+#include <string_view>
+#include <vector>
+// Streams JSON text into a caller owned buffer without building a document first.
+// Compact by default, pretty printing matches nlohmann's dump(4).
+class JsonWriter {
+	// Public Members
+	public:
+		explicit JsonWriter(std::string& buffer, bool pretty = false);
+		void begin_object();
+		void end_object();
+		void begin_array();
+		void end_array();
+		void key(std::string_view name);
+		void value(std::string_view text);
+		void value(const char* text) { value(std::string_view(text)); }
+		void value(const std::string& text) { value(std::string_view(text)); }
+		void value(long long number);
+		void value(int number) { value(static_cast<long long>(number)); }
+		void value(unsigned long long number);
+		void value(double number);
+		void value(bool flag);
+		void null();
+		// Key and value in one call
+		template <typename T>
+		void field(std::string_view name, const T& item) {
+			key(name);
+			value(item);
+		}
+		const std::string& str() const { return out; }
+	// Private Members
+	private:
+		void before_value();
+		void indent(std::size_t depth);
+		std::string& out;
+		bool pretty;
+		std::vector<bool> empty_scope; // Per open object/array, true until it gets a member.
+		bool after_key = false;
+};
+// Per worker buffer reused across requests so large pages do not reallocate.
+std::string& response_buffer();
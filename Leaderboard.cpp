@@ -0,0 +1,280 @@
+#include "Leaderboard.h"
+#include "QueryCatalog.h"
+#include "Serializer.h"
+#include <iostream>
+#include <mutex>
+#include <ctime>
+// Entries shown by /totals
+static const std::size_t top_count = 10;
+static const long long hour_seconds = 60 * 60;
+// Hours held in the bucket ring, the month window plus room for late and early incidents.
+static const long long bucket_hours = 800;
+// Incidents older than this never reach a window, the window statements read as far back.
+static const long long retained_hours = 32 * 24;
+static const char* window_filters[] = {"day", "week", "month"};
+// Bump a key and move it to its new place in the order.
+void Ranking::add(const std::string& key, long long primary, long long secondary) {
+	auto it = scores.find(key);
+	if (it == scores.end()) {
+		it = scores.emplace(key, std::make_pair(0LL, 0LL)).first;
+	} else {
+		order.erase(std::make_tuple(-it->second.first, -it->second.second, key));
+	}
+	it->second.first += primary;
+	it->second.second += secondary;
+	// Windows take counts away again, keys that drop back to nothing leave the ranking.
+	if (it->second.first == 0 && it->second.second == 0) {
+		scores.erase(it);
+		return;
+	}
+	order.emplace(-it->second.first, -it->second.second, key);
+}
+// Highest scores first
+std::vector<RankingEntry> Ranking::top(std::size_t count) const {
+	std::vector<RankingEntry> entries;
+	for (auto it = order.begin(); it != order.end() && entries.size() < count; ++it) {
+		RankingEntry entry;
+		entry.key = std::get<2>(*it);
+		entry.label = entry.key;
+		entry.primary = -std::get<0>(*it);
+		entry.secondary = -std::get<1>(*it);
+		entries.push_back(std::move(entry));
+	}
+	return entries;
+}
+long long Ranking::score(const std::string& key) const {
+	auto it = scores.find(key);
+	return it == scores.end() ? 0 : it->second.first;
+}
+// Forget everything
+void Ranking::clear() {
+	scores.clear();
+	order.clear();
+}
+// Bucket for the hour, a slot still holding an older hour is emptied first.
+static HourBucket& open_bucket(std::vector<HourBucket>& buckets, long long hour) {
+	HourBucket& bucket = buckets[static_cast<std::size_t>(hour % bucket_hours)];
+	if (bucket.hour != hour) {
+		bucket = HourBucket();
+		bucket.hour = hour;
+	}
+	return bucket;
+}
+// Add one bucket's counts into another of the same hour.
+static void merge(HourBucket& into, const HourBucket& from) {
+	for (const auto& [name, count] : from.killers) into.killers[name] += count;
+	for (const auto& [name, count] : from.victims) into.victims[name] += count;
+	for (const auto& [id, count] : from.systems) into.systems[id] += count;
+	for (const auto& [name, counts] : from.tribes) {
+		into.tribes[name].first += counts.first;
+		into.tribes[name].second += counts.second;
+	}
+}
+// Add a bucket to a window's rankings, or take it away again with a negative sign.
+static void apply(WindowBoard& window, const HourBucket& bucket, long long sign) {
+	for (const auto& [name, count] : bucket.killers) window.killers.add(name, sign * count, 0);
+	for (const auto& [name, count] : bucket.victims) window.victims.add(name, sign * count, 0);
+	for (const auto& [id, count] : bucket.systems) window.systems.add(id, sign * count, 0);
+	for (const auto& [name, counts] : bucket.tribes) window.tribes.add(name, sign * counts.first, sign * counts.second);
+}
+// First hour a window covers, the cutoff's own hour is included whole.
+static long long window_start(const std::string& filter) {
+	return filter_cutoff(filter.c_str()) / hour_seconds;
+}
+// The four boards in the /totals summary layout.
+static void write_summary(JsonWriter& out, const std::vector<RankingEntry>& killers, const std::vector<RankingEntry>& victims,
+		const std::vector<RankingEntry>& systems, const std::vector<RankingEntry>& tribes) {
+	out.begin_object();
+	out.key("top_killers");
+	format_top_killers(out, killers);
+	out.key("top_victims");
+	format_top_victims(out, victims);
+	out.key("top_systems");
+	format_top_systems(out, systems);
+	out.key("top_tribes");
+	format_top_tribes(out, tribes);
+	out.end_object();
+}
+// Build every board once from the full incident history, the windows from the last month of it by hour.
+void Leaderboards::seed(pqxx::transaction_base& txn) {
+	pqxx::result resKillers = exec_statement(txn, "leaderboard_killers");
+	pqxx::result resVictims = exec_statement(txn, "leaderboard_victims");
+	pqxx::result resSystems = exec_statement(txn, "totals_systems");
+	pqxx::result resTribes = exec_statement(txn, "totals_tribes");
+	pqxx::result resWindowKillers = exec_statement(txn, "window_killers");
+	pqxx::result resWindowVictims = exec_statement(txn, "window_victims");
+	pqxx::result resWindowSystems = exec_statement(txn, "window_systems");
+	pqxx::result resWindowTribes = exec_statement(txn, "window_tribes");
+	std::unique_lock<std::shared_mutex> lock(board_mutex);
+	killers.clear();
+	victims.clear();
+	systems.clear();
+	tribes.clear();
+	system_names.clear();
+	for (const auto& row : resKillers) {
+		killers.add(row["name"].as<std::string>(), row["incident_count"].as<long long>(), 0);
+	}
+	for (const auto& row : resVictims) {
+		victims.add(row["name"].as<std::string>(), row["incident_count"].as<long long>(), 0);
+	}
+	for (const auto& row : resSystems) {
+		std::string id = row["solar_system_id"].as<std::string>();
+		system_names[id] = row["solar_system_name"].as<std::string>();
+		systems.add(id, row["incident_count"].as<long long>(), 0);
+	}
+	for (const auto& row : resTribes) {
+		tribes.add(row["tribe_name"].as<std::string>(), row["kills"].as<long long>(), row["losses"].as<long long>());
+	}
+	// Hourly buckets, then every window summed from the ones it covers.
+	long long now_hour = std::time(nullptr) / hour_seconds;
+	buckets.assign(static_cast<std::size_t>(bucket_hours), HourBucket());
+	auto in_range = [&](long long hour) { return hour > now_hour - retained_hours && hour <= now_hour + 24; };
+	for (const auto& row : resWindowKillers) {
+		long long hour = row["hour"].as<long long>();
+		if (in_range(hour)) open_bucket(buckets, hour).killers[row["name"].as<std::string>()] += row["incident_count"].as<long long>();
+	}
+	for (const auto& row : resWindowVictims) {
+		long long hour = row["hour"].as<long long>();
+		if (in_range(hour)) open_bucket(buckets, hour).victims[row["name"].as<std::string>()] += row["incident_count"].as<long long>();
+	}
+	for (const auto& row : resWindowSystems) {
+		long long hour = row["hour"].as<long long>();
+		std::string id = row["solar_system_id"].as<std::string>();
+		system_names[id] = row["solar_system_name"].as<std::string>();
+		if (in_range(hour)) open_bucket(buckets, hour).systems[id] += row["incident_count"].as<long long>();
+	}
+	for (const auto& row : resWindowTribes) {
+		long long hour = row["hour"].as<long long>();
+		if (!in_range(hour)) continue;
+		auto& counts = open_bucket(buckets, hour).tribes[row["tribe_name"].as<std::string>()];
+		counts.first += row["kills"].as<long long>();
+		counts.second += row["losses"].as<long long>();
+	}
+	windows.clear();
+	for (const char* filter : window_filters) {
+		WindowBoard window;
+		window.filter = filter;
+		window.first_hour = window_start(window.filter);
+		for (const auto& bucket : buckets) {
+			if (bucket.hour >= window.first_hour) apply(window, bucket, 1);
+		}
+		windows.push_back(std::move(window));
+	}
+	advanced_hour.store(now_hour, std::memory_order_release);
+	seeded = true;
+	refresh();
+	std::cout << "Leaderboards seeded." << std::endl;
+}
+// Count one incident the same way the aggregate queries would.
+void Leaderboards::record(const IncidentRecord& incident) {
+	std::unique_lock<std::shared_mutex> lock(board_mutex);
+	if (!seeded) return;
+	if (!incident.killer_name.empty()) killers.add(incident.killer_name, 1, 0);
+	if (!incident.victim_name.empty()) victims.add(incident.victim_name, 1, 0);
+	if (!incident.solar_system_name.empty()) {
+		std::string id = std::to_string(incident.solar_system_id);
+		system_names[id] = incident.solar_system_name;
+		systems.add(id, 1, 0);
+	}
+	if (!incident.killer_tribe_name.empty()) tribes.add(incident.killer_tribe_name, 1, 0);
+	if (!incident.victim_tribe_name.empty()) tribes.add(incident.victim_tribe_name, 0, 1);
+	refresh();
+	// Into the incident's hour, and every window already covering that hour.
+	long long now_hour = std::time(nullptr) / hour_seconds;
+	advance(now_hour);
+	long long hour = incident.time_stamp / hour_seconds;
+	if (hour <= now_hour - retained_hours || hour > now_hour + 24) return;
+	HourBucket single;
+	single.hour = hour;
+	if (!incident.killer_name.empty()) single.killers[incident.killer_name] = 1;
+	if (!incident.victim_name.empty()) single.victims[incident.victim_name] = 1;
+	if (!incident.solar_system_name.empty()) single.systems[std::to_string(incident.solar_system_id)] = 1;
+	if (!incident.killer_tribe_name.empty()) single.tribes[incident.killer_tribe_name].first += 1;
+	if (!incident.victim_tribe_name.empty()) single.tribes[incident.victim_tribe_name].second += 1;
+	merge(open_bucket(buckets, hour), single);
+	for (auto& window : windows) {
+		if (hour >= window.first_hour) apply(window, single, 1);
+	}
+}
+// Buckets falling out of a window are taken away, buckets it grows back over are added again.
+void Leaderboards::advance(long long now_hour) {
+	if (advanced_hour.load(std::memory_order_acquire) == now_hour) return;
+	for (auto& window : windows) {
+		long long first = window_start(window.filter);
+		while (window.first_hour < first) {
+			apply(window, bucket(window.first_hour), -1);
+			window.first_hour++;
+		}
+		while (window.first_hour > first) {
+			window.first_hour--;
+			apply(window, bucket(window.first_hour), 1);
+		}
+	}
+	advanced_hour.store(now_hour, std::memory_order_release);
+}
+// Bucket of the hour, empty when its slot has moved on.
+const HourBucket& Leaderboards::bucket(long long hour) const {
+	static const HourBucket empty;
+	if (hour < 0 || buckets.empty()) return empty;
+	const HourBucket& slot = buckets[static_cast<std::size_t>(hour % bucket_hours)];
+	return slot.hour == hour ? slot : empty;
+}
+// Refresh the served top rows, caller holds the write lock.
+void Leaderboards::refresh() {
+	top_killers = killers.top(top_count);
+	top_victims = victims.top(top_count);
+	top_systems = systems.top(top_count);
+	for (auto& entry : top_systems) {
+		entry.label = system_names[entry.key];
+	}
+	top_tribes = tribes.top(top_count);
+}
+// Seeded and able to answer /totals
+bool Leaderboards::ready() const {
+	std::shared_lock<std::shared_mutex> lock(board_mutex);
+	return seeded;
+}
+// Write the current summary, false until seeded.
+bool Leaderboards::summary(JsonWriter& out) const {
+	std::shared_lock<std::shared_mutex> lock(board_mutex);
+	if (!seeded) return false;
+	write_summary(out, top_killers, top_victims, top_systems, top_tribes);
+	return true;
+}
+// Windowed summary, the hour is moved on first when it has turned since the last incident.
+bool Leaderboards::summary(JsonWriter& out, const char* filter_param) {
+	if (!filter_param) return false;
+	long long now_hour = std::time(nullptr) / hour_seconds;
+	if (advanced_hour.load(std::memory_order_acquire) != now_hour) {
+		std::unique_lock<std::shared_mutex> lock(board_mutex);
+		if (seeded) advance(now_hour);
+	}
+	std::shared_lock<std::shared_mutex> lock(board_mutex);
+	if (!seeded) return false;
+	for (const auto& window : windows) {
+		if (window.filter != filter_param) continue;
+		std::vector<RankingEntry> window_systems = window.systems.top(top_count);
+		for (auto& entry : window_systems) {
+			auto it = system_names.find(entry.key);
+			if (it != system_names.end()) entry.label = it->second;
+		}
+		write_summary(out, window.killers.top(top_count), window.victims.top(top_count), window_systems, window.tribes.top(top_count));
+		return true;
+	}
+	return false;
+}
+// One lock for the whole list, suggestions rank every match.
+std::vector<std::pair<long long, long long>> Leaderboards::activity(const std::vector<std::string>& names) const {
+	std::vector<std::pair<long long, long long>> scores(names.size(), std::make_pair(0LL, 0LL));
+	std::shared_lock<std::shared_mutex> lock(board_mutex);
+	if (!seeded) return scores;
+	for (std::size_t i = 0; i < names.size(); i++) {
+		scores[i] = std::make_pair(killers.score(names[i]), victims.score(names[i]));
+	}
+	return scores;
+}
+// Process wide leaderboards
+Leaderboards& leaderboards() {
+	static Leaderboards boards;
+	return boards;
+}
@@ -0,0 +1,84 @@
+#pragma once
+#include <pqxx/pqxx>
+#include <string>
+#include <vector>
+#include <set>
+#include <tuple>
+#include <unordered_map>
+#include <shared_mutex>
+#include <atomic>
+#include "IncidentRing.h"
+#include "JsonWriter.h"
+// One row of a ranking, primary then secondary score.
+struct RankingEntry {
+	std::string key;
+	std::string label;
+	long long primary = 0;
+	long long secondary = 0;
+};
+// Scores kept in descending order so the top rows are always at hand.
+class Ranking {
+	// Public Members
+	public:
+		void add(const std::string& key, long long primary, long long secondary);
+		std::vector<RankingEntry> top(std::size_t count) const;
+		// Primary score of a key, zero when never added.
+		long long score(const std::string& key) const;
+		void clear();
+	// Private Members
+	private:
+		std::unordered_map<std::string, std::pair<long long, long long>> scores;
+		std::set<std::tuple<long long, long long, std::string>> order; // Negated scores, then key
+};
+// Kills and losses of one hour, keyed like the rankings.
+struct HourBucket {
+	long long hour = -1;
+	std::unordered_map<std::string, long long> killers;
+	std::unordered_map<std::string, long long> victims;
+	std::unordered_map<std::string, long long> systems;
+	std::unordered_map<std::string, std::pair<long long, long long>> tribes;
+};
+// Rankings over the buckets from first_hour on, for one of the day, week and month filters.
+struct WindowBoard {
+	std::string filter;
+	long long first_hour = 0;
+	Ranking killers;
+	Ranking victims;
+	Ranking systems;
+	Ranking tribes;
+};
+// All-time and windowed top killers, victims, systems and tribes for /totals.
+class Leaderboards {
+	// Public Members
+	public:
+		void seed(pqxx::transaction_base& txn);
+		void record(const IncidentRecord& incident);
+		bool ready() const;
+		bool summary(JsonWriter& out) const;
+		// Summary over the day, week or month window, false until seeded or for any other filter.
+		bool summary(JsonWriter& out, const char* filter_param);
+		// All-time kills and losses per character name, zeros until seeded.
+		std::vector<std::pair<long long, long long>> activity(const std::vector<std::string>& names) const;
+	// Private Members
+	private:
+		void refresh();
+		// Move every window up to the current hour, caller holds the write lock.
+		void advance(long long now_hour);
+		const HourBucket& bucket(long long hour) const;
+		mutable std::shared_mutex board_mutex;
+		Ranking killers;
+		Ranking victims;
+		Ranking systems;
+		Ranking tribes;
+		std::unordered_map<std::string, std::string> system_names;
+		std::vector<RankingEntry> top_killers;
+		std::vector<RankingEntry> top_victims;
+		std::vector<RankingEntry> top_systems;
+		std::vector<RankingEntry> top_tribes;
+		std::vector<HourBucket> buckets; // Ring indexed by hour
+		std::vector<WindowBoard> windows;
+		std::atomic<long long> advanced_hour{0};
+		bool seeded = false;
+};
+// Process wide leaderboards
+Leaderboards& leaderboards();
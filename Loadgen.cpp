@@ -0,0 +1,699 @@
+// Load generator for a running server: a weighted route mix over keep-alive connections, /mails subscribers,
+// synthetic incident_trigger notifications and replay of recorded request logs.
+// Usage:
+//   loadgen [options]        run a workload and print throughput and latency percentiles per route
+//   loadgen seed [options]   print SQL seeding a local database with data the workload knows how to ask for
+#include <asio.hpp>
+#include <pqxx/pqxx>
+#include <nlohmann/json.hpp>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib> // For getenv
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <random>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+using Clock = std::chrono::steady_clock;
+// Id ranges and names shared by the seed SQL and the generated requests.
+static const long long system_base = 30000000;
+static const long long tribe_base = 98000000;
+static const long long character_base = 2112000000;
+// Everything the command line can set
+struct LoadOptions {
+	std::string host = "127.0.0.1";
+	std::string port = "8080";
+	double duration = 30;
+	std::size_t connections = 16;
+	double timeout = 10; // Seconds before a request counts as an error
+	double rate = 0; // Requests per second across all connections, 0 runs closed loop.
+	std::vector<std::pair<std::string, double>> mix = {{"incident", 40}, {"totals", 15}, {"characters", 15}, {"tribes", 15}, {"location", 15}};
+	bool gzip = false;
+	std::size_t subscribers = 0;
+	double notify_rate = 0;
+	std::string replay;
+	std::string record;
+	unsigned long long seed = 42;
+	// Dataset size, the seed subcommand creates it and the workload draws names from it.
+	long long systems = 5000;
+	long long tribes = 500;
+	long long characters = 20000;
+	long long incidents = 200000;
+};
+// One request on the plan, offset is from the start of the run.
+struct PlannedRequest {
+	long long offset_ms = -1;
+	std::string route;
+	std::string path;
+};
+// Latencies and outcomes of one route
+struct RouteSamples {
+	std::vector<long long> latencies_ns;
+	unsigned long long errors = 0;
+	unsigned long long bytes = 0;
+};
+using SampleMap = std::map<std::string, RouteSamples>;
+static void print_usage() {
+	std::cerr << "Usage: loadgen [options]\n"
+		"  --host HOST              server host (127.0.0.1)\n"
+		"  --port PORT              server port (8080)\n"
+		"  --duration SECONDS       run time (30)\n"
+		"  --connections N          keep-alive HTTP connections, one thread each (16)\n"
+		"  --timeout SECONDS        per request timeout, counted as an error (10)\n"
+		"  --rate N                 open loop requests per second in total, 0 for closed loop (0)\n"
+		"  --mix route=weight,...   incident, totals, characters, tribes, location, near\n"
+		"  --gzip                   send Accept-Encoding: gzip\n"
+		"  --subscribers N          /mails WebSocket subscribers (0)\n"
+		"  --notify-rate N          incident_trigger notifications per second, needs PGDIRECT_* (0)\n"
+		"  --replay FILE            replay a request log instead of the mix\n"
+		"  --record FILE            write the requests sent as a replayable log\n"
+		"  --seed N                 random seed (42)\n"
+		"  --systems N --tribes N --characters N --incidents N   dataset size, must match the seed\n"
+		"Usage: loadgen seed [--systems N --tribes N --characters N --incidents N --seed N] | psql\n";
+}
+// route=weight,route=weight
+static std::vector<std::pair<std::string, double>> parse_mix(const std::string& text) {
+	static const std::vector<std::string> known = {"incident", "totals", "characters", "tribes", "location", "near"};
+	std::vector<std::pair<std::string, double>> mix;
+	std::stringstream stream(text);
+	std::string item;
+	while (std::getline(stream, item, ',')) {
+		std::size_t equals = item.find('=');
+		std::string route = item.substr(0, equals);
+		if (std::find(known.begin(), known.end(), route) == known.end()) {
+			throw std::invalid_argument("Unknown route in --mix: " + route);
+		}
+		double weight = equals == std::string::npos ? 1.0 : std::stod(item.substr(equals + 1));
+		if (weight > 0) mix.emplace_back(route, weight);
+	}
+	if (mix.empty()) throw std::invalid_argument("--mix has no positive weights");
+	return mix;
+}
+// --name value pairs from argv[first] on
+static LoadOptions parse_options(int argc, char* argv[], int first) {
+	LoadOptions options;
+	for (int i = first; i < argc; i++) {
+		std::string name = argv[i];
+		if (name == "--gzip") {
+			options.gzip = true;
+			continue;
+		}
+		if (i + 1 >= argc) throw std::invalid_argument("Missing value for " + name);
+		std::string value = argv[++i];
+		if (name == "--host") options.host = value;
+		else if (name == "--port") options.port = value;
+		else if (name == "--duration") options.duration = std::stod(value);
+		else if (name == "--connections") options.connections = std::max<std::size_t>(1, std::stoull(value));
+		else if (name == "--timeout") options.timeout = std::stod(value);
+		else if (name == "--rate") options.rate = std::stod(value);
+		else if (name == "--mix") options.mix = parse_mix(value);
+		else if (name == "--subscribers") options.subscribers = std::stoull(value);
+		else if (name == "--notify-rate") options.notify_rate = std::stod(value);
+		else if (name == "--replay") options.replay = value;
+		else if (name == "--record") options.record = value;
+		else if (name == "--seed") options.seed = std::stoull(value);
+		else if (name == "--systems") options.systems = std::max(1LL, std::stoll(value));
+		else if (name == "--tribes") options.tribes = std::max(1LL, std::stoll(value));
+		else if (name == "--characters") options.characters = std::max(1LL, std::stoll(value));
+		else if (name == "--incidents") options.incidents = std::max(1LL, std::stoll(value));
+		else throw std::invalid_argument("Unknown option " + name);
+	}
+	return options;
+}
+// Synthetic dataset in the tables the catalog reads. Tables are only created when missing, so this also tops up an
+// existing database. Production triggers are not installed, incident_trigger is fired by the workload itself.
+static void print_seed_sql(const LoadOptions& options) {
+	std::string systems = std::to_string(options.systems);
+	std::string tribes = std::to_string(options.tribes);
+	std::string characters = std::to_string(options.characters);
+	std::string incidents = std::to_string(options.incidents);
+	double setseed = static_cast<double>(options.seed % 1000) / 1000.0;
+	std::cout << "-- loadgen seed: " << systems << " systems, " << tribes << " tribes, " << characters << " characters, " << incidents << " incidents\n"
+		"BEGIN;\n"
+		"SELECT setseed(" << setseed << ");\n"
+		"CREATE TABLE IF NOT EXISTS systems (solar_system_id BIGINT PRIMARY KEY, solar_system_name TEXT NOT NULL, x NUMERIC, y NUMERIC, z NUMERIC);\n"
+		"CREATE TABLE IF NOT EXISTS tribes (id BIGINT PRIMARY KEY, name TEXT NOT NULL, url TEXT);\n"
+		"CREATE TABLE IF NOT EXISTS characters (id BIGINT PRIMARY KEY, name TEXT NOT NULL, address BYTEA);\n"
+		"CREATE TABLE IF NOT EXISTS character_tribe_membership (character_id BIGINT NOT NULL, tribe_id BIGINT NOT NULL, joined_at BIGINT NOT NULL, left_at BIGINT);\n"
+		"CREATE TABLE IF NOT EXISTS incident (id BIGINT PRIMARY KEY, victim_id BIGINT, killer_id BIGINT, solar_system_id BIGINT, loss_type INTEGER, time_stamp BIGINT);\n"
+		"INSERT INTO systems SELECT " << system_base << " + g, 'system-' || g, round((random() - 0.5) * 1e19), round((random() - 0.5) * 1e19), round((random() - 0.5) * 1e19)\n"
+		"  FROM generate_series(1, " << systems << ") g ON CONFLICT DO NOTHING;\n"
+		"INSERT INTO tribes SELECT " << tribe_base << " + g, 'tribe-' || g, CASE WHEN g % 2 = 0 THEN 'https://example.com/tribe/' || g END\n"
+		"  FROM generate_series(1, " << tribes << ") g ON CONFLICT DO NOTHING;\n"
+		"INSERT INTO characters SELECT " << character_base << " + g, 'pilot-' || g, decode(md5('pilot-' || g) || substr(md5(g::text), 1, 8), 'hex')\n"
+		"  FROM generate_series(1, " << characters << ") g ON CONFLICT DO NOTHING;\n"
+		"-- Everyone is in a tribe now, every third character also left an earlier one.\n"
+		"INSERT INTO character_tribe_membership SELECT " << character_base << " + g, " << tribe_base << " + 1 + (g % " << tribes << "),\n"
+		"  extract(epoch from now())::bigint - 400 * 86400, NULL FROM generate_series(1, " << characters << ") g;\n"
+		"INSERT INTO character_tribe_membership SELECT " << character_base << " + g, " << tribe_base << " + 1 + ((g * 7) % " << tribes << "),\n"
+		"  extract(epoch from now())::bigint - 800 * 86400, extract(epoch from now())::bigint - 400 * 86400\n"
+		"  FROM generate_series(1, " << characters << ") g WHERE g % 3 = 0;\n"
+		"-- Incidents spread over the last 60 days so every filter window has rows.\n"
+		"INSERT INTO incident SELECT g,\n"
+		"  " << character_base << " + 1 + floor(random() * " << characters << ")::bigint,\n"
+		"  " << character_base << " + 1 + floor(random() * " << characters << ")::bigint,\n"
+		"  " << system_base << " + 1 + floor(random() * " << systems << ")::bigint,\n"
+		"  floor(random() * 3)::int,\n"
+		"  extract(epoch from now())::bigint - floor(random() * 60 * 86400)::bigint\n"
+		"  FROM generate_series(1, " << incidents << ") g ON CONFLICT DO NOTHING;\n"
+		"COMMIT;\n"
+		"ANALYZE;\n";
+}
+// Path for a route with parameters drawn from the seeded dataset.
+static std::string make_path(const std::string& route, std::mt19937_64& rng, const LoadOptions& options) {
+	auto pick = [&rng](long long count) { return std::to_string(std::uniform_int_distribution<long long>(1, count)(rng)); };
+	int variant = std::uniform_int_distribution<int>(0, 4)(rng);
+	if (route == "incident") {
+		switch (variant) {
+			case 0: return "/incident";
+			case 1: return "/incident?limit=50&cursor=";
+			case 2: return "/incident?name=pilot-" + pick(options.characters);
+			case 3: return "/incident?system=system-" + pick(options.systems);
+			default: return "/incident?filter=day";
+		}
+	}
+	if (route == "totals") {
+		static const char* filters[] = {"", "?filter=day", "?filter=week", "?filter=month", ""};
+		return std::string("/totals") + filters[variant];
+	}
+	if (route == "characters") return "/characters?name=pilot-" + pick(options.characters);
+	if (route == "tribes") return variant == 0 ? "/tribes" : "/tribes?name=tribe-" + pick(options.tribes);
+	if (route == "location") return "/location?system=system-" + pick(options.systems);
+	return "/location/near?system=system-" + pick(options.systems) + "&limit=10";
+}
+// Route label of a replayed path, its first segment.
+static std::string route_of(const std::string& path) {
+	std::string route = path.substr(0, path.find('?'));
+	if (route == "/location/near") return "near";
+	std::size_t start = route.find_first_not_of('/');
+	if (start == std::string::npos) return "/";
+	std::size_t end = route.find('/', start);
+	return route.substr(start, end == std::string::npos ? std::string::npos : end - start);
+}
+// Lines of "[offset_ms] path", blank lines and # comments skipped.
+static std::vector<PlannedRequest> load_replay(const std::string& file) {
+	std::ifstream input(file);
+	if (!input) throw std::runtime_error("Cannot open replay log " + file);
+	std::vector<PlannedRequest> plan;
+	std::string line;
+	while (std::getline(input, line)) {
+		if (line.empty() || line[0] == '#') continue;
+		PlannedRequest request;
+		std::size_t space = line.find_first_of(" \t");
+		if (line[0] != '/' && space != std::string::npos) {
+			request.offset_ms = std::stoll(line.substr(0, space));
+			line = line.substr(line.find_first_not_of(" \t", space));
+		}
+		request.path = line;
+		request.route = route_of(line);
+		plan.push_back(std::move(request));
+	}
+	std::stable_sort(plan.begin(), plan.end(), [](const PlannedRequest& a, const PlannedRequest& b) { return a.offset_ms < b.offset_ms; });
+	return plan;
+}
+// Blocking HTTP/1.1 client on one keep-alive connection, reconnects after errors or Connection: close.
+class HttpClient {
+	// Public Members
+	public:
+		explicit HttpClient(const LoadOptions& options) : socket(io), options(options) {}
+		// Status code of a GET, body bytes through the out parameter. Throws on transport errors.
+		int get(const std::string& path, std::size_t& body_bytes) {
+			if (!socket.is_open()) connect();
+			try {
+				return exchange(path, body_bytes);
+			} catch (...) {
+				asio::error_code ignored;
+				socket.close(ignored);
+				incoming.consume(incoming.size());
+				throw;
+			}
+		}
+	// Private Members
+	private:
+		void connect() {
+			asio::ip::tcp::resolver resolver(io);
+			asio::connect(socket, resolver.resolve(options.host, options.port));
+			socket.set_option(asio::ip::tcp::no_delay(true));
+		}
+		int exchange(const std::string& path, std::size_t& body_bytes) {
+			std::string request = "GET " + path + " HTTP/1.1\r\nHost: " + options.host + ":" + options.port + "\r\n";
+			if (options.gzip) request += "Accept-Encoding: gzip\r\n";
+			request += "\r\n";
+			with_deadline([&](auto done) { asio::async_write(socket, asio::buffer(request), done); });
+			std::size_t header_bytes = with_deadline([&](auto done) { asio::async_read_until(socket, incoming, "\r\n\r\n", done); });
+			std::string header(asio::buffers_begin(incoming.data()), asio::buffers_begin(incoming.data()) + header_bytes);
+			incoming.consume(header_bytes);
+			// Status line then the two headers we care about
+			int status = header.size() > 12 ? std::atoi(header.c_str() + 9) : 0;
+			std::size_t content_length = 0;
+			bool close_after = false;
+			std::string lower = header;
+			std::transform(lower.begin(), lower.end(), lower.begin(), [](unsigned char c) { return std::tolower(c); });
+			std::size_t length_at = lower.find("\r\ncontent-length:");
+			if (length_at != std::string::npos) content_length = std::strtoull(lower.c_str() + length_at + 17, nullptr, 10);
+			if (lower.find("\r\nconnection: close") != std::string::npos) close_after = true;
+			if (incoming.size() < content_length) {
+				std::size_t remaining = content_length - incoming.size();
+				with_deadline([&](auto done) { asio::async_read(socket, incoming, asio::transfer_exactly(remaining), done); });
+			}
+			incoming.consume(content_length);
+			body_bytes = content_length;
+			if (close_after) socket.close();
+			return status;
+		}
+		// Run one asynchronous operation, giving up after the request timeout so a stuck server cannot hang a worker.
+		template <typename Start>
+		std::size_t with_deadline(Start start) {
+			asio::error_code result = asio::error::would_block;
+			std::size_t transferred = 0;
+			start([&](const asio::error_code& error, std::size_t bytes) {
+				result = error;
+				transferred = bytes;
+			});
+			io.restart();
+			io.run_for(std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double>(options.timeout)));
+			if (result == asio::error::would_block) {
+				asio::error_code ignored;
+				socket.close(ignored);
+				io.restart();
+				io.run();
+				throw std::runtime_error("Request timed out");
+			}
+			if (result) throw asio::system_error(result);
+			return transferred;
+		}
+		asio::io_context io;
+		asio::ip::tcp::socket socket;
+		asio::streambuf incoming;
+		const LoadOptions& options;
+};
+// When each synthetic incident was fired, by id, so subscribers can work out the fan out latency.
+class FireLog {
+	// Public Members
+	public:
+		void fired(long long id, Clock::time_point at) {
+			std::lock_guard<std::mutex> lock(log_mutex);
+			times[id] = at;
+			count++;
+		}
+		bool find(long long id, Clock::time_point& at) const {
+			std::lock_guard<std::mutex> lock(log_mutex);
+			auto it = times.find(id);
+			if (it == times.end()) return false;
+			at = it->second;
+			return true;
+		}
+		unsigned long long total() const {
+			std::lock_guard<std::mutex> lock(log_mutex);
+			return count;
+		}
+	// Private Members
+	private:
+		mutable std::mutex log_mutex;
+		std::unordered_map<long long, Clock::time_point> times;
+		unsigned long long count = 0;
+};
+// One /mails subscriber, reads frames asynchronously and times the synthetic incidents it receives.
+// The socket runs on its own strand, so its handlers and close never overlap across the io threads.
+class MailSubscriber : public std::enable_shared_from_this<MailSubscriber> {
+	// Public Members
+	public:
+		MailSubscriber(asio::io_context& io, const FireLog& fire_log) : socket(asio::make_strand(io)), fire_log(fire_log) {}
+		// Connect and upgrade, blocking, before the io threads start.
+		void open(const LoadOptions& options) {
+			asio::ip::tcp::resolver resolver(socket.get_executor());
+			asio::connect(socket, resolver.resolve(options.host, options.port));
+			std::string request = "GET /mails HTTP/1.1\r\nHost: " + options.host + ":" + options.port + "\r\n"
+				"Upgrade: websocket\r\nConnection: Upgrade\r\n"
+				"Sec-WebSocket-Key: bG9hZGdlbi1zdWJzY3JpYmVy\r\nSec-WebSocket-Version: 13\r\n\r\n";
+			asio::write(socket, asio::buffer(request));
+			std::size_t header_bytes = asio::read_until(socket, incoming, "\r\n\r\n");
+			std::string header(asio::buffers_begin(incoming.data()), asio::buffers_begin(incoming.data()) + header_bytes);
+			incoming.consume(header_bytes);
+			if (header.compare(0, 12, "HTTP/1.1 101") != 0) throw std::runtime_error("WebSocket upgrade refused: " + header.substr(0, header.find('\r')));
+		}
+		void start() {
+			read_frame();
+		}
+		// Runs on the subscriber's strand, after any read handler already in flight.
+		void close() {
+			auto self = shared_from_this();
+			asio::post(socket.get_executor(), [this, self]() {
+				stopping = true;
+				asio::error_code ignored;
+				socket.close(ignored);
+			});
+		}
+		// Read by the main thread once the io threads are joined.
+		std::vector<long long> latencies_ns;
+		unsigned long long messages = 0;
+		bool closed = false;
+	// Private Members
+	private:
+		// Call next once the buffer holds at least bytes.
+		template <typename Next>
+		void need(std::size_t bytes, Next next) {
+			if (incoming.size() >= bytes) {
+				next();
+				return;
+			}
+			auto self = shared_from_this();
+			asio::async_read(socket, incoming, asio::transfer_at_least(bytes - incoming.size()),
+				[this, self, bytes, next](const asio::error_code& error, std::size_t) {
+					if (error) {
+						if (!stopping) closed = true;
+						return;
+					}
+					need(bytes, next);
+				});
+		}
+		const unsigned char* peek() const {
+			return static_cast<const unsigned char*>(incoming.data().data());
+		}
+		// Header first, then the whole frame once its length is known.
+		void read_frame() {
+			need(2, [this]() {
+				unsigned char length_code = peek()[1] & 0x7F;
+				std::size_t header = 2 + (length_code == 126 ? 2 : (length_code == 127 ? 8 : 0)) + ((peek()[1] & 0x80) ? 4 : 0);
+				need(header, [this, header, length_code]() {
+					std::size_t length = length_code;
+					if (length_code == 126) length = (std::size_t(peek()[2]) << 8) | peek()[3];
+					if (length_code == 127) {
+						length = 0;
+						for (int i = 2; i < 10; i++) length = (length << 8) | peek()[i];
+					}
+					need(header + length, [this, header, length]() { frame(header, length); });
+				});
+			});
+		}
+		void frame(std::size_t header, std::size_t length) {
+			const unsigned char* data = peek();
+			bool fin = data[0] & 0x80;
+			unsigned char opcode = data[0] & 0x0F;
+			bool masked = data[1] & 0x80;
+			std::string payload(reinterpret_cast<const char*>(data + header), length);
+			if (masked) {
+				const unsigned char* mask = data + header - 4;
+				for (std::size_t i = 0; i < length; i++) payload[i] ^= mask[i % 4];
+			}
+			incoming.consume(header + length);
+			if (opcode == 0x8) {
+				closed = true;
+				return;
+			}
+			if (opcode == 0x9) pong(payload);
+			if (opcode == 0x1 || opcode == 0x0) {
+				message += payload;
+				if (fin) {
+					deliver(message);
+					message.clear();
+				}
+			}
+			read_frame();
+		}
+		// Client frames are masked, an all zero mask keeps the payload as is.
+		void pong(const std::string& payload) {
+			std::string reply;
+			reply.push_back(static_cast<char>(0x8A));
+			reply.push_back(static_cast<char>(0x80 | std::min<std::size_t>(payload.size(), 125)));
+			reply.append(4, '\0');
+			reply.append(payload, 0, 125);
+			asio::error_code ignored;
+			asio::write(socket, asio::buffer(reply), ignored);
+		}
+		void deliver(const std::string& text) {
+			messages++;
+			auto parsed = nlohmann::json::parse(text, nullptr, false);
+			if (parsed.is_discarded() || !parsed.is_object() || !parsed.contains("id")) return;
+			const auto& id_value = parsed["id"];
+			long long id = id_value.is_string() ? std::atoll(id_value.get<std::string>().c_str()) : (id_value.is_number_integer() ? id_value.get<long long>() : 0);
+			Clock::time_point fired_at;
+			if (fire_log.find(id, fired_at)) {
+				latencies_ns.push_back(std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now() - fired_at).count());
+			}
+		}
+		asio::ip::tcp::socket socket;
+		asio::streambuf incoming;
+		std::string message;
+		bool stopping = false;
+		const FireLog& fire_log;
+};
+// Direct connection settings, the same PGDIRECT_* variables the listener uses.
+static std::string direct_connection_string() {
+	const char* dbname = std::getenv("PGDIRECT_DB");
+	const char* user = std::getenv("PGDIRECT_USER");
+	const char* password = std::getenv("PGDIRECT_PASSWORD");
+	const char* host = std::getenv("PGDIRECT_HOST");
+	const char* port = std::getenv("PGDIRECT_PORT");
+	if (!dbname || !user || !password || !host || !port) {
+		throw std::runtime_error("PGDIRECT_* environment variables are not set, --notify-rate needs them.");
+	}
+	return "dbname=" + std::string(dbname) + " user=" + std::string(user) + " password=" + std::string(password) +
+		" host=" + std::string(host) + " port=" + std::string(port);
+}
+// Fire incident_trigger at a steady rate with payloads shaped like the production trigger's.
+static void fire_notifications(const LoadOptions& options, FireLog& fire_log, Clock::time_point end) {
+	pqxx::connection conn(direct_connection_string());
+	conn.prepare("loadgen_fire", "SELECT pg_notify('incident_trigger', $1)");
+	std::mt19937_64 rng(options.seed ^ 0x9E3779B97F4A7C15ULL);
+	auto pick = [&rng](long long base, long long count) { return base + std::uniform_int_distribution<long long>(1, count)(rng); };
+	// Ids well above anything seeded, and different on every run.
+	long long next_id = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::system_clock::now().time_since_epoch()).count() * 1000;
+	auto interval = std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double>(1.0 / options.notify_rate));
+	Clock::time_point scheduled = Clock::now();
+	while (scheduled < end) {
+		std::this_thread::sleep_until(scheduled);
+		nlohmann::json payload;
+		payload["id"] = next_id;
+		payload["victim_id"] = std::to_string(pick(character_base, options.characters));
+		payload["killer_id"] = std::to_string(pick(character_base, options.characters));
+		payload["solar_system_id"] = pick(system_base, options.systems);
+		payload["loss_type"] = 0;
+		payload["time_stamp"] = std::chrono::duration_cast<std::chrono::seconds>(std::chrono::system_clock::now().time_since_epoch()).count();
+		fire_log.fired(next_id, Clock::now());
+		pqxx::nontransaction txn(conn);
+		txn.exec_prepared("loadgen_fire", payload.dump());
+		next_id++;
+		scheduled += interval;
+	}
+}
+// Weighted route picker
+class RouteMix {
+	// Public Members
+	public:
+		explicit RouteMix(const std::vector<std::pair<std::string, double>>& mix) {
+			double total = 0;
+			for (const auto& [route, weight] : mix) {
+				total += weight;
+				routes.push_back(route);
+				cumulative.push_back(total);
+			}
+		}
+		const std::string& pick(std::mt19937_64& rng) const {
+			double point = std::uniform_real_distribution<double>(0, cumulative.back())(rng);
+			std::size_t index = std::upper_bound(cumulative.begin(), cumulative.end(), point) - cumulative.begin();
+			return routes[std::min(index, routes.size() - 1)];
+		}
+	// Private Members
+	private:
+		std::vector<std::string> routes;
+		std::vector<double> cumulative;
+};
+// Shared state of the HTTP workers
+struct Workload {
+	explicit Workload(const LoadOptions& options) : options(options), mix(options.mix) {}
+	const LoadOptions& options;
+	RouteMix mix;
+	std::vector<PlannedRequest> replay;
+	bool paced = false; // Replay log carries offsets
+	std::atomic<std::size_t> next_replay{0};
+	Clock::time_point start;
+	Clock::time_point end;
+};
+// One connection's loop. Open loop and paced replay measure from the scheduled send time so a stalled server
+// shows up in the percentiles instead of quietly lowering the request rate.
+static void run_worker(Workload& workload, std::size_t worker, SampleMap& samples, std::vector<PlannedRequest>& sent) {
+	const LoadOptions& options = workload.options;
+	std::mt19937_64 rng(options.seed + worker * 7919);
+	HttpClient client(options);
+	Clock::duration interval = Clock::duration::zero();
+	if (options.rate > 0) {
+		interval = std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double>(options.connections / options.rate));
+	}
+	// Spread the first sends over one interval
+	Clock::time_point scheduled = workload.start + interval * worker / options.connections;
+	while (true) {
+		PlannedRequest request;
+		if (!workload.replay.empty()) {
+			std::size_t index = workload.next_replay.fetch_add(1);
+			if (index >= workload.replay.size()) break;
+			request = workload.replay[index];
+			if (workload.paced) scheduled = workload.start + std::chrono::milliseconds(request.offset_ms);
+		} else {
+			request.route = workload.mix.pick(rng);
+			request.path = make_path(request.route, rng, options);
+		}
+		bool timed_from_schedule = workload.paced || (workload.replay.empty() && options.rate > 0);
+		if (timed_from_schedule) {
+			if (scheduled >= workload.end) break;
+			std::this_thread::sleep_until(scheduled);
+		} else {
+			scheduled = Clock::now();
+			if (scheduled >= workload.end) break;
+		}
+		request.offset_ms = std::chrono::duration_cast<std::chrono::milliseconds>(scheduled - workload.start).count();
+		RouteSamples& route = samples[request.route];
+		try {
+			std::size_t body_bytes = 0;
+			int status = client.get(request.path, body_bytes);
+			route.latencies_ns.push_back(std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now() - scheduled).count());
+			route.bytes += body_bytes;
+			if (status < 200 || status >= 400) route.errors++;
+		} catch (const std::exception&) {
+			route.errors++;
+		}
+		if (!options.record.empty()) sent.push_back(std::move(request));
+		if (interval != Clock::duration::zero()) scheduled += interval;
+	}
+}
+// Nearest rank percentile of sorted samples, in milliseconds
+static double percentile_ms(const std::vector<long long>& sorted, double quantile) {
+	if (sorted.empty()) return 0;
+	std::size_t rank = static_cast<std::size_t>(std::ceil(quantile * sorted.size()));
+	return sorted[std::min(sorted.size() - 1, rank == 0 ? 0 : rank - 1)] / 1e6;
+}
+static void print_row(const std::string& route, std::vector<long long>& latencies, unsigned long long errors, double seconds, double average_kb) {
+	std::sort(latencies.begin(), latencies.end());
+	std::printf("%-12s %10zu %8llu %10.1f %9.2f %9.2f %9.2f %9.2f %9.2f %9.1f\n", route.c_str(), latencies.size(), errors, latencies.size() / seconds,
+		percentile_ms(latencies, 0.50), percentile_ms(latencies, 0.95), percentile_ms(latencies, 0.99), percentile_ms(latencies, 0.999),
+		latencies.empty() ? 0.0 : latencies.back() / 1e6, average_kb);
+}
+static int run_load(const LoadOptions& options) {
+	Workload workload(options);
+	if (!options.replay.empty()) {
+		workload.replay = load_replay(options.replay);
+		workload.paced = !workload.replay.empty() && workload.replay.front().offset_ms >= 0;
+		if (workload.replay.empty()) throw std::runtime_error("Replay log is empty");
+	}
+	// Subscribers connect first so they see every fired incident.
+	asio::io_context subscriber_io;
+	FireLog fire_log;
+	std::vector<std::shared_ptr<MailSubscriber>> subscribers;
+	for (std::size_t i = 0; i < options.subscribers; i++) {
+		auto subscriber = std::make_shared<MailSubscriber>(subscriber_io, fire_log);
+		subscriber->open(options);
+		subscriber->start();
+		subscribers.push_back(std::move(subscriber));
+	}
+	std::vector<std::thread> subscriber_threads;
+	if (!subscribers.empty()) {
+		for (int i = 0; i < 2; i++) subscriber_threads.emplace_back([&subscriber_io]() { subscriber_io.run(); });
+	}
+	// Replays run until the log is used up, the duration still caps them.
+	workload.start = Clock::now();
+	workload.end = workload.start + std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double>(options.duration));
+	std::thread notifier;
+	std::atomic<bool> notifier_failed{false};
+	if (options.notify_rate > 0) {
+		notifier = std::thread([&]() {
+			try {
+				fire_notifications(options, fire_log, workload.end);
+			} catch (const std::exception& e) {
+				std::cerr << "Error: Notifications stopped: " << e.what() << std::endl;
+				notifier_failed = true;
+			}
+		});
+	}
+	std::vector<SampleMap> samples(options.connections);
+	std::vector<std::vector<PlannedRequest>> sent(options.connections);
+	std::vector<std::thread> workers;
+	for (std::size_t i = 0; i < options.connections; i++) {
+		workers.emplace_back([&, i]() { run_worker(workload, i, samples[i], sent[i]); });
+	}
+	for (auto& worker : workers) worker.join();
+	double seconds = std::chrono::duration<double>(Clock::now() - workload.start).count();
+	if (notifier.joinable()) notifier.join();
+	// Give the last notifications time to arrive before hanging up.
+	if (!subscribers.empty()) {
+		std::this_thread::sleep_for(std::chrono::seconds(2));
+		for (auto& subscriber : subscribers) subscriber->close();
+		for (auto& thread : subscriber_threads) thread.join();
+	}
+	// Merge and report
+	SampleMap merged;
+	for (auto& worker_samples : samples) {
+		for (auto& [route, route_samples] : worker_samples) {
+			RouteSamples& into = merged[route];
+			into.latencies_ns.insert(into.latencies_ns.end(), route_samples.latencies_ns.begin(), route_samples.latencies_ns.end());
+			into.errors += route_samples.errors;
+			into.bytes += route_samples.bytes;
+		}
+	}
+	std::printf("%-12s %10s %8s %10s %9s %9s %9s %9s %9s %9s\n", "route", "requests", "errors", "req/s", "p50 ms", "p95 ms", "p99 ms", "p999 ms", "max ms", "avg KB");
+	std::vector<long long> all;
+	unsigned long long all_errors = 0;
+	unsigned long long all_bytes = 0;
+	for (auto& [route, route_samples] : merged) {
+		all.insert(all.end(), route_samples.latencies_ns.begin(), route_samples.latencies_ns.end());
+		all_errors += route_samples.errors;
+		all_bytes += route_samples.bytes;
+		double average_kb = route_samples.latencies_ns.empty() ? 0 : route_samples.bytes / 1024.0 / route_samples.latencies_ns.size();
+		print_row(route, route_samples.latencies_ns, route_samples.errors, seconds, average_kb);
+	}
+	print_row("all", all, all_errors, seconds, all.empty() ? 0 : all_bytes / 1024.0 / all.size());
+	// Fan out, every subscriber should see every fired incident once.
+	if (!subscribers.empty()) {
+		std::vector<long long> fanout;
+		unsigned long long messages = 0;
+		std::size_t disconnected = 0;
+		for (const auto& subscriber : subscribers) {
+			fanout.insert(fanout.end(), subscriber->latencies_ns.begin(), subscriber->latencies_ns.end());
+			messages += subscriber->messages;
+			if (subscriber->closed) disconnected++;
+		}
+		unsigned long long expected = fire_log.total() * subscribers.size();
+		unsigned long long missing = expected > fanout.size() ? expected - fanout.size() : 0;
+		std::printf("\n/mails: %zu subscribers, %zu closed early, %llu messages, %llu incidents fired\n", subscribers.size(), disconnected, messages, fire_log.total());
+		print_row("fanout", fanout, missing, seconds, 0);
+	}
+	// Requests in send order, offsets make the log replay at the same pace.
+	if (!options.record.empty()) {
+		std::vector<PlannedRequest> log;
+		for (auto& worker_sent : sent) log.insert(log.end(), worker_sent.begin(), worker_sent.end());
+		std::stable_sort(log.begin(), log.end(), [](const PlannedRequest& a, const PlannedRequest& b) { return a.offset_ms < b.offset_ms; });
+		std::ofstream output(options.record);
+		output << "# loadgen request log: offset_ms path\n";
+		for (const auto& request : log) output << request.offset_ms << ' ' << request.path << '\n';
+	}
+	return notifier_failed ? 1 : 0;
+}
+int main(int argc, char* argv[]) {
+	try {
+		if (argc > 1 && (std::string(argv[1]) == "--help" || std::string(argv[1]) == "-h")) {
+			print_usage();
+			return 0;
+		}
+		if (argc > 1 && std::string(argv[1]) == "seed") {
+			print_seed_sql(parse_options(argc, argv, 2));
+			return 0;
+		}
+		return run_load(parse_options(argc, argv, 1));
+	} catch (const std::invalid_argument& e) {
+		std::cerr << "Error: " << e.what() << std::endl;
+		print_usage();
+		return 2;
+	} catch (const std::exception& e) {
+		std::cerr << "Error: " << e.what() << std::endl;
+		return 1;
+	}
+}
@@ -0,0 +1,172 @@
+#include "Metrics.h"
+#include <atomic>
+#include <mutex>
+#include <vector>
+#include <algorithm>
+#include <cstdio>
+// Upper bounds in seconds, the last bucket is +Inf.
+static const double bucket_bounds[] = {0.0005, 0.001, 0.0025, 0.005, 0.01, 0.025, 0.05, 0.1, 0.25, 0.5, 1.0, 2.5, 5.0, 10.0};
+static constexpr std::size_t bucket_count = sizeof(bucket_bounds) / sizeof(bucket_bounds[0]) + 1;
+static constexpr std::size_t route_count = static_cast<std::size_t>(RouteMetric::Count);
+static const char* route_labels[route_count] = {"health", "characters", "suggest", "tribes", "location", "location_near", "totals", "incident", "metrics"};
+static const char* status_labels[] = {"2xx", "3xx", "4xx", "5xx"};
+// Histograms after the per route ones
+enum HistogramIndex : std::size_t {
+	DbConnect = route_count,
+	DbAcquire,
+	DbQuery,
+	Serialize,
+	BroadcastLag,
+	HistogramCount
+};
+struct Histogram {
+	std::atomic<unsigned long long> buckets[bucket_count] = {};
+	std::atomic<unsigned long long> count{0};
+	std::atomic<unsigned long long> sum_ns{0};
+};
+// Everything one thread records. Only that thread writes, so relaxed increments are enough.
+struct Shard {
+	Histogram histograms[HistogramCount];
+	std::atomic<unsigned long long> requests[route_count][4] = {};
+	std::atomic<unsigned long long> serialize_bytes{0};
+};
+// Live shards plus whatever exited threads left behind.
+struct Registry {
+	std::mutex registry_mutex;
+	std::vector<Shard*> live;
+	Shard retired;
+};
+// Never destroyed, threads may still exit during static destruction.
+static Registry& registry() {
+	static Registry* shared = new Registry();
+	return *shared;
+}
+// Add one shard into another
+static void fold(Shard& into, const Shard& from) {
+	for (std::size_t h = 0; h < HistogramCount; h++) {
+		for (std::size_t b = 0; b < bucket_count; b++) {
+			into.histograms[h].buckets[b].fetch_add(from.histograms[h].buckets[b].load(std::memory_order_relaxed), std::memory_order_relaxed);
+		}
+		into.histograms[h].count.fetch_add(from.histograms[h].count.load(std::memory_order_relaxed), std::memory_order_relaxed);
+		into.histograms[h].sum_ns.fetch_add(from.histograms[h].sum_ns.load(std::memory_order_relaxed), std::memory_order_relaxed);
+	}
+	for (std::size_t r = 0; r < route_count; r++) {
+		for (std::size_t s = 0; s < 4; s++) {
+			into.requests[r][s].fetch_add(from.requests[r][s].load(std::memory_order_relaxed), std::memory_order_relaxed);
+		}
+	}
+	into.serialize_bytes.fetch_add(from.serialize_bytes.load(std::memory_order_relaxed), std::memory_order_relaxed);
+}
+// Registers the thread's shard on first use and folds it into the retired totals on thread exit.
+class ShardHandle {
+	// Public Members
+	public:
+		ShardHandle() : shard(new Shard()) {
+			std::lock_guard<std::mutex> lock(registry().registry_mutex);
+			registry().live.push_back(shard);
+		}
+		~ShardHandle() {
+			std::lock_guard<std::mutex> lock(registry().registry_mutex);
+			fold(registry().retired, *shard);
+			registry().live.erase(std::remove(registry().live.begin(), registry().live.end(), shard), registry().live.end());
+			delete shard;
+		}
+		Shard* shard;
+};
+static Shard& local_shard() {
+	thread_local ShardHandle handle;
+	return *handle.shard;
+}
+// Single writer, so load plus store would do, but fetch_add keeps it obviously correct.
+static void observe(std::size_t index, std::chrono::steady_clock::duration elapsed) {
+	Histogram& histogram = local_shard().histograms[index];
+	long long ns = std::chrono::duration_cast<std::chrono::nanoseconds>(elapsed).count();
+	if (ns < 0) ns = 0;
+	double seconds = ns / 1e9;
+	std::size_t bucket = 0;
+	while (bucket < bucket_count - 1 && seconds > bucket_bounds[bucket]) bucket++;
+	histogram.buckets[bucket].fetch_add(1, std::memory_order_relaxed);
+	histogram.count.fetch_add(1, std::memory_order_relaxed);
+	histogram.sum_ns.fetch_add(static_cast<unsigned long long>(ns), std::memory_order_relaxed);
+}
+void observe_request(RouteMetric route, int status, std::chrono::steady_clock::duration elapsed) {
+	std::size_t index = static_cast<std::size_t>(route);
+	std::size_t status_class = status < 300 ? 0 : (status < 400 ? 1 : (status < 500 ? 2 : 3));
+	local_shard().requests[index][status_class].fetch_add(1, std::memory_order_relaxed);
+	observe(index, elapsed);
+}
+void observe_db_connect(std::chrono::steady_clock::duration elapsed) {
+	observe(DbConnect, elapsed);
+}
+void observe_db_acquire(std::chrono::steady_clock::duration elapsed) {
+	observe(DbAcquire, elapsed);
+}
+void observe_db_query(std::chrono::steady_clock::duration elapsed) {
+	observe(DbQuery, elapsed);
+}
+void observe_serialize(std::chrono::steady_clock::duration elapsed, std::size_t bytes) {
+	local_shard().serialize_bytes.fetch_add(bytes, std::memory_order_relaxed);
+	observe(Serialize, elapsed);
+}
+void observe_broadcast_lag(std::chrono::steady_clock::duration elapsed) {
+	observe(BroadcastLag, elapsed);
+}
+// Shortest text for a sample value
+static std::string number(double value) {
+	char text[32];
+	std::snprintf(text, sizeof(text), "%.9g", value);
+	return text;
+}
+static void write_header(std::string& out, const char* name, const char* type, const char* help) {
+	out.append("# HELP ").append(name).append(" ").append(help).append("\n");
+	out.append("# TYPE ").append(name).append(" ").append(type).append("\n");
+}
+void write_metric(std::string& out, const char* name, const char* type, const char* help, double value) {
+	write_header(out, name, type, help);
+	out.append(name).append(" ").append(number(value)).append("\n");
+}
+// Buckets, sum and count of one histogram, labels already formatted without braces.
+static void write_histogram(std::string& out, const char* name, const std::string& labels, const Histogram& histogram) {
+	std::string prefix = labels.empty() ? "" : labels + ",";
+	unsigned long long cumulative = 0;
+	for (std::size_t b = 0; b < bucket_count; b++) {
+		cumulative += histogram.buckets[b].load(std::memory_order_relaxed);
+		std::string bound = (b + 1 < bucket_count) ? number(bucket_bounds[b]) : "+Inf";
+		out.append(name).append("_bucket{").append(prefix).append("le=\"").append(bound).append("\"} ").append(std::to_string(cumulative)).append("\n");
+	}
+	std::string braces = labels.empty() ? "" : "{" + labels + "}";
+	out.append(name).append("_sum").append(braces).append(" ").append(number(histogram.sum_ns.load(std::memory_order_relaxed) / 1e9)).append("\n");
+	out.append(name).append("_count").append(braces).append(" ").append(std::to_string(histogram.count.load(std::memory_order_relaxed))).append("\n");
+}
+// Add up every shard and write the recorded families.
+void write_recorded_metrics(std::string& out) {
+	Shard total;
+	{
+		std::lock_guard<std::mutex> lock(registry().registry_mutex);
+		fold(total, registry().retired);
+		for (const Shard* shard : registry().live) fold(total, *shard);
+	}
+	write_header(out, "api_http_requests_total", "counter", "HTTP requests by route and status class.");
+	for (std::size_t r = 0; r < route_count; r++) {
+		for (std::size_t s = 0; s < 4; s++) {
+			out.append("api_http_requests_total{route=\"").append(route_labels[r]).append("\",code=\"").append(status_labels[s]).append("\"} ")
+				.append(std::to_string(total.requests[r][s].load(std::memory_order_relaxed))).append("\n");
+		}
+	}
+	write_header(out, "api_http_request_duration_seconds", "histogram", "Time spent in a route handler, cache lookups and compression included.");
+	for (std::size_t r = 0; r < route_count; r++) {
+		write_histogram(out, "api_http_request_duration_seconds", std::string("route=\"") + route_labels[r] + "\"", total.histograms[r]);
+	}
+	write_header(out, "api_db_connect_seconds", "histogram", "Time to open a pooled connection and prepare the catalog.");
+	write_histogram(out, "api_db_connect_seconds", "", total.histograms[DbConnect]);
+	write_header(out, "api_db_acquire_seconds", "histogram", "Time waiting for a pooled connection.");
+	write_histogram(out, "api_db_acquire_seconds", "", total.histograms[DbAcquire]);
+	write_header(out, "api_db_query_seconds", "histogram", "Time executing catalog statements.");
+	write_histogram(out, "api_db_query_seconds", "", total.histograms[DbQuery]);
+	write_header(out, "api_serialize_seconds", "histogram", "Time streaming a JSON response body.");
+	write_histogram(out, "api_serialize_seconds", "", total.histograms[Serialize]);
+	write_metric(out, "api_serialize_bytes_total", "counter", "JSON bytes produced by the serializers.",
+		static_cast<double>(total.serialize_bytes.load(std::memory_order_relaxed)));
+	write_header(out, "api_notify_broadcast_lag_seconds", "histogram", "Time from receiving an incident NOTIFY to queuing it for /mails subscribers.");
+	write_histogram(out, "api_notify_broadcast_lag_seconds", "", total.histograms[BroadcastLag]);
+}
@@ -0,0 +1,28 @@
+#pragma once
+#include <string>
+#include <chrono>
+#include <cstddef>
+// Routes with their own request counters and latency histogram.
+enum class RouteMetric {
+	Health,
+	Characters,
+	Suggest,
+	Tribes,
+	Location,
+	LocationNear,
+	Totals,
+	Incident,
+	Metrics,
+	Count
+};
+// Recording only touches the calling thread's shard with relaxed atomics, scrapes add the shards up.
+void observe_request(RouteMetric route, int status, std::chrono::steady_clock::duration elapsed);
+void observe_db_connect(std::chrono::steady_clock::duration elapsed);
+void observe_db_acquire(std::chrono::steady_clock::duration elapsed);
+void observe_db_query(std::chrono::steady_clock::duration elapsed);
+void observe_serialize(std::chrono::steady_clock::duration elapsed, std::size_t bytes);
+void observe_broadcast_lag(std::chrono::steady_clock::duration elapsed);
+// Prometheus text exposition of everything recorded so far.
+void write_recorded_metrics(std::string& out);
+// One gauge or counter sample with its HELP and TYPE lines.
+void write_metric(std::string& out, const char* name, const char* type, const char* help, double value);
@@ -0,0 +1,79 @@
+#include "NameIndex.h"
+#include <algorithm>
+#include <cctype>
+// Lower case copy for case insensitive matching.
+static std::string to_lower(std::string_view text) {
+	std::string lowered(text);
+	std::transform(lowered.begin(), lowered.end(), lowered.begin(), [](unsigned char c) { return std::tolower(c); });
+	return lowered;
+}
+// Three bytes packed into one key
+static std::uint32_t trigram(const std::string& text, std::size_t at) {
+	return (std::uint32_t(static_cast<unsigned char>(text[at])) << 16)
+		| (std::uint32_t(static_cast<unsigned char>(text[at + 1])) << 8)
+		| std::uint32_t(static_cast<unsigned char>(text[at + 2]));
+}
+// Postings are appended in position order, so every list comes out sorted.
+void NameIndex::build(const std::vector<std::pair<std::string, std::string>>& entries) {
+	keys.clear();
+	names.clear();
+	lower_names.clear();
+	postings.clear();
+	keys.reserve(entries.size());
+	names.reserve(entries.size());
+	lower_names.reserve(entries.size());
+	for (const auto& [key, name] : entries) {
+		std::uint32_t position = static_cast<std::uint32_t>(keys.size());
+		keys.push_back(key);
+		names.push_back(name);
+		lower_names.push_back(to_lower(name));
+		const std::string& lowered = lower_names.back();
+		for (std::size_t i = 0; i + 3 <= lowered.size(); i++) {
+			std::vector<std::uint32_t>& list = postings[trigram(lowered, i)];
+			if (list.empty() || list.back() != position) list.push_back(position);
+		}
+	}
+}
+// Intersect the needle's trigram lists, shortest first, then confirm each candidate really contains the needle.
+std::vector<std::size_t> NameIndex::search(std::string_view text) const {
+	std::string needle = to_lower(text);
+	std::vector<std::size_t> matches;
+	// Too short for a trigram, the lowered names are scanned instead.
+	if (needle.size() < 3) {
+		for (std::size_t i = 0; i < lower_names.size(); i++) {
+			if (lower_names[i].find(needle) != std::string::npos) matches.push_back(i);
+		}
+		return matches;
+	}
+	std::vector<const std::vector<std::uint32_t>*> lists;
+	for (std::size_t i = 0; i + 3 <= needle.size(); i++) {
+		auto it = postings.find(trigram(needle, i));
+		if (it == postings.end()) return matches;
+		lists.push_back(&it->second);
+	}
+	std::sort(lists.begin(), lists.end(), [](const auto* a, const auto* b) { return a->size() < b->size(); });
+	lists.erase(std::unique(lists.begin(), lists.end()), lists.end());
+	std::vector<std::uint32_t> candidates = *lists.front();
+	std::vector<std::uint32_t> narrowed;
+	for (std::size_t l = 1; l < lists.size() && candidates.size() > 1; l++) {
+		narrowed.clear();
+		std::set_intersection(candidates.begin(), candidates.end(), lists[l]->begin(), lists[l]->end(), std::back_inserter(narrowed));
+		candidates.swap(narrowed);
+	}
+	// Trigrams can all be present without being adjacent, so check the text itself.
+	for (std::uint32_t position : candidates) {
+		if (lower_names[position].find(needle) != std::string::npos) matches.push_back(position);
+	}
+	return matches;
+}
+bool NameIndex::starts_with(std::size_t position, std::string_view text) const {
+	const std::string& lowered = lower_names[position];
+	if (lowered.size() < text.size()) return false;
+	for (std::size_t i = 0; i < text.size(); i++) {
+		if (lowered[i] != std::tolower(static_cast<unsigned char>(text[i]))) return false;
+	}
+	return true;
+}
+bool plain_substring(std::string_view text) {
+	return text.find_first_of("%_\\") == std::string_view::npos;
+}
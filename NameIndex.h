@@ -0,0 +1,28 @@
+#pragma once
+#include <string>
+#include <string_view>
+#include <vector>
+#include <cstdint>
+#include <unordered_map>
+// Trigram index over names for case insensitive substring search, the in-memory answer to LIKE '%text%'.
+class NameIndex {
+	// Public Members
+	public:
+		// Keys with their names, positions follow the order given.
+		void build(const std::vector<std::pair<std::string, std::string>>& entries);
+		// Positions whose name contains the text ignoring ASCII case, in position order.
+		std::vector<std::size_t> search(std::string_view text) const;
+		const std::string& key(std::size_t position) const { return keys[position]; }
+		const std::string& name(std::size_t position) const { return names[position]; }
+		// Whether the name at the position starts with the text, ignoring case.
+		bool starts_with(std::size_t position, std::string_view text) const;
+		std::size_t size() const { return keys.size(); }
+	// Private Members
+	private:
+		std::vector<std::string> keys;
+		std::vector<std::string> names;
+		std::vector<std::string> lower_names;
+		std::unordered_map<std::uint32_t, std::vector<std::uint32_t>> postings; // Trigram to sorted positions
+};
+// True when the text has no LIKE wildcards, so a literal substring match finds the same rows as the SQL.
+bool plain_substring(std::string_view text);
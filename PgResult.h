@@ -0,0 +1,64 @@
+#pragma once
+#include <libpq-fe.h>
+#include <memory>
+#include <string>
+#include <string_view>
+// A libpq result shaped like the parts of pqxx::result the row serializers walk, so the SerializerRows
+// templates read rows of an asynchronous query the same way they read a pqxx::result.
+class PgField {
+	// Public Members
+	public:
+		PgField(const PGresult* res, int row, int column) : res(res), row(row), column(column) {}
+		bool is_null() const { return column < 0 || PQgetisnull(res, row, column); }
+		std::string_view view() const {
+			if (is_null()) return {};
+			return std::string_view(PQgetvalue(res, row, column), static_cast<std::size_t>(PQgetlength(res, row, column)));
+		}
+		template <typename T>
+		T as() const;
+	// Private Members
+	private:
+		const PGresult* res;
+		int row;
+		int column;
+};
+template <>
+inline std::string PgField::as<std::string>() const { return std::string(view()); }
+template <>
+inline long long PgField::as<long long>() const { return std::stoll(std::string(view())); }
+// Fields by column name, like pqxx::row.
+class PgRow {
+	// Public Members
+	public:
+		PgRow(const PGresult* res, int row) : res(res), row(row) {}
+		PgField operator[](const char* name) const { return PgField(res, row, PQfnumber(res, name)); }
+	// Private Members
+	private:
+		const PGresult* res;
+		int row;
+};
+// Shared ownership of the PGresult, cleared with the last copy.
+class PgResult {
+	// Public Members
+	public:
+		using size_type = int;
+		class const_iterator {
+			public:
+				const_iterator(const PGresult* res, int row) : res(res), row(row) {}
+				PgRow operator*() const { return PgRow(res, row); }
+				const_iterator& operator++() { row++; return *this; }
+				bool operator!=(const const_iterator& other) const { return row != other.row; }
+			private:
+				const PGresult* res;
+				int row;
+		};
+		PgResult() = default;
+		explicit PgResult(PGresult* res) : res(res, PQclear) {}
+		size_type size() const { return res ? PQntuples(res.get()) : 0; }
+		PgRow operator[](size_type row) const { return PgRow(res.get(), row); }
+		const_iterator begin() const { return const_iterator(res.get(), 0); }
+		const_iterator end() const { return const_iterator(res.get(), size()); }
+	// Private Members
+	private:
+		std::shared_ptr<PGresult> res;
+};
@@ -0,0 +1,466 @@
+#include "QueryCatalog.h"
+#include "Metrics.h"
+#include <unordered_map>
+#include <atomic>
+#include <memory>
+// Filters accepted by the filter parameter, an empty suffix means no time restriction.
+static const std::vector<std::pair<std::string, std::string>> time_filters = {
+	{"", ""},
+	{"_day", "interval '24 hours'"},
+	{"_week", "interval '7 days'"},
+	{"_month", "interval '1 month'"}
+};
+// Time restriction on a time_stamp column, empty when unfiltered. Counted in UTC whatever the session time zone,
+// like filter_cutoff for the in-memory paths.
+static std::string time_clause(const std::string& column, const std::string& interval) {
+	if (interval.empty()) return "";
+	return column + " >= extract(epoch from (now() AT TIME ZONE 'UTC') - " + interval + ")";
+}
+// Append a time restriction with the right keyword.
+static std::string and_time(const std::string& column, const std::string& interval) {
+	std::string clause = time_clause(column, interval);
+	return clause.empty() ? "" : " AND " + clause;
+}
+static std::string where_time(const std::string& column, const std::string& interval) {
+	std::string clause = time_clause(column, interval);
+	return clause.empty() ? "" : " WHERE " + clause;
+}
+// Incident columns shared by every incident query.
+static const std::string incident_columns = "SELECT i.id, "
+	"COALESCE(victim.name, '') AS victim_name, "
+	"COALESCE(encode(victim.address, 'hex'), '') AS victim_address, "
+	"COALESCE(victim_tribe.name, '') AS victim_tribe_name, "
+	"COALESCE(killer.name, '') AS killer_name, "
+	"COALESCE(encode(killer.address, 'hex'), '') AS killer_address, "
+	"COALESCE(killer_tribe.name, '') AS killer_tribe_name, "
+	"i.solar_system_id, "
+	"s.solar_system_name, "
+	"i.loss_type, "
+	"i.time_stamp ";
+// Incidents where both characters must exist.
+static const std::string incident_from = "FROM incident AS i "
+	"JOIN characters AS victim ON i.victim_id = victim.id "
+	"LEFT JOIN character_tribe_membership victim_ctm ON victim_ctm.character_id = victim.id AND victim_ctm.joined_at <= i.time_stamp AND (victim_ctm.left_at IS NULL OR victim_ctm.left_at > i.time_stamp) "
+	"LEFT JOIN tribes AS victim_tribe ON victim_ctm.tribe_id = victim_tribe.id "
+	"JOIN characters AS killer ON i.killer_id = killer.id "
+	"LEFT JOIN character_tribe_membership killer_ctm ON killer_ctm.character_id = killer.id AND killer_ctm.joined_at <= i.time_stamp AND (killer_ctm.left_at IS NULL OR killer_ctm.left_at > i.time_stamp) "
+	"LEFT JOIN tribes AS killer_tribe ON killer_ctm.tribe_id = killer_tribe.id "
+	"JOIN systems AS s ON i.solar_system_id = s.solar_system_id";
+// Incidents where either character may be missing.
+static const std::string incident_from_optional = "FROM incident AS i "
+	"JOIN systems AS s ON i.solar_system_id = s.solar_system_id "
+	"LEFT JOIN characters victim ON i.victim_id = victim.id "
+	"LEFT JOIN character_tribe_membership victim_ctm ON victim_ctm.character_id = victim.id AND victim_ctm.joined_at <= i.time_stamp AND (victim_ctm.left_at IS NULL OR victim_ctm.left_at > i.time_stamp) "
+	"LEFT JOIN tribes victim_tribe ON victim_ctm.tribe_id = victim_tribe.id "
+	"LEFT JOIN characters killer ON i.killer_id = killer.id "
+	"LEFT JOIN character_tribe_membership killer_ctm ON killer_ctm.character_id = killer.id AND killer_ctm.joined_at <= i.time_stamp AND (killer_ctm.left_at IS NULL OR killer_ctm.left_at > i.time_stamp) "
+	"LEFT JOIN tribes killer_tribe ON killer_ctm.tribe_id = killer_tribe.id";
+static const std::string incident_order = " ORDER BY i.time_stamp DESC, i.id DESC";
+// Incident ids only, names are resolved from the dimension cache.
+static const std::string incident_slim = "SELECT i.id, i.victim_id::text AS victim_id, i.killer_id::text AS killer_id, "
+	"i.solar_system_id, i.loss_type, i.time_stamp FROM incident AS i";
+// Tribe kill and loss tallies by membership at the time of the incident.
+static std::string tribe_totals(const std::string& interval) {
+	std::string where = where_time("i.time_stamp", interval);
+	return "SELECT t.name AS tribe_name, "
+		"COALESCE(kills_table.kills, 0) AS kills, "
+		"COALESCE(losses_table.losses, 0) AS losses "
+		"FROM tribes t "
+		"LEFT JOIN ("
+		"  SELECT ctm.tribe_id, COUNT(*) AS kills "
+		"  FROM incident i "
+		"  JOIN characters c ON i.killer_id = c.id "
+		"  JOIN character_tribe_membership ctm ON ctm.character_id = c.id AND ctm.joined_at <= i.time_stamp AND (ctm.left_at IS NULL OR ctm.left_at > i.time_stamp)"
+		+ where +
+		"  GROUP BY ctm.tribe_id "
+		") kills_table ON t.id = kills_table.tribe_id "
+		"LEFT JOIN ("
+		"  SELECT ctm.tribe_id, COUNT(*) AS losses "
+		"  FROM incident i "
+		"  JOIN characters c ON i.victim_id = c.id "
+		"  JOIN character_tribe_membership ctm ON ctm.character_id = c.id AND ctm.joined_at <= i.time_stamp AND (ctm.left_at IS NULL OR ctm.left_at > i.time_stamp)"
+		+ where +
+		"  GROUP BY ctm.tribe_id "
+		") losses_table ON t.id = losses_table.tribe_id ";
+}
+// Character lookup shared by the character routes.
+static const std::string character_history = "SELECT "
+	"c.name, "
+	"encode(c.address, 'hex') AS character_address, "
+	"t.name AS tribe_name, "
+	"m.joined_at, "
+	"m.left_at "
+	"FROM characters c "
+	"LEFT JOIN character_tribe_membership m ON c.id = m.character_id "
+	"LEFT JOIN tribes t ON m.tribe_id = t.id ";
+// Tribe rows with their current members, keyed by (tribe_id, member_name, member_id) for cursors.
+static const std::string tribe_members = "SELECT "
+	"t.id AS tribe_id, "
+	"t.name AS tribe_name, "
+	"t.url AS tribe_url, "
+	"c.name AS member_name, "
+	"encode(c.address, 'hex') AS member_address, "
+	"COALESCE(c.id::text, '') AS member_id, "
+	"(SELECT COUNT(*) "
+	"    FROM character_tribe_membership m2 "
+	"    WHERE m2.tribe_id = t.id AND m2.left_at IS NULL) AS member_count "
+	"FROM tribes t "
+	"LEFT JOIN character_tribe_membership m ON t.id = m.tribe_id AND m.left_at IS NULL "
+	"LEFT JOIN characters c ON m.character_id = c.id ";
+static const std::string tribe_member_order = "ORDER BY t.id, COALESCE(c.name, ''), COALESCE(c.id::text, '')";
+// Every statement the server runs, built once.
+static std::vector<std::pair<std::string, std::string>> build_catalog() {
+	std::vector<std::pair<std::string, std::string>> catalog;
+	// Health
+	catalog.emplace_back("health_characters", "SELECT COUNT(*) FROM characters");
+	catalog.emplace_back("health_incidents", "SELECT COUNT(*) FROM incident");
+	// Characters
+	catalog.emplace_back("characters_name", character_history +
+		"WHERE LOWER(c.name) LIKE LOWER($1) "
+		"ORDER BY (m.left_at IS NULL) DESC, m.joined_at DESC");
+	catalog.emplace_back("characters_address", character_history +
+		"WHERE encode(c.address, 'hex') LIKE $1 "
+		"ORDER BY (m.left_at IS NULL) DESC, m.joined_at DESC");
+	catalog.emplace_back("characters_address_exact", character_history +
+		"WHERE c.address = decode($1, 'hex') "
+		"ORDER BY (m.left_at IS NULL) DESC, m.joined_at DESC");
+	// Tribes
+	catalog.emplace_back("tribes_name", tribe_members +
+		"WHERE LOWER(t.name) LIKE LOWER($1) "
+		+ tribe_member_order + " LIMIT $2 OFFSET $3");
+	catalog.emplace_back("tribes_name_after", tribe_members +
+		"WHERE LOWER(t.name) LIKE LOWER($1) "
+		"AND t.id >= $2 "
+		"AND (t.id, COALESCE(c.name, ''), COALESCE(c.id::text, '')) > ($2, $3, $4) "
+		+ tribe_member_order + " LIMIT $5");
+	// Tribes already matched against the name index
+	catalog.emplace_back("tribes_ids", tribe_members +
+		"WHERE t.id = ANY($1) "
+		+ tribe_member_order + " LIMIT $2 OFFSET $3");
+	catalog.emplace_back("tribes_ids_after", tribe_members +
+		"WHERE t.id = ANY($1) "
+		"AND t.id >= $2 "
+		"AND (t.id, COALESCE(c.name, ''), COALESCE(c.id::text, '')) > ($2, $3, $4) "
+		+ tribe_member_order + " LIMIT $5");
+	catalog.emplace_back("tribes_all", "SELECT "
+		"t.id AS tribe_id, "
+		"t.name AS tribe_name, "
+		"t.url AS tribe_url, "
+		"(SELECT COUNT(*) "
+		"    FROM character_tribe_membership m "
+		"    WHERE m.tribe_id = t.id AND m.left_at IS NULL) AS member_count "
+		"FROM tribes t "
+		"ORDER BY t.id");
+	// Locations
+	catalog.emplace_back("systems_search", "SELECT solar_system_name, solar_system_id, x, y, z FROM systems "
+		"WHERE solar_system_name ILIKE $1 or solar_system_id::text ILIKE $1");
+	catalog.emplace_back("systems_all", "SELECT solar_system_name, solar_system_id, x, y, z FROM systems");
+	// Listener enrichment for a whole batch: characters, their memberships overlapping the batch window, and systems.
+	catalog.emplace_back("listener_batch", "SELECT 'character' AS kind, c.id::text AS key, c.name AS name, "
+		"encode(c.address, 'hex') AS address, NULL::bigint AS joined_at, NULL::bigint AS left_at "
+		"FROM characters c "
+		"WHERE c.id = ANY($1) "
+		"UNION ALL "
+		"SELECT 'membership', ctm.character_id::text, t.name, NULL, ctm.joined_at::bigint, ctm.left_at::bigint "
+		"FROM character_tribe_membership ctm "
+		"JOIN tribes t ON ctm.tribe_id = t.id "
+		"WHERE ctm.character_id = ANY($1) "
+		"AND ctm.joined_at <= $3 "
+		"AND (ctm.left_at IS NULL OR ctm.left_at > $4) "
+		"UNION ALL "
+		"SELECT 'system', s.solar_system_id::text, s.solar_system_name, NULL, NULL, NULL "
+		"FROM systems s "
+		"WHERE s.solar_system_id = ANY($2)");
+	// Dimension cache
+	catalog.emplace_back("dimension_characters", "SELECT c.id::text AS id, c.name, encode(c.address, 'hex') AS address FROM characters c");
+	catalog.emplace_back("dimension_characters_by_id", "SELECT c.id::text AS id, c.name, encode(c.address, 'hex') AS address FROM characters c "
+		"WHERE c.id = ANY($1)");
+	catalog.emplace_back("dimension_memberships", "SELECT ctm.character_id::text AS character_id, ctm.tribe_id, "
+		"ctm.joined_at::bigint AS joined_at, ctm.left_at::bigint AS left_at FROM character_tribe_membership ctm");
+	catalog.emplace_back("dimension_memberships_by_id", "SELECT ctm.character_id::text AS character_id, ctm.tribe_id, "
+		"ctm.joined_at::bigint AS joined_at, ctm.left_at::bigint AS left_at FROM character_tribe_membership ctm "
+		"WHERE ctm.character_id = ANY($1)");
+	catalog.emplace_back("dimension_tribes", "SELECT t.id AS tribe_id, t.name, t.url FROM tribes t");
+	catalog.emplace_back("dimension_tribes_by_id", "SELECT t.id AS tribe_id, t.name, t.url FROM tribes t WHERE t.id = ANY($1)");
+	catalog.emplace_back("incident_slim_mail", incident_slim + " WHERE i.id = $1");
+	// Full history tallies for the in-memory leaderboards.
+	catalog.emplace_back("leaderboard_killers", "SELECT killer.name AS name, COUNT(*) AS incident_count "
+		"FROM incident i "
+		"JOIN characters killer ON i.killer_id = killer.id "
+		"WHERE killer.name <> '' "
+		"GROUP BY killer.name");
+	catalog.emplace_back("leaderboard_victims", "SELECT victim.name AS name, COUNT(*) AS incident_count "
+		"FROM incident i "
+		"JOIN characters victim ON i.victim_id = victim.id "
+		"WHERE victim.name <> '' "
+		"GROUP BY victim.name");
+	// All-time kills, losses and first/last seen per character for the character stats.
+	catalog.emplace_back("character_stats", "SELECT c.id::text AS id, c.name, "
+		"COALESCE(k.kills, 0) AS kills, "
+		"COALESCE(v.losses, 0) AS losses, "
+		"LEAST(k.first_seen, v.first_seen) AS first_seen, "
+		"GREATEST(k.last_seen, v.last_seen) AS last_seen "
+		"FROM characters c "
+		"LEFT JOIN ("
+		"  SELECT killer_id, COUNT(*) AS kills, MIN(time_stamp)::bigint AS first_seen, MAX(time_stamp)::bigint AS last_seen "
+		"  FROM incident GROUP BY killer_id"
+		") k ON k.killer_id = c.id "
+		"LEFT JOIN ("
+		"  SELECT victim_id, COUNT(*) AS losses, MIN(time_stamp)::bigint AS first_seen, MAX(time_stamp)::bigint AS last_seen "
+		"  FROM incident GROUP BY victim_id"
+		") v ON v.victim_id = c.id "
+		"WHERE k.killer_id IS NOT NULL OR v.victim_id IS NOT NULL");
+	// Hourly counts for the windowed leaderboards, a little more than the longest window.
+	const std::string window_since = " i.time_stamp >= extract(epoch from now() - interval '32 days') ";
+	const std::string window_hour = "FLOOR(i.time_stamp / 3600)::bigint";
+	catalog.emplace_back("window_killers", "SELECT killer.name AS name, " + window_hour + " AS hour, COUNT(*) AS incident_count "
+		"FROM incident i "
+		"JOIN characters killer ON i.killer_id = killer.id "
+		"WHERE killer.name <> '' AND" + window_since +
+		"GROUP BY killer.name, hour");
+	catalog.emplace_back("window_victims", "SELECT victim.name AS name, " + window_hour + " AS hour, COUNT(*) AS incident_count "
+		"FROM incident i "
+		"JOIN characters victim ON i.victim_id = victim.id "
+		"WHERE victim.name <> '' AND" + window_since +
+		"GROUP BY victim.name, hour");
+	catalog.emplace_back("window_systems", "SELECT s.solar_system_id, s.solar_system_name, " + window_hour + " AS hour, COUNT(*) AS incident_count "
+		"FROM incident i "
+		"JOIN systems s ON i.solar_system_id = s.solar_system_id "
+		"WHERE" + window_since +
+		"GROUP BY s.solar_system_id, s.solar_system_name, hour");
+	catalog.emplace_back("window_tribes", "SELECT t.name AS tribe_name, x.hour, SUM(x.kills) AS kills, SUM(x.losses) AS losses "
+		"FROM ("
+		"  SELECT ctm.tribe_id, " + window_hour + " AS hour, 1 AS kills, 0 AS losses "
+		"  FROM incident i "
+		"  JOIN characters c ON i.killer_id = c.id "
+		"  JOIN character_tribe_membership ctm ON ctm.character_id = c.id AND ctm.joined_at <= i.time_stamp AND (ctm.left_at IS NULL OR ctm.left_at > i.time_stamp) "
+		"  WHERE" + window_since +
+		"  UNION ALL "
+		"  SELECT ctm.tribe_id, " + window_hour + " AS hour, 0 AS kills, 1 AS losses "
+		"  FROM incident i "
+		"  JOIN characters c ON i.victim_id = c.id "
+		"  JOIN character_tribe_membership ctm ON ctm.character_id = c.id AND ctm.joined_at <= i.time_stamp AND (ctm.left_at IS NULL OR ctm.left_at > i.time_stamp) "
+		"  WHERE" + window_since +
+		") x "
+		"JOIN tribes t ON t.id = x.tribe_id "
+		"GROUP BY t.name, x.hour");
+	// Newest incidents with character ids for the in-memory ring.
+	catalog.emplace_back("incident_recent", incident_columns + ", i.victim_id::text AS victim_id, i.killer_id::text AS killer_id "
+		+ incident_from + incident_order + " LIMIT $1");
+	// Single incident by id, the time filter does not apply.
+	catalog.emplace_back("incident_mail", incident_columns + incident_from_optional + " WHERE i.id = $1");
+	// Incidents after an id in id order, for the listener to catch up on what it missed while reconnecting.
+	catalog.emplace_back("incident_catch_up", incident_columns + ", i.victim_id::text AS victim_id, i.killer_id::text AS killer_id "
+		+ incident_from_optional + " WHERE i.id > $1 ORDER BY i.id LIMIT $2");
+	// Newest incidents after an id, keyset backfill for resuming /mails subscribers.
+	catalog.emplace_back("incident_replay", incident_columns + incident_from_optional + " WHERE i.id > $1 ORDER BY i.id DESC LIMIT $2");
+	// Every time filtered family
+	for (const auto& [suffix, interval] : time_filters) {
+		// Incidents
+		catalog.emplace_back("incident_all" + suffix, incident_columns + incident_from
+			+ where_time("i.time_stamp", interval) + incident_order + " LIMIT $1 OFFSET $2");
+		catalog.emplace_back("incident_name" + suffix, incident_columns + incident_from
+			+ " WHERE (victim.name ILIKE $1 OR killer.name ILIKE $1)" + and_time("i.time_stamp", interval)
+			+ incident_order + " LIMIT $2 OFFSET $3");
+		catalog.emplace_back("incident_system" + suffix, incident_columns + incident_from
+			+ " WHERE (i.solar_system_id::text ILIKE $1 OR s.solar_system_name ILIKE $1)" + and_time("i.time_stamp", interval)
+			+ incident_order + " LIMIT $2 OFFSET $3");
+		catalog.emplace_back("incident_tribe" + suffix, incident_columns + incident_from_optional
+			+ " WHERE (killer_tribe.name ILIKE $1 OR victim_tribe.name ILIKE $1)" + and_time("i.time_stamp", interval)
+			+ incident_order + " LIMIT $2 OFFSET $3");
+		// Keyset pages continue strictly after the cursor's (time_stamp, id).
+		catalog.emplace_back("incident_all_after" + suffix, incident_columns + incident_from
+			+ " WHERE (i.time_stamp, i.id) < ($1, $2)" + and_time("i.time_stamp", interval) + incident_order + " LIMIT $3");
+		catalog.emplace_back("incident_name_after" + suffix, incident_columns + incident_from
+			+ " WHERE (victim.name ILIKE $1 OR killer.name ILIKE $1) AND (i.time_stamp, i.id) < ($2, $3)" + and_time("i.time_stamp", interval)
+			+ incident_order + " LIMIT $4");
+		catalog.emplace_back("incident_system_after" + suffix, incident_columns + incident_from
+			+ " WHERE (i.solar_system_id::text ILIKE $1 OR s.solar_system_name ILIKE $1) AND (i.time_stamp, i.id) < ($2, $3)" + and_time("i.time_stamp", interval)
+			+ incident_order + " LIMIT $4");
+		catalog.emplace_back("incident_tribe_after" + suffix, incident_columns + incident_from_optional
+			+ " WHERE (killer_tribe.name ILIKE $1 OR victim_tribe.name ILIKE $1) AND (i.time_stamp, i.id) < ($2, $3)" + and_time("i.time_stamp", interval)
+			+ incident_order + " LIMIT $4");
+		// Slim incidents, characters and systems already matched against the caches.
+		catalog.emplace_back("incident_slim_all" + suffix, incident_slim
+			+ where_time("i.time_stamp", interval) + incident_order + " LIMIT $1 OFFSET $2");
+		catalog.emplace_back("incident_slim_all_after" + suffix, incident_slim
+			+ " WHERE (i.time_stamp, i.id) < ($1, $2)" + and_time("i.time_stamp", interval) + incident_order + " LIMIT $3");
+		catalog.emplace_back("incident_slim_name" + suffix, incident_slim
+			+ " WHERE (i.victim_id = ANY($1) OR i.killer_id = ANY($1))" + and_time("i.time_stamp", interval)
+			+ incident_order + " LIMIT $2 OFFSET $3");
+		catalog.emplace_back("incident_slim_name_after" + suffix, incident_slim
+			+ " WHERE (i.victim_id = ANY($1) OR i.killer_id = ANY($1)) AND (i.time_stamp, i.id) < ($2, $3)" + and_time("i.time_stamp", interval)
+			+ incident_order + " LIMIT $4");
+		catalog.emplace_back("incident_slim_system" + suffix, incident_slim
+			+ " WHERE i.solar_system_id = ANY($1)" + and_time("i.time_stamp", interval)
+			+ incident_order + " LIMIT $2 OFFSET $3");
+		catalog.emplace_back("incident_slim_system_after" + suffix, incident_slim
+			+ " WHERE i.solar_system_id = ANY($1) AND (i.time_stamp, i.id) < ($2, $3)" + and_time("i.time_stamp", interval)
+			+ incident_order + " LIMIT $4");
+		// Totals by name
+		catalog.emplace_back("totals_name" + suffix, "WITH combined AS ("
+			"  SELECT killer.id AS char_id, killer.name AS person, 1 AS kill_count, 0 AS loss_count, i.time_stamp "
+			"  FROM incident i "
+			"  JOIN characters killer ON i.killer_id = killer.id "
+			"  UNION ALL "
+			"  SELECT victim.id AS char_id, victim.name AS person, 0 AS kill_count, 1 AS loss_count, i.time_stamp "
+			"  FROM incident i "
+			"  JOIN characters victim ON i.victim_id = victim.id "
+			") "
+			"SELECT c.person, "
+			"       SUM(c.kill_count) AS total_kills, "
+			"       SUM(c.loss_count) AS total_losses, "
+			"       COALESCE(t.name, '') AS tribe_name "
+			"FROM combined c "
+			"LEFT JOIN character_tribe_membership m ON c.char_id = m.character_id AND m.left_at IS NULL "
+			"LEFT JOIN tribes t ON m.tribe_id = t.id "
+			"WHERE c.person ILIKE $1" + and_time("c.time_stamp", interval) + " "
+			"GROUP BY c.person, t.name");
+		// Totals for characters already matched against the name index, the id filter reaches the incident indexes.
+		catalog.emplace_back("totals_name_ids" + suffix, "WITH combined AS ("
+			"  SELECT killer.id AS char_id, killer.name AS person, 1 AS kill_count, 0 AS loss_count, i.time_stamp "
+			"  FROM incident i "
+			"  JOIN characters killer ON i.killer_id = killer.id "
+			"  WHERE i.killer_id = ANY($1)" + and_time("i.time_stamp", interval) +
+			"  UNION ALL "
+			"  SELECT victim.id AS char_id, victim.name AS person, 0 AS kill_count, 1 AS loss_count, i.time_stamp "
+			"  FROM incident i "
+			"  JOIN characters victim ON i.victim_id = victim.id "
+			"  WHERE i.victim_id = ANY($1)" + and_time("i.time_stamp", interval) +
+			") "
+			"SELECT c.person, "
+			"       SUM(c.kill_count) AS total_kills, "
+			"       SUM(c.loss_count) AS total_losses, "
+			"       COALESCE(t.name, '') AS tribe_name "
+			"FROM combined c "
+			"LEFT JOIN character_tribe_membership m ON c.char_id = m.character_id AND m.left_at IS NULL "
+			"LEFT JOIN tribes t ON m.tribe_id = t.id "
+			"GROUP BY c.person, t.name");
+		catalog.emplace_back("totals_names" + suffix, "WITH combined AS ("
+			"  SELECT killer.id AS char_id, killer.name AS person, 1 AS kill_count, 0 AS loss_count, i.time_stamp "
+			"  FROM incident i "
+			"  JOIN characters killer ON i.killer_id = killer.id"
+			+ where_time("i.time_stamp", interval) +
+			"  UNION ALL "
+			"  SELECT victim.id AS char_id, victim.name AS person, 0 AS kill_count, 1 AS loss_count, i.time_stamp "
+			"  FROM incident i "
+			"  JOIN characters victim ON i.victim_id = victim.id"
+			+ where_time("i.time_stamp", interval) +
+			") "
+			"SELECT agg.person, "
+			"       SUM(agg.kill_count) AS total_kills, "
+			"       SUM(agg.loss_count) AS total_losses, "
+			"       COALESCE(t.name, '') AS tribe_name "
+			"FROM combined agg "
+			"LEFT JOIN character_tribe_membership m ON agg.char_id = m.character_id AND m.left_at IS NULL "
+			"LEFT JOIN tribes t ON m.tribe_id = t.id "
+			"GROUP BY agg.person, t.name "
+			"ORDER BY total_kills DESC");
+		// Totals by system
+		catalog.emplace_back("totals_system" + suffix, "SELECT s.solar_system_id, s.solar_system_name, COUNT(*) AS incident_count "
+			"FROM incident i "
+			"JOIN systems s ON i.solar_system_id = s.solar_system_id "
+			"WHERE (s.solar_system_id::text ILIKE $1 OR s.solar_system_name ILIKE $1)" + and_time("i.time_stamp", interval) + " "
+			"GROUP BY s.solar_system_id, s.solar_system_name "
+			"ORDER BY s.solar_system_id DESC");
+		catalog.emplace_back("totals_systems" + suffix, "SELECT s.solar_system_id, s.solar_system_name, COUNT(*) AS incident_count "
+			"FROM incident i "
+			"JOIN systems s ON i.solar_system_id = s.solar_system_id"
+			+ where_time("i.time_stamp", interval) + " "
+			"GROUP BY s.solar_system_id, s.solar_system_name "
+			"ORDER BY incident_count DESC");
+		// Totals by tribe
+		catalog.emplace_back("totals_tribe" + suffix, tribe_totals(interval) + "WHERE t.name ILIKE $1 ORDER BY kills DESC");
+		catalog.emplace_back("totals_tribes" + suffix, tribe_totals(interval) + "ORDER BY kills DESC");
+		// Summary leaderboards
+		catalog.emplace_back("top_killers" + suffix, "SELECT killer.name AS name, COUNT(*) AS incident_count "
+			"FROM incident i "
+			"JOIN characters killer ON i.killer_id = killer.id "
+			"WHERE killer.name <> ''" + and_time("i.time_stamp", interval) + " "
+			"GROUP BY killer.name ORDER BY incident_count DESC LIMIT 10");
+		catalog.emplace_back("top_victims" + suffix, "SELECT victim.name AS name, COUNT(*) AS incident_count "
+			"FROM incident i "
+			"JOIN characters victim ON i.victim_id = victim.id "
+			"WHERE victim.name <> ''" + and_time("i.time_stamp", interval) + " "
+			"GROUP BY victim.name ORDER BY incident_count DESC LIMIT 10");
+		catalog.emplace_back("top_systems" + suffix, "SELECT s.solar_system_id, s.solar_system_name, COUNT(*) AS incident_count "
+			"FROM incident i "
+			"JOIN systems s ON i.solar_system_id = s.solar_system_id"
+			+ where_time("i.time_stamp", interval) + " "
+			"GROUP BY s.solar_system_id, s.solar_system_name ORDER BY incident_count DESC LIMIT 10");
+		catalog.emplace_back("top_tribes" + suffix, tribe_totals(interval) + "ORDER BY kills DESC, losses DESC LIMIT 10");
+	}
+	return catalog;
+}
+// The catalog itself
+static const std::vector<std::pair<std::string, std::string>>& catalog() {
+	static const std::vector<std::pair<std::string, std::string>> statements = build_catalog();
+	return statements;
+}
+// Counters are written lock free, the map itself never changes after it is built.
+struct StatementCounters {
+	std::atomic<unsigned long long> executions{0};
+	std::atomic<unsigned long long> errors{0};
+	std::atomic<long long> total_ns{0};
+	std::atomic<long long> max_ns{0};
+};
+static std::unordered_map<std::string, std::unique_ptr<StatementCounters>>& counters() {
+	static std::unordered_map<std::string, std::unique_ptr<StatementCounters>> table = [] {
+		std::unordered_map<std::string, std::unique_ptr<StatementCounters>> built;
+		for (const auto& entry : catalog()) {
+			built.emplace(entry.first, std::make_unique<StatementCounters>());
+		}
+		return built;
+	}();
+	return table;
+}
+const std::vector<std::pair<std::string, std::string>>& statement_catalog() {
+	return catalog();
+}
+// Prepare them all on a connection
+void prepare_statements(pqxx::connection& conn) {
+	for (const auto& [name, sql] : catalog()) {
+		conn.prepare(name, sql);
+	}
+}
+// Map the filter parameter onto the statement suffix.
+std::string statement_name(const std::string& family, const char* filter_param) {
+	if (!filter_param) return family;
+	std::string filter = filter_param;
+	if (filter == "day" || filter == "week" || filter == "month") {
+		return family + "_" + filter;
+	}
+	return family;
+}
+// Count and time one execution.
+void record_statement(const std::string& name, std::chrono::steady_clock::duration elapsed, bool failed) {
+	auto it = counters().find(name);
+	if (it == counters().end()) return;
+	StatementCounters& counter = *it->second;
+	long long ns = std::chrono::duration_cast<std::chrono::nanoseconds>(elapsed).count();
+	if (failed) {
+		counter.errors.fetch_add(1, std::memory_order_relaxed);
+		return;
+	}
+	observe_db_query(elapsed);
+	counter.executions.fetch_add(1, std::memory_order_relaxed);
+	counter.total_ns.fetch_add(ns, std::memory_order_relaxed);
+	long long seen = counter.max_ns.load(std::memory_order_relaxed);
+	while (ns > seen && !counter.max_ns.compare_exchange_weak(seen, ns, std::memory_order_relaxed)) {}
+}
+// Snapshot of every statement that has run at least once.
+std::vector<StatementStats> statement_stats() {
+	std::vector<StatementStats> stats;
+	for (const auto& entry : catalog()) {
+		const StatementCounters& counter = *counters().at(entry.first);
+		StatementStats item;
+		item.name = entry.first;
+		item.executions = counter.executions.load(std::memory_order_relaxed);
+		item.errors = counter.errors.load(std::memory_order_relaxed);
+		if (item.executions == 0 && item.errors == 0) continue;
+		item.total_ms = counter.total_ns.load(std::memory_order_relaxed) / 1e6;
+		item.max_ms = counter.max_ns.load(std::memory_order_relaxed) / 1e6;
+		stats.push_back(std::move(item));
+	}
+	return stats;
+}
@@ -0,0 +1,36 @@
+#pragma once
+#include <pqxx/pqxx>
+#include <string>
+#include <vector>
+#include <chrono>
+#include <utility>
+// Execution counters for a single catalog statement.
+struct StatementStats {
+	std::string name;
+	unsigned long long executions = 0;
+	unsigned long long errors = 0;
+	double total_ms = 0.0;
+	double max_ms = 0.0;
+};
+// Prepare every catalog statement on a freshly opened connection.
+void prepare_statements(pqxx::connection& conn);
+// Every catalog statement as name and SQL, for connections that are not opened through libpqxx.
+const std::vector<std::pair<std::string, std::string>>& statement_catalog();
+// Statement name for a query family and the optional day/week/month filter, e.g. incident_name_week.
+std::string statement_name(const std::string& family, const char* filter_param);
+// Bookkeeping for exec_statement.
+void record_statement(const std::string& name, std::chrono::steady_clock::duration elapsed, bool failed);
+std::vector<StatementStats> statement_stats();
+// Run a prepared catalog statement and record its execution time.
+template <typename... Args>
+pqxx::result exec_statement(pqxx::transaction_base& txn, const std::string& name, Args&&... args) {
+	auto start = std::chrono::steady_clock::now();
+	try {
+		pqxx::result res = txn.exec_prepared(name, std::forward<Args>(args)...);
+		record_statement(name, std::chrono::steady_clock::now() - start, false);
+		return res;
+	} catch (...) {
+		record_statement(name, std::chrono::steady_clock::now() - start, true);
+		throw;
+	}
+}
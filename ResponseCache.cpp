@@ -0,0 +1,167 @@
+#include "ResponseCache.h"
+#include "Env.h"
+#include <algorithm>
+#include <vector>
+#include <cctype>
+// Lower case copy for case insensitive matching.
+static std::string to_lower(std::string text) {
+	std::transform(text.begin(), text.end(), text.begin(), [](unsigned char c) { return std::tolower(c); });
+	return text;
+}
+// Same idea as ILIKE '%needle%', needle already lower case.
+static bool contains(const std::string& text, const std::string& needle) {
+	return to_lower(text).find(needle) != std::string::npos;
+}
+// Capacity of at least one entry
+ResponseCache::ResponseCache(std::size_t capacity, std::chrono::milliseconds ttl)
+	: capacity(capacity == 0 ? 1 : capacity), ttl(ttl) {}
+// Route plus sorted key=value pairs
+std::string ResponseCache::key(const crow::request& req) {
+	std::vector<std::string> names = req.url_params.keys();
+	std::sort(names.begin(), names.end());
+	names.erase(std::unique(names.begin(), names.end()), names.end());
+	std::string built = req.url;
+	char separator = '?';
+	for (const auto& name : names) {
+		const char* value = req.url_params.get(name);
+		built.push_back(separator);
+		built.append(name);
+		built.push_back('=');
+		if (value) built.append(value);
+		separator = '&';
+	}
+	return built;
+}
+// Fresh entry for the key, counted as a hit or a miss.
+bool ResponseCache::find(const std::string& key, CachedResponse& out) {
+	std::lock_guard<std::mutex> lock(cache_mutex);
+	auto it = entries.find(key);
+	if (it == entries.end()) {
+		counters.misses++;
+		return false;
+	}
+	// Time windows like filter=day move on even without new incidents.
+	if (std::chrono::steady_clock::now() - it->second.stored > ttl) {
+		erase(it);
+		counters.misses++;
+		return false;
+	}
+	recent.splice(recent.begin(), recent, it->second.recent);
+	out = it->second.response;
+	counters.hits++;
+	return true;
+}
+// Keep a response unless an invalidation happened while it was being computed.
+void ResponseCache::store(const crow::request& req, const std::string& key, const CachedResponse& response, unsigned long long generation) {
+	Entry entry;
+	entry.response = response;
+	entry.route = req.url;
+	entry.stored = std::chrono::steady_clock::now();
+	entry.by_mail = req.url_params.get("mail_id") != nullptr;
+	const char* cursor = req.url_params.get("cursor");
+	entry.by_cursor = cursor && *cursor;
+	for (const char* search : {"name", "system", "tribe"}) {
+		const char* value = req.url_params.get(search);
+		if (!value) continue;
+		entry.search = search;
+		entry.needle = to_lower(value);
+		break;
+	}
+	std::lock_guard<std::mutex> lock(cache_mutex);
+	if (generation != current_generation.load(std::memory_order_acquire)) return;
+	auto existing = entries.find(key);
+	if (existing != entries.end()) erase(existing);
+	recent.push_front(key);
+	entry.recent = recent.begin();
+	entries.emplace(key, std::move(entry));
+	counters.stores++;
+	// Least recently used goes first.
+	while (entries.size() > capacity) {
+		erase(entries.find(recent.back()));
+	}
+}
+// Whether a new incident could change this entry's body.
+bool ResponseCache::affected(const Entry& entry, const IncidentRecord& incident) const {
+	// Locations, characters and tribes do not change with incidents.
+	if (entry.route != "/incident" && entry.route != "/totals") return false;
+	// A single mail never changes, and keyset pages past the first only hold older incidents.
+	if (entry.by_mail || entry.by_cursor) return false;
+	// Unfiltered, or a pattern we do not try to interpret.
+	if (!entry.search || entry.needle.empty() || entry.needle.find_first_of("%_") != std::string::npos) return true;
+	std::string_view search = entry.search;
+	if (search == "name") {
+		return contains(incident.victim_name, entry.needle) || contains(incident.killer_name, entry.needle);
+	}
+	if (search == "system") {
+		return contains(incident.solar_system_name, entry.needle) || std::to_string(incident.solar_system_id).find(entry.needle) != std::string::npos;
+	}
+	return contains(incident.victim_tribe_name, entry.needle) || contains(incident.killer_tribe_name, entry.needle);
+}
+// Drop an entry and its place in the recency list. Caller holds the lock.
+void ResponseCache::erase(std::unordered_map<std::string, Entry>::iterator it) {
+	recent.erase(it->second.recent);
+	entries.erase(it);
+}
+void ResponseCache::invalidate(const IncidentRecord& incident) {
+	std::lock_guard<std::mutex> lock(cache_mutex);
+	current_generation.fetch_add(1, std::memory_order_acq_rel);
+	for (auto it = entries.begin(); it != entries.end();) {
+		auto next = std::next(it);
+		if (affected(it->second, incident)) {
+			erase(it);
+			counters.invalidated++;
+		}
+		it = next;
+	}
+}
+// Names changed somewhere, nothing cached can be trusted.
+void ResponseCache::invalidate_all() {
+	std::lock_guard<std::mutex> lock(cache_mutex);
+	current_generation.fetch_add(1, std::memory_order_acq_rel);
+	counters.invalidated += entries.size();
+	entries.clear();
+	recent.clear();
+}
+// Copy the counters out
+ResponseCacheStats ResponseCache::stats() const {
+	std::lock_guard<std::mutex> lock(cache_mutex);
+	ResponseCacheStats snapshot = counters;
+	snapshot.entries = entries.size();
+	return snapshot;
+}
+// 64 bit FNV-1a
+std::string make_etag(std::string_view body) {
+	unsigned long long hash = 14695981039346656037ULL;
+	for (unsigned char c : body) {
+		hash ^= c;
+		hash *= 1099511628211ULL;
+	}
+	static const char hex[] = "0123456789abcdef";
+	std::string etag = "\"";
+	for (int shift = 60; shift >= 0; shift -= 4) {
+		etag.push_back(hex[(hash >> shift) & 0x0F]);
+	}
+	etag.push_back('"');
+	return etag;
+}
+// Comma separated list, weak prefixes compare equal like RFC 9110 asks for If-None-Match.
+bool etag_matches(const std::string& if_none_match, const std::string& etag) {
+	std::size_t start = 0;
+	while (start < if_none_match.size()) {
+		std::size_t end = if_none_match.find(',', start);
+		if (end == std::string::npos) end = if_none_match.size();
+		std::string_view candidate(if_none_match.data() + start, end - start);
+		while (!candidate.empty() && candidate.front() == ' ') candidate.remove_prefix(1);
+		while (!candidate.empty() && candidate.back() == ' ') candidate.remove_suffix(1);
+		if (candidate.substr(0, 2) == "W/") candidate.remove_prefix(2);
+		if (candidate == "*" || candidate == etag) return true;
+		start = end + 1;
+	}
+	return false;
+}
+// Process wide cache
+ResponseCache& response_cache() {
+	static ResponseCache cache(env_size("RESPONSE_CACHE_SIZE", 1024),
+		std::chrono::milliseconds(env_size("RESPONSE_CACHE_TTL_MS", 30000)));
+	return cache;
+}
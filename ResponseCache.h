@@ -0,0 +1,67 @@
+#pragma once
+#include "crow.h"
+#include <string>
+#include <string_view>
+#include <memory>
+#include <mutex>
+#include <list>
+#include <atomic>
+#include <chrono>
+#include <unordered_map>
+#include "IncidentRing.h"
+// A serialized body with its strong validator.
+struct CachedResponse {
+	std::shared_ptr<const std::string> body;
+	std::string etag;
+};
+// Snapshot of cache counters for health and metrics.
+struct ResponseCacheStats {
+	unsigned long long entries = 0;
+	unsigned long long hits = 0;
+	unsigned long long misses = 0;
+	unsigned long long stores = 0;
+	unsigned long long invalidated = 0;
+};
+// GET responses keyed on route and normalized query parameters, dropped when an incident could change them.
+class ResponseCache {
+	// Public Members
+	public:
+		ResponseCache(std::size_t capacity, std::chrono::milliseconds ttl);
+		// Route plus sorted key=value pairs, so parameter order does not matter.
+		static std::string key(const crow::request& req);
+		bool find(const std::string& key, CachedResponse& out);
+		// Bumped by every invalidation, a response computed across one is not stored.
+		unsigned long long generation() const { return current_generation.load(std::memory_order_acquire); }
+		void store(const crow::request& req, const std::string& key, const CachedResponse& response, unsigned long long generation);
+		// Drop what a new incident could change: unfiltered pages and searches it matches.
+		void invalidate(const IncidentRecord& incident);
+		void invalidate_all();
+		ResponseCacheStats stats() const;
+	// Private Members
+	private:
+		struct Entry {
+			CachedResponse response;
+			std::string route;
+			const char* search = nullptr; // Which search parameter the entry was filtered by, if any.
+			std::string needle;
+			bool by_mail = false;
+			bool by_cursor = false;
+			std::chrono::steady_clock::time_point stored;
+			std::list<std::string>::iterator recent;
+		};
+		bool affected(const Entry& entry, const IncidentRecord& incident) const;
+		void erase(std::unordered_map<std::string, Entry>::iterator it);
+		mutable std::mutex cache_mutex;
+		std::unordered_map<std::string, Entry> entries;
+		std::list<std::string> recent; // Most recently used first
+		std::size_t capacity;
+		std::chrono::milliseconds ttl;
+		std::atomic<unsigned long long> current_generation{0};
+		ResponseCacheStats counters;
+};
+// Quoted strong ETag from a 64 bit FNV-1a hash of the body.
+std::string make_etag(std::string_view body);
+// If-None-Match holds this ETag or *
+bool etag_matches(const std::string& if_none_match, const std::string& etag);
+// Process wide cache, sized from RESPONSE_CACHE_SIZE and RESPONSE_CACHE_TTL_MS.
+ResponseCache& response_cache();
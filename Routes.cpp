@@ -1,10 +1,32 @@
 #include "Routes.h"
 #include "Serializer.h"
+#include "ConnectionPool.h"
+#include "QueryCatalog.h"
+#include "IncidentRing.h"
+#include "Leaderboard.h"
+#include "CharacterStats.h"
+#include "StarMap.h"
+#include "DimensionCache.h"
+#include "JsonWriter.h"
+#include "Cursor.h"
+#include "Broadcaster.h"
+#include "ResponseCache.h"
+#include "Compression.h"
+#include "WireFormat.h"
+#include "Metrics.h"
+#include "AsyncQuery.h"
+#include "Env.h"
 #include <pqxx/pqxx>
 #include <iostream>
 #include <nlohmann/json.hpp>
 #include <cstdlib> // For getenv
 #include <string>
+#include <chrono>
+#include <type_traits>
+#include <optional>
+#include <limits>
+#include <cstring>
+#include <cmath>
 // Pooled Connection
 std::string get_pool_connection_string() {
 	const char* dbname = std::getenv("PGBOUNCER_DB");
@@ -23,24 +45,218 @@ std::string get_pool_connection_string() {
 		" host=" + std::string(host) +
 		" port=" + std::string(port);
 }
+// Pretty printing is opt in with ?pretty=1 or ?pretty=true
+static bool wants_pretty(const crow::request& req) {
+	const char* pretty = req.url_params.get("pretty");
+	return pretty && (std::string(pretty) == "1" || std::string(pretty) == "true");
+}
+// Stream a serializer into this thread's buffer and hand it to Crow.
+template <typename Serialize>
+static crow::response json_response(const crow::request& req, Serialize&& serialize) {
+	std::string& buffer = response_buffer();
+	buffer.clear();
+	JsonWriter out(buffer, wants_pretty(req));
+	auto start = std::chrono::steady_clock::now();
+	serialize(out);
+	observe_serialize(std::chrono::steady_clock::now() - start, buffer.size());
+	crow::response resp(buffer);
+	resp.set_header("Content-Type", "application/json");
+	return resp;
+}
+// Per statement deadline for the parallel /totals summary, TOTALS_QUERY_TIMEOUT_MS.
+static long long totals_query_timeout_ms() {
+	static const long long timeout = static_cast<long long>(env_size("TOTALS_QUERY_TIMEOUT_MS", 5000));
+	return timeout;
+}
+// Bodies smaller than this go out as they are, compressing them saves nothing worth the header.
+static const std::size_t compress_threshold = 1024;
+// JSON, MessagePack or CBOR as the Accept header asks, a body that will not convert goes out as JSON.
+static WireFormat response_format(const crow::request& req, const CachedResponse& entry, std::shared_ptr<const std::string>& body) {
+	body = entry.body;
+	WireFormat format = negotiate_format(req.get_header_value("Accept"));
+	if (format == WireFormat::Json) return format;
+	try {
+		body = compression_memo().transcode(entry.etag, *entry.body, format);
+		return format;
+	} catch (const std::exception& e) {
+		std::cerr << "Error: Response not re-encoded: " << e.what() << std::endl;
+		return WireFormat::Json;
+	}
+}
+// Answer from a cache entry, 304 for a matching If-None-Match.
+static crow::response serve_cached(const crow::request& req, const CachedResponse& entry) {
+	const std::string& if_none_match = req.get_header_value("If-None-Match");
+	std::shared_ptr<const std::string> body;
+	WireFormat format = response_format(req, entry, body);
+	// Each format and encoding is its own representation with its own validator.
+	std::string etag = entry.etag;
+	if (format != WireFormat::Json) {
+		etag.insert(etag.size() - 1, std::string("-") + format_name(format));
+	}
+	std::string representation = etag;
+	ContentEncoding encoding = ContentEncoding::Identity;
+	if (body->size() >= compress_threshold) {
+		encoding = negotiate_encoding(req.get_header_value("Accept-Encoding"));
+	}
+	if (encoding != ContentEncoding::Identity) {
+		etag.insert(etag.size() - 1, std::string("-") + encoding_name(encoding));
+	}
+	if (!if_none_match.empty() && etag_matches(if_none_match, etag)) {
+		crow::response resp(304);
+		resp.set_header("ETag", etag);
+		resp.set_header("Vary", "Accept, Accept-Encoding");
+		return resp;
+	}
+	crow::response resp(encoding == ContentEncoding::Identity
+		? *body
+		: *compression_memo().encode(representation, *body, encoding));
+	resp.set_header("Content-Type", format_content_type(format));
+	resp.set_header("ETag", etag);
+	resp.set_header("Vary", "Accept, Accept-Encoding");
+	if (encoding != ContentEncoding::Identity) resp.set_header("Content-Encoding", encoding_name(encoding));
+	return resp;
+}
+// Keep a fresh 200 and serve it from the entry, errors and partial answers go out once and are never kept.
+static crow::response store_and_serve(const crow::request& req, const std::string& key, unsigned long long generation, crow::response resp) {
+	if (resp.code != 200) return resp;
+	// Partial answers still honour Accept, but skip the cache and the memo.
+	if (resp.get_header_value("Cache-Control") == "no-store") {
+		WireFormat format = negotiate_format(req.get_header_value("Accept"));
+		if (format == WireFormat::Json) return resp;
+		try {
+			resp.body = transcode_json(resp.body, format);
+			resp.set_header("Content-Type", format_content_type(format));
+		} catch (const std::exception& e) {
+			std::cerr << "Error: Response not re-encoded: " << e.what() << std::endl;
+		}
+		resp.set_header("Vary", "Accept");
+		return resp;
+	}
+	CachedResponse entry;
+	entry.body = std::make_shared<const std::string>(std::move(resp.body));
+	entry.etag = make_etag(*entry.body);
+	response_cache().store(req, key, entry, generation);
+	return serve_cached(req, entry);
+}
+// Serve GET routes from the response cache, answer matching If-None-Match with 304 and keep fresh 200s.
+template <typename Handler>
+static auto cached(Handler handler) {
+	return [handler](const crow::request& req) -> crow::response {
+		std::string key = ResponseCache::key(req);
+		CachedResponse entry;
+		if (response_cache().find(key, entry)) return serve_cached(req, entry);
+		unsigned long long generation = response_cache().generation();
+		return store_and_serve(req, key, generation, handler(req));
+	};
+}
+// Completion of an asynchronous handler, called once on the request's io_context thread.
+using Respond = std::function<void(crow::response)>;
+// Same cache for handlers that answer later through a Respond.
+template <typename Handler>
+static auto cached_async(Handler handler) {
+	return [handler](const crow::request& req, Respond respond) {
+		std::string key = ResponseCache::key(req);
+		CachedResponse entry;
+		if (response_cache().find(key, entry)) {
+			respond(serve_cached(req, entry));
+			return;
+		}
+		unsigned long long generation = response_cache().generation();
+		handler(req, [&req, key, generation, respond](crow::response resp) {
+			respond(store_and_serve(req, key, generation, std::move(resp)));
+		});
+	};
+}
+// Count and time an asynchronous route, Crow sends the response when it is ended.
+template <typename Handler>
+static auto metered_async(RouteMetric route, Handler handler) {
+	return [route, handler](const crow::request& req, crow::response& res) {
+		auto start = std::chrono::steady_clock::now();
+		handler(req, [route, start, &res](crow::response out) {
+			observe_request(route, out.code, std::chrono::steady_clock::now() - start);
+			res = std::move(out);
+			res.end();
+		});
+	};
+}
+// Count and time a route, handlers with or without the request both work.
+template <typename Handler>
+static auto metered(RouteMetric route, Handler handler) {
+	return [route, handler](const crow::request& req) -> crow::response {
+		auto start = std::chrono::steady_clock::now();
+		crow::response resp;
+		if constexpr (std::is_invocable_v<Handler, const crow::request&>) {
+			resp = handler(req);
+		} else {
+			resp = handler();
+		}
+		observe_request(route, resp.code, std::chrono::steady_clock::now() - start);
+		return resp;
+	};
+}
 // Health route and all HTTP API routes here
 void setupRoutes(crow::SimpleApp& app) {
 	// Get server health, character count, and kill count
-	CROW_ROUTE(app, "/health").methods("GET"_method)([]() {
+	CROW_ROUTE(app, "/health").methods("GET"_method)(metered(RouteMetric::Health, []() {
 		crow::json::wvalue response;
 		response["health"] = "I'm alive!";
 		// Try to get everything else for health
 		try {
-			pqxx::connection conn{get_pool_connection_string()};
-			pqxx::work txn(conn);
+			auto conn = get_connection_pool().acquire();
+			pqxx::work txn(*conn);
 			// Character count
-			pqxx::result char_res = txn.exec("SELECT COUNT(*) FROM characters");
+			pqxx::result char_res = exec_statement(txn, "health_characters");
 			int character_count = char_res[0][0].as<int>();
 			response["player_count"] = character_count;
 			// Incident count
-			pqxx::result kill_res = txn.exec("SELECT COUNT(*) FROM incident");
+			pqxx::result kill_res = exec_statement(txn, "health_incidents");
 			int kill_count = kill_res[0][0].as<int>();
 			response["incident_count"] = kill_count;
+			// Connection pool usage
+			PoolStats pool = get_connection_pool().stats();
+			response["pool"]["capacity"] = pool.capacity;
+			response["pool"]["open"] = pool.open;
+			response["pool"]["idle"] = pool.idle;
+			response["pool"]["leases"] = pool.leases;
+			response["pool"]["waits"] = pool.waits;
+			response["pool"]["timeouts"] = pool.timeouts;
+			response["pool"]["wait_avg_ms"] = pool.leases ? pool.wait_total_ms / pool.leases : 0.0;
+			response["pool"]["wait_max_ms"] = pool.wait_max_ms;
+			// WebSocket fan out
+			BroadcastStats broadcast = mail_broadcaster().stats();
+			response["websocket"]["subscribers"] = broadcast.subscribers;
+			response["websocket"]["published"] = broadcast.published;
+			response["websocket"]["delivered"] = broadcast.delivered;
+			response["websocket"]["dropped"] = broadcast.dropped;
+			response["websocket"]["filtered"] = broadcast.filtered;
+			response["websocket"]["disconnected"] = broadcast.disconnected;
+			response["websocket"]["queue_depth"] = broadcast.queue_depth;
+			response["websocket"]["queue_depth_max"] = broadcast.queue_depth_max;
+			response["websocket"]["replayed"] = broadcast.replayed;
+			response["websocket"]["backfills"] = broadcast.backfills;
+			response["websocket"]["log_size"] = broadcast.log_size;
+			// Response cache
+			ResponseCacheStats cache = response_cache().stats();
+			response["response_cache"]["entries"] = cache.entries;
+			response["response_cache"]["hits"] = cache.hits;
+			response["response_cache"]["misses"] = cache.misses;
+			response["response_cache"]["stores"] = cache.stores;
+			response["response_cache"]["invalidated"] = cache.invalidated;
+			// Compression
+			CompressionStats compression = compression_memo().stats();
+			response["compression"]["compressed"] = compression.compressed;
+			response["compression"]["reused"] = compression.reused;
+			response["compression"]["transcoded"] = compression.transcoded;
+			response["compression"]["bytes_in"] = compression.bytes_in;
+			response["compression"]["bytes_out"] = compression.bytes_out;
+			response["compression"]["memo_bytes"] = compression.memo_bytes;
+			// Prepared statement usage
+			for (const auto& statement : statement_stats()) {
+				response["statements"][statement.name]["executions"] = statement.executions;
+				response["statements"][statement.name]["errors"] = statement.errors;
+				response["statements"][statement.name]["avg_ms"] = statement.executions ? statement.total_ms / statement.executions : 0.0;
+				response["statements"][statement.name]["max_ms"] = statement.max_ms;
+			}
 			// Commit
 			txn.commit();
 		} catch (const std::exception &e) {
@@ -53,9 +269,45 @@ void setupRoutes(crow::SimpleApp& app) {
 		}
 		// Return response
 		return crow::response(200, response);
-	});
+	}));
+	// Prometheus scrape, recorded histograms plus gauges read from the shared structures
+	CROW_ROUTE(app, "/metrics").methods("GET"_method)(metered(RouteMetric::Metrics, []() {
+		std::string body;
+		body.reserve(32 * 1024);
+		write_recorded_metrics(body);
+		// Connection pool
+		PoolStats pool = get_connection_pool().stats();
+		write_metric(body, "api_pool_open_connections", "gauge", "Connections currently open to PgBouncer.", static_cast<double>(pool.open));
+		write_metric(body, "api_pool_idle_connections", "gauge", "Open connections waiting in the pool.", static_cast<double>(pool.idle));
+		write_metric(body, "api_pool_timeouts_total", "counter", "Acquires that gave up waiting for a connection.", static_cast<double>(pool.timeouts));
+		// WebSocket fan out
+		BroadcastStats broadcast = mail_broadcaster().stats();
+		write_metric(body, "api_websocket_subscribers", "gauge", "Connected /mails subscribers.", static_cast<double>(broadcast.subscribers));
+		write_metric(body, "api_websocket_queue_depth", "gauge", "Incidents queued across all subscribers.", static_cast<double>(broadcast.queue_depth));
+		write_metric(body, "api_websocket_published_total", "counter", "Incidents handed to the broadcaster.", static_cast<double>(broadcast.published));
+		write_metric(body, "api_websocket_dropped_total", "counter", "Incidents dropped from full subscriber queues.", static_cast<double>(broadcast.dropped));
+		write_metric(body, "api_websocket_filtered_total", "counter", "Incident deliveries skipped by subscription filters.", static_cast<double>(broadcast.filtered));
+		write_metric(body, "api_websocket_replayed_total", "counter", "Incidents replayed to resuming subscribers.", static_cast<double>(broadcast.replayed));
+		write_metric(body, "api_websocket_backfills_total", "counter", "Replay log backfills read from the database.", static_cast<double>(broadcast.backfills));
+		write_metric(body, "api_websocket_replay_log_size", "gauge", "Incidents held for replay.", static_cast<double>(broadcast.log_size));
+		write_metric(body, "api_websocket_disconnected_total", "counter", "Subscribers closed when their queue filled.", static_cast<double>(broadcast.disconnected));
+		// Response cache and compression
+		ResponseCacheStats cache = response_cache().stats();
+		write_metric(body, "api_response_cache_entries", "gauge", "Responses held in the cache.", static_cast<double>(cache.entries));
+		write_metric(body, "api_response_cache_hits_total", "counter", "Requests answered from the cache.", static_cast<double>(cache.hits));
+		write_metric(body, "api_response_cache_misses_total", "counter", "Requests that had to run the handler.", static_cast<double>(cache.misses));
+		CompressionStats compression = compression_memo().stats();
+		write_metric(body, "api_compression_bytes_in_total", "counter", "Bytes given to zlib.", static_cast<double>(compression.bytes_in));
+		write_metric(body, "api_compression_bytes_out_total", "counter", "Bytes zlib gave back.", static_cast<double>(compression.bytes_out));
+		write_metric(body, "api_transcoded_total", "counter", "Cached JSON bodies re-encoded as MessagePack or CBOR.", static_cast<double>(compression.transcoded));
+		// Incident ring
+		write_metric(body, "api_incident_ring_size", "gauge", "Incidents held in memory for /incident.", static_cast<double>(recent_incidents().size()));
+		crow::response resp(body);
+		resp.set_header("Content-Type", "text/plain; version=0.0.4");
+		return resp;
+	}));
 	// get characters
-	CROW_ROUTE(app, "/characters").methods("GET"_method)([](const crow::request &req) -> crow::response {
+	CROW_ROUTE(app, "/characters").methods("GET"_method)(metered(RouteMetric::Characters, cached([](const crow::request &req) -> crow::response {
 		// Check methods applied.
 		if (req.method != crow::HTTPMethod::Get) {
 			// Wrong method sent.
@@ -63,29 +315,48 @@ void setupRoutes(crow::SimpleApp& app) {
 		}
 		// Try user input.
 		try {
-			pqxx::connection conn{get_pool_connection_string()};
-			pqxx::work txn(conn);
-			pqxx::result res;
 			// Check for parameters by initializin a pointer for the url sent.
 			const char* name_parameter = req.url_params.get("name");
 			const char* address_parameter = req.url_params.get("address");
+			// Plain name searches are answered from the name index, wildcards still go to LIKE.
+			if (name_parameter && dimensions().loaded() && plain_substring(name_parameter)) {
+				std::shared_ptr<const DimensionSnapshot> snapshot = dimensions().snapshot();
+				const DimensionSnapshot& dims = *snapshot;
+				std::vector<std::string> ids = dims.search_characters(name_parameter);
+				if (ids.empty()) {
+					crow::json::wvalue error_response;
+					error_response["error"] = "Bad Request! No character records found";
+					return crow::response(400, error_response);
+				}
+				return json_response(req, [&](JsonWriter& out) { format_characters(out, dims, ids); });
+			}
+			// Exact and prefix address lookups are binary searches in the address index.
+			if (!name_parameter && address_parameter && dimensions().loaded()) {
+				const char* match_parameter = req.url_params.get("match");
+				std::string address;
+				if (normalize_address(address_parameter, address) && !address.empty()
+						&& (!match_parameter || std::string(match_parameter) == "prefix"
+							|| (std::string(match_parameter) == "exact" && address.size() == 2 * AddressIndex::width))) {
+					std::shared_ptr<const DimensionSnapshot> snapshot = dimensions().snapshot();
+					const DimensionSnapshot& dims = *snapshot;
+					std::vector<std::string> ids = dims.character_addresses->starting_with(address);
+					if (ids.empty()) {
+						crow::json::wvalue error_response;
+						error_response["error"] = "Bad Request! No character records found";
+						return crow::response(400, error_response);
+					}
+					return json_response(req, [&](JsonWriter& out) { format_characters(out, dims, ids); });
+				}
+			}
+			auto conn = get_connection_pool().acquire();
+			pqxx::work txn(*conn);
+			pqxx::result res;
 			// Check the parameters every time we are called up.
 			if (name_parameter) {
 				// Parse our search value name_parameter
 				std::string searchPattern = "%" + std::string(name_parameter) + "%";
-				// The query
-				std::string query = "SELECT "
-					"    c.name, "
-					"    encode(c.address, 'hex') AS character_address, "
-					"    t.name AS tribe_name, "
-					"    m.joined_at, "
-					"    m.left_at "
-					"FROM characters c "
-					"LEFT JOIN character_tribe_membership m ON c.id = m.character_id "
-					"LEFT JOIN tribes t ON m.tribe_id = t.id "
-					"WHERE LOWER(c.name) LIKE LOWER($1) "
-					"ORDER BY (m.left_at IS NULL) DESC, m.joined_at DESC";
-				res = txn.exec_params(query, searchPattern);
+				// Prepared call
+				res = exec_statement(txn, "characters_name", searchPattern);
 				// Check if query returned any rows.
 				if (res.size() == 0) {
 					crow::json::wvalue error_response;
@@ -93,21 +364,24 @@ void setupRoutes(crow::SimpleApp& app) {
 					return crow::response(400, error_response);
 				}
 			} else if (address_parameter) {
-				// Parse our search value address_parameter
-				std::string searchPattern = "%" + std::string(address_parameter) + "%";
-				// The query
-				std::string query = "SELECT "
-					"c.name, "
-					"encode(c.address, 'hex') AS character_address, "
-					"t.name AS tribe_name, "
-					"m.joined_at, "
-					"m.left_at "
-					"FROM characters c "
-					"LEFT JOIN character_tribe_membership m ON c.id = m.character_id "
-					"LEFT JOIN tribes t ON m.tribe_id = t.id "
-					"WHERE encode(c.address, 'hex') LIKE $1 "
-					"ORDER BY (m.left_at IS NULL) DESC, m.joined_at DESC";
-				res = txn.exec_params(query, searchPattern);
+				// Prefix by default, a full address is also an exact match, contains is the slow hex scan.
+				const char* match_parameter = req.url_params.get("match");
+				std::string match = match_parameter ? match_parameter : "prefix";
+				std::string address;
+				if (!normalize_address(address_parameter, address) || address.empty()
+						|| (match != "prefix" && match != "exact" && match != "contains")
+						|| (match == "exact" && address.size() != 2 * AddressIndex::width)) {
+					crow::json::wvalue error_response;
+					error_response["error"] = "Bad Request! Invalid address or match";
+					return crow::response(400, error_response);
+				}
+				if (match == "exact") {
+					res = exec_statement(txn, "characters_address_exact", address);
+				} else if (match == "prefix") {
+					res = exec_statement(txn, "characters_address", address + "%");
+				} else {
+					res = exec_statement(txn, "characters_address", "%" + address + "%");
+				}
 				// Check if query returned any rows.
 				if (res.size() == 0) {
 					crow::json::wvalue error_response;
@@ -122,14 +396,8 @@ void setupRoutes(crow::SimpleApp& app) {
 			}
 			// Transact
 			txn.commit();
-			// Build the JSON using nlohmann
-			auto character_string = format_characters(res);
-			// Convert JSON object to string
-			std::string json_string = character_string.dump(4); // Pretty printing with indent of 4 spaces
-			// Create a Crow response with the correct Content-Type header
-			crow::response resp(json_string);
-			resp.set_header("Content-Type", "application/json");
-			return resp;
+			// Stream the JSON straight into the response
+			return json_response(req, [&](JsonWriter& out) { format_characters(out, res); });
 		} catch (const std::exception &e) {
 			// Log the error and return an error message.
 			std::cerr << "Erorr: " << e.what() << std::endl;
@@ -138,9 +406,52 @@ void setupRoutes(crow::SimpleApp& app) {
 			error_response["error"] = "Interal Server Error!";
 			return crow::response(500, error_response);
 		}
-	});
+	})));
+	// Character name autocomplete, most active first.
+	CROW_ROUTE(app, "/characters/suggest").methods("GET"_method)(metered(RouteMetric::Suggest, cached([](const crow::request &req) -> crow::response {
+		// Check methods applied.
+		if (req.method != crow::HTTPMethod::Get) {
+			// Wrong method sent.
+			return crow::response(405);
+		}
+		try {
+			const char* query_parameter = req.url_params.get("q");
+			long long limit = req.url_params.get("limit") ? std::stoll(req.url_params.get("limit")) : 10;
+			if (!query_parameter || !*query_parameter || limit <= 0) {
+				crow::json::wvalue error_response;
+				error_response["error"] = "Missing parameter!";
+				return crow::response(400, error_response);
+			}
+			// Shorter text has no trigram to narrow on and would rank nearly every name.
+			if (std::strlen(query_parameter) < 3) {
+				crow::json::wvalue error_response;
+				error_response["error"] = "Bad Request! q needs at least 3 characters!";
+				return crow::response(400, error_response);
+			}
+			// Suggestions only run against the name index.
+			if (!dimensions().loaded()) {
+				crow::json::wvalue error_response;
+				error_response["error"] = "Character cache is not loaded yet!";
+				return crow::response(503, error_response);
+			}
+			// Suggestions point into the snapshot, so it is held until they are written.
+			std::shared_ptr<const DimensionSnapshot> snapshot = dimensions().snapshot();
+			std::vector<CharacterSuggestion> suggestions = snapshot->suggest_characters(query_parameter, static_cast<std::size_t>(std::min(limit, 50LL)));
+			return json_response(req, [&](JsonWriter& out) { format_suggestions(out, suggestions); });
+		} catch (const std::invalid_argument& e) {
+			crow::json::wvalue error_response;
+			error_response["error"] = "Bad Request! Invalid limit!";
+			return crow::response(400, error_response);
+		} catch (const std::exception& e) {
+			// Log the error and return an error message.
+			std::cerr << "Error: " << e.what() << std::endl;
+			crow::json::wvalue error_response;
+			error_response["error"] = "Internal Server Error!";
+			return crow::response(500, error_response);
+		}
+	})));
 	// get tribes
-	CROW_ROUTE(app, "/tribes").methods("GET"_method)([](const crow::request &req) -> crow::response {
+	CROW_ROUTE(app, "/tribes").methods("GET"_method)(metered(RouteMetric::Tribes, cached([](const crow::request &req) -> crow::response {
 		// Check methods applied.
 		if(req.method != crow::HTTPMethod::Get) {
 			// Wrong method sent.
@@ -149,34 +460,50 @@ void setupRoutes(crow::SimpleApp& app) {
 		// Try user input.
 		try {
 			// Set up connections
-			pqxx::connection conn{get_pool_connection_string()};
-			pqxx::work txn(conn);
+			auto conn = get_connection_pool().acquire();
+			pqxx::work txn(*conn);
 			pqxx::result res;
 			// Check for parameters by initializing a pointer for the url sent.
 			const char* name_parameter = req.url_params.get("name");
+			const char* cursor_parameter = req.url_params.get("cursor");
 			int limit = req.url_params.get("limit") ? std::stoi(req.url_params.get("limit")) : 100;
 			int offset = req.url_params.get("offset") ? std::stoi(req.url_params.get("offset")) : 0;
+			// Plain names are matched against the name index, the query then looks tribes up by id.
+			bool indexed = name_parameter && dimensions().loaded() && plain_substring(name_parameter);
+			std::vector<long long> tribe_ids;
+			if (indexed) tribe_ids = dimensions().snapshot()->search_tribes(name_parameter);
 			// Check the parameters every time we are called up.
-			if (name_parameter) {
+			if (name_parameter && cursor_parameter) {
+				// Keyset pages of members, an empty cursor starts at the first tribe.
+				std::string searchPattern = "%" + std::string(name_parameter) + "%";
+				if (*cursor_parameter) {
+					TribeCursor cursor;
+					if (!decode_cursor(cursor_parameter, cursor)) {
+						crow::json::wvalue error_response;
+						error_response["error"] = "Bad Request! Invalid cursor";
+						return crow::response(400, error_response);
+					}
+					if (indexed) {
+						res = exec_statement(txn, "tribes_ids_after", tribe_ids, cursor.tribe_id, cursor.member_name, cursor.member_id, limit);
+					} else {
+						res = exec_statement(txn, "tribes_name_after", searchPattern, cursor.tribe_id, cursor.member_name, cursor.member_id, limit);
+					}
+				} else if (indexed) {
+					res = exec_statement(txn, "tribes_ids", tribe_ids, limit, 0);
+				} else {
+					res = exec_statement(txn, "tribes_name", searchPattern, limit, 0);
+				}
+				txn.commit();
+				return json_response(req, [&](JsonWriter& out) { format_tribe_page(out, res, limit); });
+			} else if (name_parameter) {
 				// Parse our search value name_parameter
 				std::string searchPattern = "%" + std::string(name_parameter) + "%";
-				// Prepare SQL Call.
-				std::string query = "SELECT "
-					"    t.id AS tribe_id, "
-					"    t.name AS tribe_name, "
-					"    t.url AS tribe_url, "
-					"    c.name AS member_name, "
-					"    encode(c.address, 'hex') AS member_address, "
-					"    (SELECT COUNT(*) "
-					"    	 FROM character_tribe_membership m2 "
-					"        WHERE m2.tribe_id = t.id AND m2.left_at IS NULL) AS member_count "
-					"FROM tribes t "
-					"LEFT JOIN character_tribe_membership m ON t.id = m.tribe_id AND m.left_at IS NULL "
-					"LEFT JOIN characters c ON m.character_id = c.id "
-					"WHERE LOWER(t.name) LIKE LOWER($1) "
-					"ORDER BY t.id, c.name "
-					"LIMIT $2 OFFSET $3";
-				res = txn.exec_params(query, searchPattern, limit, offset);
+				// Prepared call
+				if (indexed) {
+					res = exec_statement(txn, "tribes_ids", tribe_ids, limit, offset);
+				} else {
+					res = exec_statement(txn, "tribes_name", searchPattern, limit, offset);
+				}
 				// Check if query returned any rows.
 				if (res.size() == 0) {
 					crow::json::wvalue error_response;
@@ -185,26 +512,11 @@ void setupRoutes(crow::SimpleApp& app) {
 				}
 				// Transact
 				txn.commit();
-				// Build the JSON using nlohmann
-				auto tribe_string = format_tribe_membership(res);
-				// Convert JSON object to string
-				std::string json_string = tribe_string.dump(4); // Pretty printing with indent of 4 spaces.
-				// Create a crow response with the correct Content-Type header.
-				crow::response resp(json_string);
-				resp.set_header("Content-Type", "application/json");
-				return resp;
+				// Stream the JSON straight into the response
+				return json_response(req, [&](JsonWriter& out) { format_tribe_membership(out, res); });
 			} else {
-				// Qeury
-				std::string query = "SELECT "
-					"    t.id AS tribe_id, "
-					"    t.name AS tribe_name, "
-					"    t.url AS tribe_url, "
-					"    (SELECT COUNT(*) "
-					"        FROM character_tribe_membership m "
-					"        WHERE m.tribe_id = t.id AND m.left_at IS NULL) AS member_count "
-					"FROM tribes t "
-					"ORDER BY t.id";
-				res = txn.exec(query);
+				// Prepared call
+				res = exec_statement(txn, "tribes_all");
 				// Check if query returned any rows.
 				if (res.size() == 0) {
 					crow::json::wvalue error_response;
@@ -213,14 +525,8 @@ void setupRoutes(crow::SimpleApp& app) {
 				}
 				// Transact
 				txn.commit();
-				// Build the JSON using nlohmann
-				auto tribe_string = format_tribes(res);
-				// Convert JSON object to string
-				std::string json_string = tribe_string.dump(4); // Pretty printing with indent of 4 spaces
-				// Create a Crow response with the correct Content-Type header
-				crow::response resp(json_string);
-				resp.set_header("Content-Type", "application/json");
-				return resp;
+				// Stream the JSON straight into the response
+				return json_response(req, [&](JsonWriter& out) { format_tribes(out, res); });
 			}
 		} catch (const std::exception &e) {
 			// Log the error and return an error message.
@@ -230,28 +536,35 @@ void setupRoutes(crow::SimpleApp& app) {
 			error_response["error"] = "Interal Server Error!";
 			return crow::response(500, error_response);
 		}
-	});
+	})));
 	// get locations
-	CROW_ROUTE(app, "/location").methods("GET"_method)([](const crow::request &req) -> crow::response {
+	CROW_ROUTE(app, "/location").methods("GET"_method)(metered(RouteMetric::Location, cached([](const crow::request &req) -> crow::response {
 		// Get Method
 		if(req.method == crow::HTTPMethod::Get) {
 			try {
-				// Set up connections
-				pqxx::connection conn{get_pool_connection_string()};
-				pqxx::work txn(conn);
-				pqxx::result res;
 				// Check for the parameters by initializing a pointer for the url sent.
 				const char* system_parameter = req.url_params.get("system");
+				// Systems are static, answer from the star map once it is loaded.
+				if (star_map().loaded()) {
+					std::vector<std::size_t> positions = system_parameter ? star_map().search(system_parameter) : star_map().all();
+					// Check if anything matched.
+					if (system_parameter && positions.empty()) {
+						crow::json::wvalue error_response;
+						error_response["error"] = "Bad Request! No system records found";
+						return crow::response(400, error_response);
+					}
+					return json_response(req, [&](JsonWriter& out) { build_system_json(out, star_map(), positions); });
+				}
+				// Set up connections
+				auto conn = get_connection_pool().acquire();
+				pqxx::work txn(*conn);
+				pqxx::result res;
 				// Check the parameters every time we are called up.
 				if(system_parameter) {
 					// Parse our search value system_parameter
 					std::string searchPattern = "%" + std::string(system_parameter) + "%";
-					// Prepare SQL call.
-					res = txn.exec_params(
-						"SELECT solar_system_name, solar_system_id, x, y, z FROM systems"
-						" WHERE solar_system_name ILIKE $1 or solar_system_id::text ILIKE $1;",
-						searchPattern
-					);
+					// Prepared call
+					res = exec_statement(txn, "systems_search", searchPattern);
 					// Check if query returned any rows.
 					if (res.size() == 0) {
 						crow::json::wvalue error_response;
@@ -259,18 +572,12 @@ void setupRoutes(crow::SimpleApp& app) {
 						return crow::response(400, error_response);
 					}
 				} else {
-					res = txn.exec_params("SELECT solar_system_name, solar_system_id, x, y, z FROM systems");
+					res = exec_statement(txn, "systems_all");
 				}
 				// Transact
 				txn.commit();
-				// Build the JSON using nlohmann
-				auto system_string = build_system_json(res);
-				// Convert JSON object to string
-				std::string json_string = system_string.dump(4); // Pretty printing with indent of 4 spaces
-				// Create a Crow response with the correct Content-Type header
-				crow::response resp(json_string);
-				resp.set_header("Content-Type", "application/json");
-				return resp;
+				// Stream the JSON straight into the response
+				return json_response(req, [&](JsonWriter& out) { build_system_json(out, res); });
 			// Error catching
 			} catch (const std::exception& e){
 				// Log the error and return an error message.
@@ -284,426 +591,342 @@ void setupRoutes(crow::SimpleApp& app) {
 			// Send error for method issues.
 			return crow::response(405);
 		}
-	});
-	// Get totals
-	CROW_ROUTE(app, "/totals").methods("GET"_method)([](const crow::request &req) -> crow::response {
-		// Get Method
+	})));
+	// Get systems around a system, within a radius or the closest ones.
+	CROW_ROUTE(app, "/location/near").methods("GET"_method)(metered(RouteMetric::LocationNear, cached([](const crow::request &req) -> crow::response {
+		// Check methods applied.
 		if(req.method != crow::HTTPMethod::Get) {
 			// Wrong method sent.
 			return crow::response(405);
 		}
+		try {
+			// Check for the parameters by initializing a pointer for the url sent.
+			const char* system_parameter = req.url_params.get("system");
+			const char* radius_parameter = req.url_params.get("radius");
+			long long limit = req.url_params.get("limit") ? std::stoll(req.url_params.get("limit")) : 10;
+			if (!system_parameter || limit <= 0) {
+				crow::json::wvalue error_response;
+				error_response["error"] = "Missing parameter!";
+				return crow::response(400, error_response);
+			}
+			// Geometry only runs in memory.
+			if (!star_map().loaded()) {
+				crow::json::wvalue error_response;
+				error_response["error"] = "Star map is not loaded yet!";
+				return crow::response(503, error_response);
+			}
+			std::size_t origin;
+			if (!star_map().resolve(system_parameter, origin)) {
+				crow::json::wvalue error_response;
+				error_response["error"] = "Bad Request! No system records found";
+				return crow::response(400, error_response);
+			}
+			// Radius search when given, k nearest otherwise.
+			std::vector<std::pair<std::size_t, double>> neighbours;
+			if (radius_parameter) {
+				double radius = std::stod(radius_parameter);
+				// Negative, zero, infinite or NaN would otherwise be squared into a valid looking sphere.
+				if (!std::isfinite(radius) || !(radius > 0)) throw std::invalid_argument("radius");
+				neighbours = star_map().within(origin, radius, static_cast<std::size_t>(limit));
+			} else {
+				neighbours = star_map().nearest(origin, static_cast<std::size_t>(limit));
+			}
+			return json_response(req, [&](JsonWriter& out) { build_nearby_json(out, star_map(), neighbours); });
+		} catch (const std::invalid_argument& e) {
+			crow::json::wvalue error_response;
+			error_response["error"] = "Bad Request! Invalid radius or limit!";
+			return crow::response(400, error_response);
+		} catch (const std::out_of_range& e) {
+			crow::json::wvalue error_response;
+			error_response["error"] = "Bad Request! Invalid radius or limit!";
+			return crow::response(400, error_response);
+		} catch (const std::exception& e) {
+			// Log the error and return an error message.
+			std::cerr << "Error: " << e.what() << std::endl;
+			crow::json::wvalue error_response;
+			error_response["error"] = "Internal Server Error!";
+			return crow::response(500, error_response);
+		}
+	})));
+	// Get totals, database queries run without holding the worker thread.
+	CROW_ROUTE(app, "/totals").methods("GET"_method)(metered_async(RouteMetric::Totals, cached_async([](const crow::request &req, Respond respond) {
+		// Get Method
+		if(req.method != crow::HTTPMethod::Get) {
+			// Wrong method sent.
+			respond(crow::response(405));
+			return;
+		}
 		// Try user input.
 		try {
-			// Get your PostgreSQL connection
-			pqxx::connection conn{get_pool_connection_string()};
-			pqxx::work txn(conn);
-			pqxx::result res;
-			pqxx::result resKillers;
-			pqxx::result resVictims;
-			pqxx::result resSystems;
-			pqxx::result resTribes;
 			// Check for the parameters by initializing a pointer for the url sent.
 			const char* name_parameter = req.url_params.get("name"); // name
 			const char* system_parameter = req.url_params.get("system"); // system by id or name
 			// Extract the "filter" parameter (e.g., "24h", "week", or "month")
 			const char* filter_parameter = req.url_params.get("filter");
 			const char* tribe_parameter = req.url_params.get("tribe"); // tribe
-			// Build parameters
+			// All-time and day, week or month summaries come from the in-memory leaderboards.
+			if (!name_parameter && !system_parameter && !tribe_parameter && leaderboards().ready()) {
+				if (filter_cutoff(filter_parameter) == 0) {
+					respond(json_response(req, [](JsonWriter& out) { leaderboards().summary(out); }));
+				} else {
+					respond(json_response(req, [&](JsonWriter& out) { leaderboards().summary(out, filter_parameter); }));
+				}
+				return;
+			}
+			// Summary from the database, the four boards run side by side and whatever is in by the deadline is sent.
+			if (!name_parameter && !system_parameter && !tribe_parameter) {
+				struct Summary {
+					explicit Summary(asio::io_context& io) : deadline(io) {}
+					asio::steady_timer deadline;
+					std::vector<std::optional<PgResult>> results = std::vector<std::optional<PgResult>>(4);
+					std::size_t pending = 4;
+					bool sent = false;
+				};
+				static const std::vector<std::pair<const char*, void (*)(JsonWriter&, const PgResult&)>> boards = {
+					{"top_killers", format_top_killers},
+					{"top_victims", format_top_victims},
+					{"top_systems", format_top_systems},
+					{"top_tribes", format_top_tribes}
+				};
+				// Every callback runs on this request's io_context thread, the state needs no lock.
+				auto summary = std::make_shared<Summary>(*req.io_context);
+				auto send = [summary, &req, respond]() {
+					if (summary->sent) return;
+					summary->sent = true;
+					summary->deadline.cancel();
+					bool partial = summary->pending > 0;
+					for (const auto& result : summary->results) partial = partial || !result;
+					crow::response resp = json_response(req, [&](JsonWriter& out) {
+						out.begin_object();
+						for (std::size_t i = 0; i < boards.size(); i++) {
+							out.key(boards[i].first);
+							if (summary->results[i]) {
+								boards[i].second(out, *summary->results[i]);
+							} else {
+								out.begin_array();
+								out.end_array();
+							}
+						}
+						// Boards that failed or ran past the deadline are listed, their arrays are left empty.
+						if (partial) {
+							out.field("partial", true);
+							out.key("missing");
+							out.begin_array();
+							for (std::size_t i = 0; i < boards.size(); i++) {
+								if (!summary->results[i]) out.value(boards[i].first);
+							}
+							out.end_array();
+						}
+						out.end_object();
+					});
+					if (partial) resp.set_header("Cache-Control", "no-store");
+					respond(std::move(resp));
+				};
+				summary->deadline.expires_after(std::chrono::milliseconds(totals_query_timeout_ms()));
+				summary->deadline.async_wait([send](const asio::error_code& ec) {
+					if (!ec) send();
+				});
+				for (std::size_t i = 0; i < boards.size(); i++) {
+					async_queries().exec(*req.io_context, statement_name(boards[i].first, filter_parameter), {},
+						[summary, send, i](PgResult result, std::string error) {
+							summary->pending--;
+							if (error.empty()) {
+								summary->results[i] = std::move(result);
+							} else {
+								std::cerr << "Error: " << boards[i].first << ": " << error << std::endl;
+							}
+							if (summary->pending == 0) send();
+						}, std::chrono::milliseconds(totals_query_timeout_ms()));
+				}
+				return;
+			}
+			// All-time name totals come from the per-character stats, sorted and cut in memory.
+			if (name_parameter && filter_cutoff(filter_parameter) == 0 && character_stats().ready()
+					&& dimensions().loaded() && plain_substring(name_parameter)) {
+				std::shared_ptr<const DimensionSnapshot> snapshot = dimensions().snapshot();
+				const DimensionSnapshot& dims = *snapshot;
+				long long limit = req.url_params.get("limit") ? std::stoll(req.url_params.get("limit")) : -1;
+				std::vector<std::string> ids;
+				if (*name_parameter) ids = dims.search_characters(name_parameter);
+				std::vector<CharacterTotals> totals;
+				if (!character_stats().ranking(*name_parameter ? &ids : nullptr, req.url_params.get("sort"),
+						limit < 0 ? std::numeric_limits<std::size_t>::max() : static_cast<std::size_t>(limit), totals)) {
+					crow::json::wvalue error_response;
+					error_response["error"] = "Bad Request! Invalid sort!";
+					respond(crow::response(400, error_response));
+					return;
+				}
+				if (totals.empty()) {
+					crow::json::wvalue error_response;
+					error_response["error"] = "Bad Request! No name records found!";
+					respond(crow::response(400, error_response));
+					return;
+				}
+				respond(json_response(req, [&](JsonWriter& out) { format_top_names(out, totals, dims); }));
+				return;
+			}
 			// Helper lambda to build search pattern.
 			auto build_search_pattern = [](const char* value) -> std::string {
 				return std::string("%") + std::string(value) + "%";
 			};
-			// Create a time-based helper lambda to build the time-based clause.
-			auto get_time_clause = [](const char* filter_param) -> std::string {
-				// Check for filter value passed.
-				if (!filter_param)
-					return "";
-				// Create string to hold passed value.
-				std::string filterStr = filter_param;
-				// Check our filter value.
-				if (filterStr == "day") {
-					return "i.time_stamp >= extract(epoch from now() - interval '24 hours')";
-				} else if (filterStr == "week") {
-					return "i.time_stamp >= extract(epoch from now() - interval '7 days')";
-				} else if (filterStr == "month") {
-					return "i.time_stamp >= extract(epoch from now() - interval '1 month')";
-				} else {
-					return "";
-				}
-			};
+			// Pick the statement, its parameters and how its rows are written.
+			std::string statement;
+			std::vector<std::string> params;
+			void (*format)(JsonWriter&, const PgResult&) = nullptr;
+			const char* not_found = nullptr;
 			// Check the parameters every time we are called up.
 			if(name_parameter) {
-				if(name_parameter && std::string(name_parameter).size() > 0) {
-					// Parse our search value name parameter.
-					std::string searchPattern = build_search_pattern(name_parameter);
-					// Work with the filter.
-					std::string timeClause = get_time_clause(filter_parameter);
-					// Base query
-					std::string baseQuery = "WITH combined AS ("
-						"  SELECT killer.id AS char_id, killer.name AS person, "
-						"         1 AS kill_count, 0 AS loss_count, "
-						"         i.time_stamp "
-						"  FROM incident i "
-						"  JOIN characters killer ON i.killer_id = killer.id "
-						"  UNION ALL "
-						"  SELECT victim.id AS char_id, victim.name AS person, "
-						"         0 AS kill_count, 1 AS loss_count, "
-						"         i.time_stamp "
-						"  FROM incident i "
-						"  JOIN characters victim ON i.victim_id = victim.id "
-						") "
-						"SELECT c.person, "
-						"       SUM(c.kill_count) AS total_kills, "
-						"       SUM(c.loss_count) AS total_losses, "
-						"       COALESCE(t.name, '') AS tribe_name "
-						"FROM combined c "
-						"LEFT JOIN character_tribe_membership m ON c.char_id = m.character_id AND m.left_at IS NULL "
-						"LEFT JOIN tribes t ON m.tribe_id = t.id "
-						"WHERE c.person ILIKE $1 ";  //The parameter placeholder for our name search.;
-					// Empty query string.
-					std::string query;
-					// Append filters
-					if (!timeClause.empty()) {
-						baseQuery += "AND " + timeClause + " ";
+				if(std::string(name_parameter).size() > 0) {
+					if (dimensions().loaded() && plain_substring(name_parameter)) {
+						// Matched in the name index, the query filters incidents by character id as an array literal.
+						std::string ids = "{";
+						for (const auto& id : dimensions().snapshot()->search_characters(name_parameter)) {
+							if (ids.size() > 1) ids += ",";
+							ids += id;
+						}
+						statement = statement_name("totals_name_ids", filter_parameter);
+						params.push_back(ids + "}");
+					} else {
+						statement = statement_name("totals_name", filter_parameter);
+						params.push_back(build_search_pattern(name_parameter));
 					}
-					query = baseQuery + "GROUP BY c.person, t.name;";
-					// Prepare SQL call.
-					res = txn.exec_params(query, searchPattern);
 				} else {
-					// Work with the filter.
-					std::string timeClause = get_time_clause(filter_parameter);
-					// Base query
-					std::string query = "WITH combined AS ("
-						"  SELECT killer.id AS char_id, killer.name AS person, 1 AS kill_count, 0 AS loss_count, i.time_stamp "
-						"  FROM incident i "
-						"  JOIN characters killer ON i.killer_id = killer.id "
-						+ (timeClause.empty() ? "" : "WHERE " + timeClause + " ") +
-						"  UNION ALL "
-						"  SELECT victim.id AS char_id, victim.name AS person, 0 AS kill_count, 1 AS loss_count, i.time_stamp "
-						"  FROM incident i "
-						"  JOIN characters victim ON i.victim_id = victim.id "
-						+ (timeClause.empty() ? "" : "WHERE " + timeClause + " ") +
-						") "
-						"SELECT agg.person, "
-						"       SUM(agg.kill_count) AS total_kills, "
-						"       SUM(agg.loss_count) AS total_losses, "
-						"       COALESCE(t.name, '') AS tribe_name "
-						"FROM combined agg "
-						"LEFT JOIN character_tribe_membership m ON agg.char_id = m.character_id AND m.left_at IS NULL "
-						"LEFT JOIN tribes t ON m.tribe_id = t.id "
-						"GROUP BY agg.person, t.name "
-						"ORDER BY total_kills DESC;";
-					// Run the query (no exec_params needed since no placeholders)
-					res = txn.exec(query);
-				}
-				// Check if query returned any rows.
-				if (res.size() == 0) {
-					crow::json::wvalue error_response;
-					error_response["error"] = "Bad Request! No name records found!";
-					return crow::response(400, error_response);
+					statement = statement_name("totals_names", filter_parameter);
 				}
-				// Build the JSON using nlohmann
-				auto name_string = format_top_names(res);
-				// Convert JSON object to string
-				std::string json_string = name_string.dump(4); // Pretty printing with indent of 4 spaces
-				// Create a Crow response with the correct Content-Type header
-				crow::response resp(json_string);
-				resp.set_header("Content-Type", "application/json");
-				return resp;
+				format = format_top_names;
+				not_found = "Bad Request! No name records found!";
 			} else if(system_parameter) {
-				if(system_parameter && std::string(system_parameter).size() > 0) {
-					// Convert the string to a 64-bit integer using std::stoll.
-					std::string searchPattern = build_search_pattern(system_parameter);
-					// Work with the filter.
-					std::string timeClause = get_time_clause(filter_parameter);
-					// Base query that aggregates kill/loss counts per "person"
-					// and joins with the systems table to include solar_system_name.
-					std::string baseQuery = "SELECT s.solar_system_id, "
-						"       s.solar_system_name, "
-						"       COUNT(*) AS incident_count "
-						"FROM incident i "
-						"JOIN systems s ON i.solar_system_id = s.solar_system_id "
-						"WHERE (s.solar_system_id::text ILIKE $1 OR s.solar_system_name ILIKE $1) ";
-					// Empty query string.
-					std::string query;
-					// Append filters
-					if (!timeClause.empty()) {
-						baseQuery += "AND " + timeClause + " ";
-					}
-					query = baseQuery + "GROUP BY s.solar_system_id, s.solar_system_name "
-						"ORDER BY s.solar_system_id DESC;";
-					// Prepare SQL call.
-					res = txn.exec_params(query, searchPattern);
+				if(std::string(system_parameter).size() > 0) {
+					statement = statement_name("totals_system", filter_parameter);
+					params.push_back(build_search_pattern(system_parameter));
 				} else {
-					// Work with the filter.
-					std::string timeClause = get_time_clause(filter_parameter);
-					// Empty query string, with a filter for systems.
-					std::string baseQuery = "SELECT s.solar_system_id, s.solar_system_name, COUNT(*) AS incident_count "
-						"FROM incident i "
-						"JOIN systems s ON i.solar_system_id = s.solar_system_id";
-					// Empty query string.
-					std::string query;
-					// If get_time_clause returns a non-empty string, add WHERE before it.
-					if (!timeClause.empty()) {
-						baseQuery += " WHERE " + timeClause + " ";
-					}
-					query = baseQuery + " GROUP BY s.solar_system_id, s.solar_system_name "
-						"ORDER BY incident_count DESC;";
-					// Prepare SQL call.
-					res = txn.exec(query);
-				}
-				// Check if query returned any rows.
-				if (res.size() == 0) {
-					crow::json::wvalue error_response;
-					error_response["error"] = "Bad Request! No system records found";
-					return crow::response(400, error_response);
+					statement = statement_name("totals_systems", filter_parameter);
 				}
-				// Reuse formatTopSystems since returns are the same with nlohmann.
-				auto systems_string = format_top_systems(res);
-				// Convert JSON object to string
-				std::string json_string = systems_string.dump(4); // Pretty printing with indent of 4 spaces
-				// Create a Crow response with the correct Content-Type header
-				crow::response resp(json_string);
-				resp.set_header("Content-Type", "application/json");
-				return resp;
-			} else if(tribe_parameter) {
-				// Check the parameters every time we are called up.
-				if(tribe_parameter && std::string(tribe_parameter).size() > 0) {
-					// Parse our search value tribe parameter.
-					std::string searchPattern = build_search_pattern(tribe_parameter);
-					// Work with the filter.
-					std::string timeClause = get_time_clause(filter_parameter);
-					// Base query for tribe stats with name filter
-					std::string baseQuery = "SELECT t.name AS tribe_name, "
-						"COALESCE(kills_table.kills, 0) AS kills, "
-						"COALESCE(losses_table.losses, 0) AS losses "
-						"FROM tribes t "
-						"LEFT JOIN ("
-						"  SELECT ctm.tribe_id, COUNT(*) AS kills "
-						"  FROM incident i "
-						"  JOIN characters c ON i.killer_id = c.id "
-						"  JOIN character_tribe_membership ctm ON ctm.character_id = c.id AND ctm.joined_at <= i.time_stamp AND (ctm.left_at IS NULL OR ctm.left_at > i.time_stamp) "
-						+ (timeClause.empty() ? "" : "WHERE " + timeClause + " ") +
-						"  GROUP BY ctm.tribe_id "
-						") kills_table ON t.id = kills_table.tribe_id "
-						"LEFT JOIN ("
-						"  SELECT ctm.tribe_id, COUNT(*) AS losses "
-						"  FROM incident i "
-						"  JOIN characters c ON i.victim_id = c.id "
-						"  JOIN character_tribe_membership ctm ON ctm.character_id = c.id AND ctm.joined_at <= i.time_stamp AND (ctm.left_at IS NULL OR ctm.left_at > i.time_stamp) "
-						+ (timeClause.empty() ? "" : "WHERE " + timeClause + " ") +
-						"  GROUP BY ctm.tribe_id "
-						") losses_table ON t.id = losses_table.tribe_id "
-						"WHERE t.name ILIKE $1 "
-						"ORDER BY kills DESC";
-					// Prepare SQL call.
-					res = txn.exec_params(baseQuery, searchPattern);
+				format = format_top_systems;
+				not_found = "Bad Request! No system records found";
+			} else {
+				if(std::string(tribe_parameter).size() > 0) {
+					statement = statement_name("totals_tribe", filter_parameter);
+					params.push_back(build_search_pattern(tribe_parameter));
 				} else {
-					std::string timeClause = get_time_clause(filter_parameter);
-					std::string baseQuery = "SELECT t.name AS tribe_name, "
-						"COALESCE(kills_table.kills, 0) AS kills, "
-						"COALESCE(losses_table.losses, 0) AS losses "
-						"FROM tribes t "
-						"LEFT JOIN ("
-						"  SELECT ctm.tribe_id, COUNT(*) AS kills "
-						"  FROM incident i "
-						"  JOIN characters c ON i.killer_id = c.id "
-						"  JOIN character_tribe_membership ctm ON ctm.character_id = c.id AND ctm.joined_at <= i.time_stamp AND (ctm.left_at IS NULL OR ctm.left_at > i.time_stamp) "
-						+ (timeClause.empty() ? "" : "WHERE " + timeClause + " ") +
-						"  GROUP BY ctm.tribe_id "
-						") kills_table ON t.id = kills_table.tribe_id "
-						"LEFT JOIN ("
-						"  SELECT ctm.tribe_id, COUNT(*) AS losses "
-						"  FROM incident i "
-						"  JOIN characters c ON i.victim_id = c.id "
-						"  JOIN character_tribe_membership ctm ON ctm.character_id = c.id AND ctm.joined_at <= i.time_stamp AND (ctm.left_at IS NULL OR ctm.left_at > i.time_stamp) "
-						+ (timeClause.empty() ? "" : "WHERE " + timeClause + " ") +
-						"  GROUP BY ctm.tribe_id "
-						") losses_table ON t.id = losses_table.tribe_id "
-						"ORDER BY kills DESC";
-					res = txn.exec(baseQuery);
+					statement = statement_name("totals_tribes", filter_parameter);
 				}
-				if (res.size() == 0) {
+				format = format_top_tribes;
+				not_found = "Bad Request! No tribe records found!";
+			}
+			// The worker thread is free again until the rows arrive.
+			async_queries().exec(*req.io_context, statement, std::move(params), [&req, respond, format, not_found](PgResult res, std::string error) {
+				// No connection in time, the client may try again.
+				if (error == AsyncQueryPool::busy) {
 					crow::json::wvalue error_response;
-					error_response["error"] = "Bad Request! No tribe records found!";
-					return crow::response(400, error_response);
-				}
-				auto name_string = format_top_tribes(res);
-				std::string json_string = name_string.dump(4);
-				crow::response resp(json_string);
-				resp.set_header("Content-Type", "application/json");
-				return resp;
-			} else {
-				std::string timeClause = get_time_clause(filter_parameter);
-				std::string qKillers = "SELECT killer.name AS name, COUNT(*) AS incident_count "
-					"FROM incident i "
-					"JOIN characters killer ON i.killer_id = killer.id "
-					"WHERE killer.name <> '' ";
-				if (!timeClause.empty()) {
-					qKillers += "AND " + timeClause + " ";
+					error_response["error"] = "Service Unavailable! Database is busy, try again!";
+					respond(crow::response(503, error_response));
+					return;
 				}
-				qKillers += "GROUP BY killer.name ORDER BY incident_count DESC LIMIT 10;";
-				std::string qVictims = "SELECT victim.name AS name, COUNT(*) AS incident_count "
-					"FROM incident i "
-					"JOIN characters victim ON i.victim_id = victim.id "
-					"WHERE victim.name <> '' ";
-				if (!timeClause.empty()) {
-					qVictims += "AND " + timeClause + " ";
+				if (!error.empty()) {
+					std::cerr << "Error: " << error << std::endl;
+					crow::json::wvalue error_response;
+					error_response["error"] = "Internal Server Error!";
+					respond(crow::response(500, error_response));
+					return;
 				}
-				qVictims += "GROUP BY victim.name ORDER BY incident_count DESC LIMIT 10;";
-				std::string qSystems = "SELECT s.solar_system_id, s.solar_system_name, COUNT(*) AS incident_count "
-					"FROM incident i "
-					"JOIN systems s ON i.solar_system_id = s.solar_system_id ";
-				if (!timeClause.empty()) {
-					qSystems += "WHERE " + timeClause + " ";
+				// Check if query returned any rows.
+				if (res.size() == 0) {
+					crow::json::wvalue error_response;
+					error_response["error"] = not_found;
+					respond(crow::response(400, error_response));
+					return;
 				}
-				qSystems += "GROUP BY s.solar_system_id, s.solar_system_name ORDER BY incident_count DESC LIMIT 10;";
-				std::string qTribes = "SELECT t.name AS tribe_name, "
-					"COALESCE(kills_table.kills, 0) AS kills, "
-					"COALESCE(losses_table.losses, 0) AS losses "
-					"FROM tribes t "
-					"LEFT JOIN ("
-					"  SELECT ctm.tribe_id, COUNT(*) AS kills "
-					"  FROM incident i "
-					"  JOIN characters c ON i.killer_id = c.id "
-					"  JOIN character_tribe_membership ctm ON ctm.character_id = c.id AND ctm.joined_at <= i.time_stamp AND (ctm.left_at IS NULL OR ctm.left_at > i.time_stamp) "
-					+ (timeClause.empty() ? "" : "WHERE " + timeClause + " ") +
-					"  GROUP BY ctm.tribe_id "
-					") kills_table ON t.id = kills_table.tribe_id "
-					"LEFT JOIN ("
-					"  SELECT ctm.tribe_id, COUNT(*) AS losses "
-					"  FROM incident i "
-					"  JOIN characters c ON i.victim_id = c.id "
-					"  JOIN character_tribe_membership ctm ON ctm.character_id = c.id AND ctm.joined_at <= i.time_stamp AND (ctm.left_at IS NULL OR ctm.left_at > i.time_stamp) "
-					+ (timeClause.empty() ? "" : "WHERE " + timeClause + " ") +
-					"  GROUP BY ctm.tribe_id "
-					") losses_table ON t.id = losses_table.tribe_id "
-					"ORDER BY kills DESC, losses DESC LIMIT 10;";
-				resKillers = txn.exec(qKillers);
-				resVictims = txn.exec(qVictims);
-				resSystems  = txn.exec(qSystems);
-				resTribes = txn.exec(qTribes);
-				auto topKillers = format_top_killers(resKillers);
-				auto topVictims = format_top_victims(resVictims);
-				auto topSystems = format_top_systems(resSystems);
-				auto topTribes = format_top_tribes(resTribes);
-				nlohmann::ordered_json response;
-				response["top_killers"] = topKillers;
-				response["top_victims"] = topVictims;
-				response["top_systems"] = topSystems;
-				response["top_tribes"] = topTribes;
-				std::string json_string = response.dump(4);
-				crow::response resp(json_string);
-				resp.set_header("Content-Type", "application/json");
-				return resp;
-			}
+				// Stream the JSON straight into the response
+				respond(json_response(req, [&](JsonWriter& out) { format(out, res); }));
+			});
 		} catch(const std::exception& e) {
 			std::cerr << "Notification error: " << e.what() << "\n";
 			crow::json::wvalue error_response;
 			error_response["error"] = "Internal Server Error!";
-			return crow::response(500, error_response);
+			respond(crow::response(500, error_response));
 		}
-	});
+	})));
 	// Get incidents
-	CROW_ROUTE(app, "/incident").methods("GET"_method)([](const crow::request &req) -> crow::response {
+	CROW_ROUTE(app, "/incident").methods("GET"_method)(metered(RouteMetric::Incident, cached([](const crow::request &req) -> crow::response {
 		// Get Method
 		if(req.method == crow::HTTPMethod::Get) {
 			try {
-				// Get your PostgreSQL connection
-				pqxx::connection conn{get_pool_connection_string()};
-				pqxx::work txn(conn);
-				pqxx::result res;
 				// Check for the parameters by initializing a pointer for the url sent.
 				const char* name_parameter = req.url_params.get("name"); // name
 				const char* system_parameter = req.url_params.get("system"); // system by id or name
 				const char* filter_parameter = req.url_params.get("filter");
 				const char* mail_parameter = req.url_params.get("mail_id");
 				const char* tribe_parameter = req.url_params.get("tribe");
+				const char* cursor_parameter = req.url_params.get("cursor");
 				int limit = req.url_params.get("limit") ? std::stoi(req.url_params.get("limit")) : 100;
 				int offset = req.url_params.get("offset") ? std::stoi(req.url_params.get("offset")) : 0;
+				// Any cursor parameter switches to keyset pages, an empty one starts from the newest incident.
+				bool cursor_mode = cursor_parameter && !mail_parameter;
+				bool resume = cursor_mode && *cursor_parameter;
+				IncidentCursor cursor;
+				if (resume && !decode_cursor(cursor_parameter, cursor)) {
+					crow::json::wvalue error_response;
+					error_response["error"] = "Bad Request! Invalid cursor";
+					return crow::response(400, error_response);
+				}
+				if (cursor_mode) offset = 0;
+				// Latest incidents come straight from memory when the ring covers the page.
+				if (!name_parameter && !system_parameter && !mail_parameter && !tribe_parameter) {
+					std::vector<IncidentRecord> incidents;
+					bool served = resume
+						? recent_incidents().after(filter_cutoff(filter_parameter), cursor.time_stamp, cursor.id, limit, incidents)
+						: recent_incidents().page(filter_cutoff(filter_parameter), limit, offset, incidents);
+					if (served && cursor_mode) {
+						return json_response(req, [&](JsonWriter& out) { build_incident_page(out, incidents, limit); });
+					}
+					if (served) {
+						if (incidents.empty()) {
+							crow::json::wvalue error_response;
+							error_response["error"] = "Bad Request! No incident records found";
+							return crow::response(400, error_response);
+						}
+						return json_response(req, [&](JsonWriter& out) { build_incident_json(out, incidents); });
+					}
+				}
+				// Get your PostgreSQL connection
+				auto conn = get_connection_pool().acquire();
+				pqxx::work txn(*conn);
+				pqxx::result res;
 				auto build_search_pattern = [](const char* value) -> std::string {
 					return std::string("%") + std::string(value) + "%";
 				};
-				auto get_time_clause = [](const char* filter_param) -> std::string {
-					if (!filter_param)
-						return "";
-					std::string filterStr = filter_param;
-					if (filterStr == "day") {
-						return "i.time_stamp >= extract(epoch from now() - interval '24 hours')";
-					} else if (filterStr == "week") {
-						return "i.time_stamp >= extract(epoch from now() - interval '7 days')";
-					} else if (filterStr == "month") {
-						return "i.time_stamp >= extract(epoch from now() - interval '1 month')";
-					} else {
-						return "";
+				// Run a family by offset, or by keyset from the cursor with its _after statement.
+				auto run_page = [&](const std::string& family, const auto&... search) -> pqxx::result {
+					if (resume) {
+						return exec_statement(txn, statement_name(family + "_after", filter_parameter), search..., cursor.time_stamp, cursor.id, limit);
 					}
+					return exec_statement(txn, statement_name(family, filter_parameter), search..., limit, offset);
 				};
+				// With the caches loaded, queries return ids only and names are filled in from memory.
+				bool slim = dimensions().loaded() && star_map().loaded() && !tribe_parameter;
 				if(name_parameter) {
-					std::string searchPattern = build_search_pattern(name_parameter);
-					std::string timeClause = get_time_clause(filter_parameter);
-					std::string baseQuery = "SELECT i.id, "
-						"COALESCE(victim.name, '') AS victim_name, "
-						"COALESCE(encode(victim.address, 'hex'), '') AS victim_address, "
-						"COALESCE(victim_tribe.name, '') AS victim_tribe_name, "
-						"COALESCE(killer.name, '') AS killer_name, "
-						"COALESCE(encode(killer.address, 'hex'), '') AS killer_address, "
-						"COALESCE(killer_tribe.name, '') AS killer_tribe_name, "
-						"i.solar_system_id, "
-						"s.solar_system_name, "
-						"i.loss_type, "
-						"i.time_stamp "
-						"FROM incident AS i "
-						"JOIN characters AS victim ON i.victim_id = victim.id "
-						"LEFT JOIN character_tribe_membership victim_ctm ON victim_ctm.character_id = victim.id AND victim_ctm.joined_at <= i.time_stamp AND (victim_ctm.left_at IS NULL OR victim_ctm.left_at > i.time_stamp) "
-						"LEFT JOIN tribes AS victim_tribe ON victim_ctm.tribe_id = victim_tribe.id "
-						"JOIN characters AS killer ON i.killer_id = killer.id "
-						"LEFT JOIN character_tribe_membership killer_ctm ON killer_ctm.character_id = killer.id AND killer_ctm.joined_at <= i.time_stamp AND (killer_ctm.left_at IS NULL OR killer_ctm.left_at > i.time_stamp) "
-						"LEFT JOIN tribes AS killer_tribe ON killer_ctm.tribe_id = killer_tribe.id "
-						"JOIN systems AS s ON i.solar_system_id = s.solar_system_id "
-						"WHERE (victim.name ILIKE $1 OR killer.name ILIKE $1)";
-					std::string query;
-					if(!timeClause.empty()) {
-						query = baseQuery + " AND " + timeClause + " ORDER BY i.time_stamp DESC, i.id DESC LIMIT $2 OFFSET $3;";
+					if (slim && plain_substring(name_parameter)) {
+						res = run_page("incident_slim_name", dimensions().snapshot()->search_characters(name_parameter));
 					} else {
-						query = baseQuery + " ORDER BY i.time_stamp DESC, i.id DESC LIMIT $2 OFFSET $3;";
+						std::string searchPattern = build_search_pattern(name_parameter);
+						res = run_page("incident_name", searchPattern);
 					}
-					res = txn.exec_params(query, searchPattern, limit, offset);
-					if (res.size() == 0) {
+					if (res.size() == 0 && !cursor_mode) {
 						crow::json::wvalue error_response;
 						error_response["error"] = "Bad Request! No incident records found!";
 						return crow::response(400, error_response);
 					}
 				} else if(system_parameter) {
-					std::string searchPattern = build_search_pattern(system_parameter);
-					std::string timeClause = get_time_clause(filter_parameter);
-					std::string baseQuery = "SELECT i.id, "
-						"COALESCE(victim.name, '') AS victim_name, "
-						"COALESCE(encode(victim.address, 'hex'), '') AS victim_address, "
-						"COALESCE(victim_tribe.name, '') AS victim_tribe_name, "
-						"COALESCE(killer.name, '') AS killer_name, "
-						"COALESCE(encode(killer.address, 'hex'), '') AS killer_address, "
-						"COALESCE(killer_tribe.name, '') AS killer_tribe_name, "
-						"i.solar_system_id, "
-						"s.solar_system_name, "
-						"i.loss_type, "
-						"i.time_stamp "
-						"FROM incident AS i "
-						"JOIN characters AS victim ON i.victim_id = victim.id "
-						"LEFT JOIN character_tribe_membership victim_ctm ON victim_ctm.character_id = victim.id AND victim_ctm.joined_at <= i.time_stamp AND (victim_ctm.left_at IS NULL OR victim_ctm.left_at > i.time_stamp) "
-						"LEFT JOIN tribes AS victim_tribe ON victim_ctm.tribe_id = victim_tribe.id "
-						"JOIN characters AS killer ON i.killer_id = killer.id "
-						"LEFT JOIN character_tribe_membership killer_ctm ON killer_ctm.character_id = killer.id AND killer_ctm.joined_at <= i.time_stamp AND (killer_ctm.left_at IS NULL OR killer_ctm.left_at > i.time_stamp) "
-						"LEFT JOIN tribes AS killer_tribe ON killer_ctm.tribe_id = killer_tribe.id "
-						"JOIN systems AS s ON i.solar_system_id = s.solar_system_id "
-						"WHERE (i.solar_system_id::text ILIKE $1 OR s.solar_system_name ILIKE $1)";
-					std::string query;
-					if(!timeClause.empty()) {
-						query = baseQuery + " AND " + timeClause + " ORDER BY i.time_stamp DESC, i.id DESC LIMIT $2 OFFSET $3;";
+					if (slim) {
+						std::vector<long long> system_ids;
+						for (std::size_t i : star_map().search(system_parameter)) system_ids.push_back(star_map().ids[i]);
+						res = run_page("incident_slim_system", system_ids);
 					} else {
-						query = baseQuery + " ORDER BY i.time_stamp DESC, i.id DESC LIMIT $2 OFFSET $3;";
+						std::string searchPattern = build_search_pattern(system_parameter);
+						res = run_page("incident_system", searchPattern);
 					}
-					res = txn.exec_params(query, searchPattern, limit, offset);
-					if (res.size() == 0) {
+					if (res.size() == 0 && !cursor_mode) {
 						crow::json::wvalue error_response;
 						error_response["error"] = "Bad Request! No incident records found";
 						return crow::response(400, error_response);
@@ -715,27 +938,7 @@ void setupRoutes(crow::SimpleApp& app) {
 					} catch (const std::exception& e) {
 						return crow::response(400, "Invalid 'id' parameter");
 					}
-					std::string query = "SELECT i.id, "
-						"COALESCE(victim_tribe.name, '') AS victim_tribe_name, "
-						"COALESCE(encode(victim.address, 'hex'), '') AS victim_address, "
-						"COALESCE(victim.name, '') AS victim_name, "
-						"COALESCE(killer_tribe.name, '') AS killer_tribe_name, "
-						"COALESCE(encode(killer.address, 'hex'), '') AS killer_address, "
-						"COALESCE(killer.name, '') AS killer_name, "
-						"i.solar_system_id, "
-						"s.solar_system_name, "
-						"i.loss_type, "
-						"i.time_stamp "
-						"FROM incident AS i "
-						"JOIN systems AS s ON i.solar_system_id = s.solar_system_id "
-						"LEFT JOIN characters victim ON i.victim_id = victim.id "
-						"LEFT JOIN character_tribe_membership victim_ctm ON victim_ctm.character_id = victim.id AND victim_ctm.joined_at <= i.time_stamp AND (victim_ctm.left_at IS NULL OR victim_ctm.left_at > i.time_stamp) "
-						"LEFT JOIN tribes victim_tribe ON victim_ctm.tribe_id = victim_tribe.id "
-						"LEFT JOIN characters killer ON i.killer_id = killer.id "
-						"LEFT JOIN character_tribe_membership killer_ctm ON killer_ctm.character_id = killer.id AND killer_ctm.joined_at <= i.time_stamp AND (killer_ctm.left_at IS NULL OR killer_ctm.left_at > i.time_stamp) "
-						"LEFT JOIN tribes killer_tribe ON killer_ctm.tribe_id = killer_tribe.id "
-						"WHERE i.id = $1;";
-					res = txn.exec_params(query, searchPattern);
+					res = exec_statement(txn, slim ? "incident_slim_mail" : "incident_mail", searchPattern);
 					if (res.size() == 0) {
 						crow::json::wvalue error_response;
 						error_response["error"] = "Bad Request! No incident records found";
@@ -743,106 +946,33 @@ void setupRoutes(crow::SimpleApp& app) {
 					}
 				} else if(tribe_parameter) {
 					std::string searchPattern = build_search_pattern(tribe_parameter);
-					std::string timeClause = get_time_clause(filter_parameter);
-					std::string baseQuery =	"SELECT i.id, "
-						"COALESCE(victim_tribe.name, '') AS victim_tribe_name, "
-						"COALESCE(encode(victim.address, 'hex'), '') AS victim_address, "
-						"COALESCE(victim.name, '') AS victim_name, "
-						"COALESCE(killer_tribe.name, '') AS killer_tribe_name, "
-						"COALESCE(encode(killer.address, 'hex'), '') AS killer_address, "
-						"COALESCE(killer.name, '') AS killer_name, "
-						"i.solar_system_id, "
-						"s.solar_system_name, "
-						"i.loss_type, "
-						"i.time_stamp "
-						"FROM incident AS i "
-						"JOIN systems AS s ON i.solar_system_id = s.solar_system_id "
-						"LEFT JOIN characters victim ON i.victim_id = victim.id "
-						"LEFT JOIN character_tribe_membership victim_ctm ON victim_ctm.character_id = victim.id AND victim_ctm.joined_at <= i.time_stamp AND (victim_ctm.left_at IS NULL OR victim_ctm.left_at > i.time_stamp) "
-						"LEFT JOIN tribes victim_tribe ON victim_ctm.tribe_id = victim_tribe.id "
-						"LEFT JOIN characters killer ON i.killer_id = killer.id "
-						"LEFT JOIN character_tribe_membership killer_ctm ON killer_ctm.character_id = killer.id AND killer_ctm.joined_at <= i.time_stamp AND (killer_ctm.left_at IS NULL OR killer_ctm.left_at > i.time_stamp) "
-						"LEFT JOIN tribes killer_tribe ON killer_ctm.tribe_id = killer_tribe.id "
-						"WHERE (killer_tribe.name ILIKE $1 OR victim_tribe.name ILIKE $1)";
-					std::string query;
-					if(!timeClause.empty()) {
-						query = baseQuery + " AND " + timeClause + " ORDER BY i.time_stamp DESC, i.id DESC LIMIT $2 OFFSET $3;";
-					} else {
-						query = baseQuery + " ORDER BY i.time_stamp DESC, i.id DESC LIMIT $2 OFFSET $3;";
-					}
-					res = txn.exec_params(query, searchPattern, limit, offset);
-					if (res.size() == 0) {
-						crow::json::wvalue error_response;
-						error_response["error"] = "Bad Request! No incident records found";
-						return crow::response(400, error_response);
-					}
-				} else if(filter_parameter) {
-					std::string timeClause = get_time_clause(filter_parameter);
-					std::string baseQuery = "SELECT i.id, "
-						"COALESCE(victim.name, '') AS victim_name, "
-						"COALESCE(encode(victim.address, 'hex'), '') AS victim_address, "
-						"COALESCE(victim_tribe.name, '') AS victim_tribe_name, "
-						"COALESCE(killer.name, '') AS killer_name, "
-						"COALESCE(encode(killer.address, 'hex'), '') AS killer_address, "
-						"COALESCE(killer_tribe.name, '') AS killer_tribe_name, "
-						"i.solar_system_id, "
-						"s.solar_system_name, "
-						"i.loss_type, "
-						"i.time_stamp "
-						"FROM incident AS i "
-						"JOIN characters AS victim ON i.victim_id = victim.id "
-						"LEFT JOIN character_tribe_membership victim_ctm ON victim_ctm.character_id = victim.id AND victim_ctm.joined_at <= i.time_stamp AND (victim_ctm.left_at IS NULL OR victim_ctm.left_at > i.time_stamp) "
-						"LEFT JOIN tribes AS victim_tribe ON victim_ctm.tribe_id = victim_tribe.id "
-						"JOIN characters AS killer ON i.killer_id = killer.id "
-						"LEFT JOIN character_tribe_membership killer_ctm ON killer_ctm.character_id = killer.id AND killer_ctm.joined_at <= i.time_stamp AND (killer_ctm.left_at IS NULL OR killer_ctm.left_at > i.time_stamp) "
-						"LEFT JOIN tribes AS killer_tribe ON killer_ctm.tribe_id = killer_tribe.id "
-						"JOIN systems AS s ON i.solar_system_id = s.solar_system_id";
-					std::string query;
-					if(!timeClause.empty()) {
-						query = baseQuery + " AND " + timeClause + " ORDER BY i.time_stamp DESC, i.id DESC LIMIT $1 OFFSET $2;";
-					} else {
-						query = baseQuery + " ORDER BY i.time_stamp DESC, i.id DESC LIMIT $1 OFFSET $2;";
-					}
-					res = txn.exec_params(query, limit, offset);
-					if (res.size() == 0) {
+					res = run_page("incident_tribe", searchPattern);
+					if (res.size() == 0 && !cursor_mode) {
 						crow::json::wvalue error_response;
 						error_response["error"] = "Bad Request! No incident records found";
 						return crow::response(400, error_response);
 					}
 				} else {
-					std::string query = "SELECT i.id, "
-						"COALESCE(victim.name, '') AS victim_name, "
-						"COALESCE(encode(victim.address, 'hex'), '') AS victim_address, "
-						"COALESCE(victim_tribe.name, '') AS victim_tribe_name, "
-						"COALESCE(killer.name, '') AS killer_name, "
-						"COALESCE(encode(killer.address, 'hex'), '') AS killer_address, "
-						"COALESCE(killer_tribe.name, '') AS killer_tribe_name, "
-						"i.solar_system_id, "
-						"s.solar_system_name, "
-						"i.loss_type, "
-						"i.time_stamp "
-						"FROM incident AS i "
-						"JOIN characters AS victim ON i.victim_id = victim.id "
-						"LEFT JOIN character_tribe_membership victim_ctm ON victim_ctm.character_id = victim.id AND victim_ctm.joined_at <= i.time_stamp AND (victim_ctm.left_at IS NULL OR victim_ctm.left_at > i.time_stamp) "
-						"LEFT JOIN tribes AS victim_tribe ON victim_ctm.tribe_id = victim_tribe.id "
-						"JOIN characters AS killer ON i.killer_id = killer.id "
-						"LEFT JOIN character_tribe_membership killer_ctm ON killer_ctm.character_id = killer.id AND killer_ctm.joined_at <= i.time_stamp AND (killer_ctm.left_at IS NULL OR killer_ctm.left_at > i.time_stamp) "
-						"LEFT JOIN tribes AS killer_tribe ON killer_ctm.tribe_id = killer_tribe.id "
-						"JOIN systems AS s ON i.solar_system_id = s.solar_system_id "
-						"ORDER BY i.time_stamp DESC, i.id DESC LIMIT $1 OFFSET $2;";
-					res = txn.exec_params(query, limit, offset);
-					if (res.size() == 0) {
+					// Latest incidents, optionally limited to the filter window.
+					res = run_page(slim ? "incident_slim_all" : "incident_all");
+					if (res.size() == 0 && !cursor_mode) {
 						crow::json::wvalue error_response;
 						error_response["error"] = "Bad Request! No incident records found";
 						return crow::response(400, error_response);
 					}
 				}
 				txn.commit();
-				auto incident_string = build_incident_json(res);
-				std::string json_string = incident_string.dump(4);
-				crow::response resp(json_string);
-				resp.set_header("Content-Type", "application/json");
-				return resp;
+				if (slim) {
+					std::vector<IncidentRecord> incidents = dimensions().resolve_rows(res);
+					if (cursor_mode) {
+						return json_response(req, [&](JsonWriter& out) { build_incident_page(out, incidents, limit); });
+					}
+					return json_response(req, [&](JsonWriter& out) { build_incident_json(out, incidents); });
+				}
+				if (cursor_mode) {
+					return json_response(req, [&](JsonWriter& out) { build_incident_page(out, res, limit); });
+				}
+				return json_response(req, [&](JsonWriter& out) { build_incident_json(out, res); });
 			} catch(const std::exception& e) {
 				std::cerr << "Notification error: " << e.what() << "\n";
 				crow::json::wvalue error_response;
@@ -856,34 +986,246 @@ void setupRoutes(crow::SimpleApp& app) {
 		} else {
 			return crow::response(405);
 		}
-	});
+	})));
 }
 
 // Websocket
 #include <mutex>
 #include <vector>
+// Most filter keys one subscriber may hold, WEBSOCKET_FILTER_LIMIT. A near filter counts every system it covers.
+static std::size_t websocket_filter_limit() {
+	static const std::size_t limit = env_size("WEBSOCKET_FILTER_LIMIT", 10000);
+	return limit;
+}
+// One value or an array of them
+static std::vector<nlohmann::json> filter_values(const nlohmann::json& spec, const char* name) {
+	if (!spec.contains(name)) return {};
+	const nlohmann::json& values = spec[name];
+	if (values.is_array()) return std::vector<nlohmann::json>(values.begin(), values.end());
+	return {values};
+}
+// Text form of a string or integer filter value, empty for anything else.
+static std::string filter_text(const nlohmann::json& value) {
+	if (value.is_string()) return value.get<std::string>();
+	if (value.is_number_integer()) return std::to_string(value.get<long long>());
+	return "";
+}
+// Star map position of a system given by id or name.
+static bool filter_system(const nlohmann::json& value, std::size_t& index, std::string& error) {
+	std::string system = filter_text(value);
+	if (!star_map().loaded()) {
+		error = "Star map is not loaded yet!";
+		return false;
+	}
+	if (system.empty() || !star_map().resolve(system, index)) {
+		error = "Unknown system: " + (system.empty() ? value.dump() : system);
+		return false;
+	}
+	return true;
+}
+// Turn a subscribe or unsubscribe body into normalized keys, near filters become the systems they cover.
+static bool parse_filter(const nlohmann::json& spec, IncidentFilter& filter, std::string& error) {
+	if (!spec.is_object()) {
+		error = "Expected an object with systems, tribes, characters, loss_types or near.";
+		return false;
+	}
+	for (const nlohmann::json& value : filter_values(spec, "systems")) {
+		// Ids need no star map, names do.
+		std::string system = filter_text(value);
+		if (!system.empty() && system.find_first_not_of("0123456789") == std::string::npos) {
+			filter.systems.insert(std::stoll(system));
+			continue;
+		}
+		std::size_t index;
+		if (!filter_system(value, index, error)) return false;
+		filter.systems.insert(star_map().ids[index]);
+	}
+	for (const nlohmann::json& value : filter_values(spec, "tribes")) {
+		if (!value.is_string() || value.get<std::string>().empty()) {
+			error = "Tribes are given by name.";
+			return false;
+		}
+		filter.tribes.insert(tribe_filter_key(value.get<std::string>()));
+	}
+	// Numbers are ids and strings are names, anything else says what it is, {"id": ...}, {"name": ...} or {"address": ...}.
+	for (const nlohmann::json& value : filter_values(spec, "characters")) {
+		CharacterKey kind = value.is_number_integer() ? CharacterKey::Id : CharacterKey::Name;
+		std::string character = filter_text(value);
+		if (value.is_object() && value.size() == 1) {
+			auto field = value.begin();
+			if (field.key() == "id") kind = CharacterKey::Id;
+			else if (field.key() == "address") kind = CharacterKey::Address;
+			if (field.key() == "id" || field.key() == "name" || field.key() == "address") character = filter_text(field.value());
+		}
+		std::string key = character.empty() ? "" : character_filter_key(kind, character);
+		if (key.empty() || (kind == CharacterKey::Id && character.find_first_not_of("0123456789") != std::string::npos)) {
+			error = "Characters are given as an id number, a name, or {\"id\": ...}, {\"name\": ...} or {\"address\": ...}.";
+			return false;
+		}
+		filter.characters.insert(std::move(key));
+	}
+	for (const nlohmann::json& value : filter_values(spec, "loss_types")) {
+		std::string loss_type = filter_text(value);
+		if (loss_type == "ship/structure") loss_type = "0";
+		if (loss_type.empty() || loss_type.size() > 9 || loss_type.find_first_not_of("0123456789") != std::string::npos) {
+			error = "Loss types are numbers or ship/structure.";
+			return false;
+		}
+		filter.loss_types.insert(std::stoi(loss_type));
+	}
+	for (const nlohmann::json& value : filter_values(spec, "near")) {
+		if (!value.is_object() || !value.contains("system") || !value.contains("radius") || !value["radius"].is_number()) {
+			error = "Near takes a system and a radius.";
+			return false;
+		}
+		double radius = value["radius"].get<double>();
+		std::size_t origin;
+		if (!filter_system(value["system"], origin, error)) return false;
+		if (!(radius > 0)) {
+			error = "Radius must be positive.";
+			return false;
+		}
+		filter.systems.insert(star_map().ids[origin]);
+		// One past the limit is enough to refuse it.
+		for (const auto& [index, distance] : star_map().within(origin, radius, websocket_filter_limit() + 1)) {
+			filter.systems.insert(star_map().ids[index]);
+		}
+	}
+	return true;
+}
+// Subscribe and unsubscribe control messages, the reply says how many keys the connection now filters on.
+static void handle_subscription(crow::websocket::connection& ws, const nlohmann::json& control) {
+	nlohmann::json response;
+	std::string error;
+	if (control.contains("subscribe") && control["subscribe"] == "all") {
+		mail_broadcaster().match_all(&ws);
+		response["message"] = "Subscribed to every incident.";
+	} else if (control.contains("subscribe")) {
+		IncidentFilter filter;
+		if (!parse_filter(control["subscribe"], filter, error)) {
+			response["error"] = error;
+		} else if (!mail_broadcaster().add_filter(&ws, filter, websocket_filter_limit())) {
+			response["error"] = "Too many filters, the limit is " + std::to_string(websocket_filter_limit()) + ".";
+		} else {
+			response["message"] = "Subscribed.";
+		}
+	} else {
+		IncidentFilter filter;
+		if (!parse_filter(control["unsubscribe"], filter, error)) {
+			response["error"] = error;
+		} else {
+			mail_broadcaster().remove_filter(&ws, filter);
+			response["message"] = "Unsubscribed.";
+		}
+	}
+	response["filters"] = mail_broadcaster().filter_size(&ws);
+	ws.send_text(response.dump());
+}
+// Read the newest incidents after since into the replay log, and again for any older since that came in meanwhile.
+static void backfill_mails(asio::io_context& io, long long since) {
+	std::vector<std::string> params = {std::to_string(since), std::to_string(mail_broadcaster().log_capacity())};
+	async_queries().exec(io, "incident_replay", std::move(params), [&io, since](PgResult res, std::string error) {
+		std::vector<LoggedIncident> incidents;
+		if (!error.empty()) {
+			std::cerr << "Error: Replay backfill failed: " << error << std::endl;
+		} else {
+			try {
+				// Oldest first, framed by the same function as a live incident.
+				for (int i = res.size() - 1; i >= 0; i--) {
+					PgRow row = res[i];
+					IncidentRecord record;
+					record.id = row["id"].as<long long>();
+					record.victim_name = row["victim_name"].as<std::string>();
+					record.victim_address = row["victim_address"].as<std::string>();
+					record.victim_tribe_name = row["victim_tribe_name"].as<std::string>();
+					record.killer_name = row["killer_name"].as<std::string>();
+					record.killer_address = row["killer_address"].as<std::string>();
+					record.killer_tribe_name = row["killer_tribe_name"].as<std::string>();
+					record.solar_system_id = row["solar_system_id"].as<long long>();
+					record.solar_system_name = row["solar_system_name"].as<std::string>();
+					record.loss_type = static_cast<int>(row["loss_type"].as<long long>());
+					record.time_stamp = row["time_stamp"].as<long long>();
+					incidents.push_back(LoggedIncident{record.id, mail_broadcaster().frames(record)});
+				}
+			} catch (const std::exception& e) {
+				std::cerr << "Error: Replay backfill unreadable: " << e.what() << std::endl;
+				error = e.what();
+			}
+		}
+		std::optional<long long> next = mail_broadcaster().backfill(since, std::move(incidents), error.empty());
+		if (next) backfill_mails(io, *next);
+	});
+}
+// What onaccept read from the upgrade request, handed to onopen through the connection's userdata.
+struct MailConnect {
+	WireFormat format = WireFormat::Json;
+	std::optional<long long> since;
+	asio::io_context* io = nullptr;
+};
 // Make sure these are declared
-std::vector<crow::websocket::connection*> ws_connections;
-std::mutex ws_mutex;
-
 void setupWebSocket(crow::SimpleApp& app) {
-	CROW_WEBSOCKET_ROUTE(app, "/mails").onopen([](crow::websocket::connection& ws) {
-		std::cout << "WebSocket connection established." << std::endl;
-		{
-			// Add the new connection to our global list (thread-safe)
-			std::lock_guard<std::mutex> lock(ws_mutex);
-			ws_connections.push_back(&ws);
+	// ?format=json|msgpack|cbor picks the frames, ?since=<incident id> replays what was missed before going live.
+	CROW_WEBSOCKET_ROUTE(app, "/mails").onaccept([](const crow::request& req, void** userdata) {
+		const char* requested = req.url_params.get("format");
+		std::optional<WireFormat> format = requested ? format_from_name(requested) : WireFormat::Json;
+		if (!format) return false;
+		auto connect = std::make_unique<MailConnect>();
+		connect->format = *format;
+		connect->io = req.io_context;
+		if (const char* since = req.url_params.get("since")) {
+			std::string text(since);
+			if (text.empty() || text.size() > 18 || text.find_first_not_of("0123456789") != std::string::npos) return false;
+			connect->since = std::stoll(text);
 		}
-		// Inform the client that they've connected to the notification service.
+		*userdata = connect.release();
+		return true;
+	}).onopen([](crow::websocket::connection& ws) {
+		std::cout << "WebSocket connection established." << std::endl;
+		std::unique_ptr<MailConnect> connect(static_cast<MailConnect*>(ws.userdata()));
+		ws.userdata(nullptr);
+		if (!connect) connect = std::make_unique<MailConnect>();
+		// Inform the client that they've connected to the notification service, ahead of any replayed incident.
 		nlohmann::json msg;
 		msg["message"] = "Connected to alpha-strikes notification service.";
+		msg["format"] = format_name(connect->format);
 		ws.send_text(msg.dump());
+		// Start receiving incidents from the broadcaster, after a replay when resuming.
+		if (!connect->since) {
+			mail_broadcaster().subscribe(&ws, connect->format);
+			return;
+		}
+		std::optional<long long> backfill_since = mail_broadcaster().resume(&ws, connect->format, *connect->since);
+		if (!backfill_since) return;
+		if (connect->io) {
+			backfill_mails(*connect->io, *backfill_since);
+		} else {
+			// Nowhere to run the query, release whoever waits with what the log has.
+			mail_broadcaster().backfill(*backfill_since, {}, false);
+		}
 	}).onclose([](crow::websocket::connection& ws, const std::string& reason, uint16_t close_code) {
 		std::cout << "WebSocket connection closed!" << std::endl;
-		std::lock_guard<std::mutex> lock(ws_mutex);
-		ws_connections.erase(std::remove(ws_connections.begin(), ws_connections.end(), &ws), ws_connections.end());
+		mail_broadcaster().unsubscribe(&ws);
 	}).onmessage([](crow::websocket::connection& ws, const std::string& msg, bool is_binary) {
 		nlohmann::json response;
+		// {"format": "msgpack"} switches the incident frames, control replies stay JSON text.
+		nlohmann::json control = nlohmann::json::parse(msg, nullptr, false);
+		// {"subscribe": {...}} narrows the incidents, {"subscribe": "all"} widens them again.
+		if (control.is_object() && (control.contains("subscribe") || control.contains("unsubscribe"))) {
+			handle_subscription(ws, control);
+			return;
+		}
+		if (control.is_object() && control.contains("format") && control["format"].is_string()) {
+			std::optional<WireFormat> format = format_from_name(control["format"].get<std::string>());
+			if (format) {
+				mail_broadcaster().set_format(&ws, *format);
+				response["message"] = "Incident format changed.";
+				response["format"] = format_name(*format);
+			} else {
+				response["error"] = "Unknown format, use json, msgpack or cbor.";
+			}
+			ws.send_text(response.dump());
+			return;
+		}
 		response["message"] = "Knocking on my door? Join the discord listed on the documentation page!";
 		response["echo"] = msg;
 		ws.send_text(response.dump());
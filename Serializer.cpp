@@ -1,189 +1,260 @@
 #include "Serializer.h"
+#include "SerializerRows.h"
+#include <algorithm>
 // Build incident json
-nlohmann::ordered_json build_incident_json(const pqxx::result& res) {
-	nlohmann::ordered_json json_array = nlohmann::ordered_json::array();
-	for (const auto& row : res) {
-		nlohmann::ordered_json item;
-		item["id"] = row["id"].as<long long>();
-		//item["victim_tribe_name"] = row["victim_tribe_name"].as<std::string>(); // Empty if none presented
-		item["victim_tribe_name"] = row["victim_tribe_name"].as<std::string>().empty() ? "NONE" : row["victim_tribe_name"].as<std::string>();
-		item["victim_address"] = row["victim_address"].as<std::string>();
-		item["victim_name"] = row["victim_name"].as<std::string>();
+void build_incident_json(JsonWriter& out, const pqxx::result& res) {
+	incident_rows(out, res);
+}
+// Build incident json from the in-memory ring, same layout as the query version.
+void build_incident_json(JsonWriter& out, const std::vector<IncidentRecord>& incidents) {
+	out.begin_array();
+	for (const auto& incident : incidents) {
+		out.begin_object();
+		out.field("id", incident.id);
+		out.field("victim_tribe_name", incident.victim_tribe_name.empty() ? "NONE" : incident.victim_tribe_name);
+		out.field("victim_address", incident.victim_address);
+		out.field("victim_name", incident.victim_name);
 		// Hard write "ship" if loss_type is 0
-		item["loss_type"] = (row["loss_type"].as<int>() == 0) ? "ship/structure" : row["loss_type"].as<std::string>();
-		//item["loss_type"] = row["loss_type"].as<std::string>();
-		item["killer_tribe_name"] = row["killer_tribe_name"].as<std::string>().empty() ? "NONE" : row["killer_tribe_name"].as<std::string>();
-		//item["killer_tribe_name"] = row["killer_tribe_name"].as<std::string>(); // Empty if none presented
-		item["killer_address"] = row["killer_address"].as<std::string>();
-		item["killer_name"] = row["killer_name"].as<std::string>();
-		item["time_stamp"] = row["time_stamp"].as<long long>();
-		item["solar_system_id"] = row["solar_system_id"].as<long long>();
-		item["solar_system_name"] = row["solar_system_name"].as<std::string>();
-		json_array.push_back(std::move(item));
+		out.field("loss_type", (incident.loss_type == 0) ? "ship/structure" : std::to_string(incident.loss_type));
+		out.field("killer_tribe_name", incident.killer_tribe_name.empty() ? "NONE" : incident.killer_tribe_name);
+		out.field("killer_address", incident.killer_address);
+		out.field("killer_name", incident.killer_name);
+		out.field("time_stamp", incident.time_stamp);
+		out.field("solar_system_id", incident.solar_system_id);
+		out.field("solar_system_name", incident.solar_system_name);
+		out.end_object();
+	}
+	out.end_array();
+}
+// Keyset page of incidents, next_cursor is null once a short page shows the end was reached.
+void build_incident_page(JsonWriter& out, const pqxx::result& res, long long limit) {
+	incident_page_rows(out, res, limit);
+}
+void build_incident_page(JsonWriter& out, const std::vector<IncidentRecord>& incidents, long long limit) {
+	out.begin_object();
+	out.key("incidents");
+	build_incident_json(out, incidents);
+	out.key("next_cursor");
+	if (limit > 0 && incidents.size() == static_cast<std::size_t>(limit)) {
+		IncidentCursor cursor;
+		cursor.time_stamp = incidents.back().time_stamp;
+		cursor.id = incidents.back().id;
+		out.value(encode_cursor(cursor));
+	} else {
+		out.null();
 	}
-	return json_array;
+	out.end_object();
 }
 // Build system json
-nlohmann::ordered_json build_system_json(const pqxx::result& res) {
-	nlohmann::ordered_json json_array = nlohmann::ordered_json::array();
-	for (const auto& row : res) {
-		nlohmann::ordered_json item;
-		item["solar_system_id"] = row["solar_system_id"].as<long long>();
-		item["solar_system_name"] = row["solar_system_name"].as<std::string>();
-		item["coordinates"] = {
-			{"x", row["x"].as<std::string>()},
-			{"y", row["y"].as<std::string>()},
-			{"z", row["z"].as<std::string>()}
-		};
-		json_array.push_back(std::move(item));
+void build_system_json(JsonWriter& out, const pqxx::result& res) {
+	system_rows(out, res);
+}
+// Build system json from the in-memory star map
+void build_system_json(JsonWriter& out, const StarMap& map, const std::vector<std::size_t>& positions) {
+	out.begin_array();
+	for (std::size_t i : positions) {
+		out.begin_object();
+		out.field("solar_system_id", map.ids[i]);
+		out.field("solar_system_name", map.names[i]);
+		write_coordinates(out, map.x_text[i], map.y_text[i], map.z_text[i]);
+		out.end_object();
 	}
-	return json_array;
+	out.end_array();
 }
-// Format the name json
-nlohmann::ordered_json format_top_names(const pqxx::result& resName) {
-	nlohmann::ordered_json json_array = nlohmann::ordered_json::array();
-	for (const auto& row : resName) {
-		nlohmann::ordered_json item;
-		item["name"] = row["person"].as<std::string>();
-		item["tribe_name"] = row["tribe_name"].as<std::string>();
-		item["total_kills"] = row["total_kills"].as<int>();
-		item["total_losses"] = row["total_losses"].as<int>();
-		json_array.push_back(item);
+// Build neighbouring systems json with their distance
+void build_nearby_json(JsonWriter& out, const StarMap& map, const std::vector<std::pair<std::size_t, double>>& neighbours) {
+	out.begin_array();
+	for (const auto& [i, distance] : neighbours) {
+		out.begin_object();
+		out.field("solar_system_id", map.ids[i]);
+		out.field("solar_system_name", map.names[i]);
+		out.field("distance", distance);
+		write_coordinates(out, map.x_text[i], map.y_text[i], map.z_text[i]);
+		out.end_object();
 	}
-	return json_array;
+	out.end_array();
+}
+// Format the name json
+void format_top_names(JsonWriter& out, const pqxx::result& resName) {
+	top_name_rows(out, resName);
 }
 // Format top killers
-nlohmann::ordered_json format_top_killers(const pqxx::result& resKillers) {
-	nlohmann::ordered_json topKillers = nlohmann::ordered_json::array();
-	for (const auto& row : resKillers) {
-		nlohmann::ordered_json item;
-		item["name"] = row["name"].as<std::string>();
-		item["kills"] = row["incident_count"].as<int>();
-		topKillers.push_back(item);
-	}
-	return topKillers;
+void format_top_killers(JsonWriter& out, const pqxx::result& resKillers) {
+	top_killer_rows(out, resKillers);
 }
 // Format top victims
-nlohmann::ordered_json format_top_victims(const pqxx::result& resVictims) {
-	nlohmann::ordered_json topVictims = nlohmann::ordered_json::array();
-	for (const auto& row : resVictims) {
-		nlohmann::ordered_json item;
-		item["name"] = row["name"].as<std::string>();
-		item["losses"] = row["incident_count"].as<int>();
-		topVictims.push_back(item);
-	}
-	return topVictims;
+void format_top_victims(JsonWriter& out, const pqxx::result& resVictims) {
+	top_victim_rows(out, resVictims);
 }
 // Format top systems
-nlohmann::ordered_json format_top_systems(const pqxx::result& resSystems) {
-	nlohmann::ordered_json topSystems = nlohmann::ordered_json::array();
-	for (const auto& row : resSystems) {
-		nlohmann::ordered_json item;
-		item["solar_system_id"] = row["solar_system_id"].as<std::string>();
-		item["solar_system_name"] = row["solar_system_name"].as<std::string>();
-		item["incident_count"] = row["incident_count"].as<int>();
-		topSystems.push_back(item);
-	}
-	return topSystems;
+void format_top_systems(JsonWriter& out, const pqxx::result& resSystems) {
+	top_system_rows(out, resSystems);
 }
 // Format top tribes
-nlohmann::ordered_json format_top_tribes(const pqxx::result& resTribes) {
-	nlohmann::ordered_json topTribes = nlohmann::ordered_json::array();
-	for (const auto& row : resTribes) {
-		nlohmann::ordered_json item;
-		item["tribe_name"] = row["tribe_name"].as<std::string>();
-		item["total_kills"] = row["kills"].as<long long>();
-		item["total_losses"] = row["losses"].as<long long>();
-		topTribes.push_back(item);
+void format_top_tribes(JsonWriter& out, const pqxx::result& resTribes) {
+	top_tribe_rows(out, resTribes);
+}
+// Same rows from an asynchronous query
+void format_top_names(JsonWriter& out, const PgResult& resName) {
+	top_name_rows(out, resName);
+}
+void format_top_killers(JsonWriter& out, const PgResult& resKillers) {
+	top_killer_rows(out, resKillers);
+}
+void format_top_victims(JsonWriter& out, const PgResult& resVictims) {
+	top_victim_rows(out, resVictims);
+}
+void format_top_systems(JsonWriter& out, const PgResult& resSystems) {
+	top_system_rows(out, resSystems);
+}
+void format_top_tribes(JsonWriter& out, const PgResult& resTribes) {
+	top_tribe_rows(out, resTribes);
+}
+// Format top killers from the in-memory leaderboard
+void format_top_killers(JsonWriter& out, const std::vector<RankingEntry>& killers) {
+	out.begin_array();
+	for (const auto& entry : killers) {
+		out.begin_object();
+		out.field("name", entry.label);
+		out.field("kills", entry.primary);
+		out.end_object();
 	}
-	return topTribes;
+	out.end_array();
 }
-// Format tribe characters
-nlohmann::ordered_json format_tribe_membership(const pqxx::result& resTribes) {
-	nlohmann::ordered_json tribe_json;
-	//std::vector<std::string> members;
-	std::vector<nlohmann::ordered_json> members;
-	// Check if empty.
-	if (resTribes.size() == 0) {
-		nlohmann::json error_json;
-		error_json["error"] = "Not found!";
-		return error_json; // Just in case
+// Format top victims from the in-memory leaderboard
+void format_top_victims(JsonWriter& out, const std::vector<RankingEntry>& victims) {
+	out.begin_array();
+	for (const auto& entry : victims) {
+		out.begin_object();
+		out.field("name", entry.label);
+		out.field("losses", entry.primary);
+		out.end_object();
 	}
-	// Use the first row for tribe_id, tribe_name, tribe_url
-	const auto& first_row = resTribes[0];
-	tribe_json["tribe_id"] = first_row["tribe_id"].as<long long>();
-	tribe_json["tribe_name"] = first_row["tribe_name"].as<std::string>();
-	tribe_json["tribe_url"] = first_row["tribe_url"].as<std::string>();
-	// Run through all names that are members for display.
-	for (const auto& row : resTribes) {
-		nlohmann::ordered_json member;
-		member["member_address"] = row["member_address"].as<std::string>();
-		member["member_name"] = row["member_name"].as<std::string>();
-		members.push_back(member);
+	out.end_array();
+}
+// Format top systems from the in-memory leaderboard
+void format_top_systems(JsonWriter& out, const std::vector<RankingEntry>& systems) {
+	out.begin_array();
+	for (const auto& entry : systems) {
+		out.begin_object();
+		out.field("solar_system_id", entry.key);
+		out.field("solar_system_name", entry.label);
+		out.field("incident_count", entry.primary);
+		out.end_object();
 	}
-	// Check to see if we are represented.
-	if (!members.empty()) {
-		tribe_json["members"] = members;
-		tribe_json["member_count"] = first_row["member_count"].as<long long>(); 
-	} else {
-		tribe_json["members"] = "No members found!";
+	out.end_array();
+}
+// Format top tribes from the in-memory leaderboard
+void format_top_tribes(JsonWriter& out, const std::vector<RankingEntry>& tribes) {
+	out.begin_array();
+	for (const auto& entry : tribes) {
+		out.begin_object();
+		out.field("tribe_name", entry.label);
+		out.field("total_kills", entry.primary);
+		out.field("total_losses", entry.secondary);
+		out.end_object();
 	}
-	//tribe_json["members"] = members;
-	// Return the json
-	return tribe_json;
+	out.end_array();
+}
+// Format tribe characters
+void format_tribe_membership(JsonWriter& out, const pqxx::result& resTribes) {
+	tribe_membership_rows(out, resTribes);
+}
+// Keyset page of tribe members, the tribe fields come from the page's first row.
+void format_tribe_page(JsonWriter& out, const pqxx::result& resTribes, long long limit) {
+	tribe_page_rows(out, resTribes, limit);
 }
 // Format tribe information without membership listing
-nlohmann::ordered_json format_tribes(const pqxx::result& resTribes) {
-	nlohmann::ordered_json json_array = nlohmann::ordered_json::array();
-	// Tribes without members display
-	for (const auto& row : resTribes) {
-		nlohmann::ordered_json item;
-		item["tribe_id"] = row["tribe_id"].as<long long>();
-		item["tribe_name"] = row["tribe_name"].as<std::string>();
-		item["tribe_url"] = row["tribe_url"].is_null() ? "NONE" : row["tribe_url"].as<std::string>();
-		item["member_count"] = row["member_count"].as<long long>(); 
-		json_array.push_back(item);
-	}
-	// Return the json
-	return json_array;
+void format_tribes(JsonWriter& out, const pqxx::result& resTribes) {
+	tribe_rows(out, resTribes);
 }
 // Format character tribe history
-nlohmann::ordered_json format_characters(const pqxx::result& resChars) {
-	// Mapping characters
-	std::map<std::string, nlohmann::ordered_json> characters;
-	// Running through each character
-	for (const auto& row : resChars) {
-		std::string address = row["character_address"].as<std::string>();
-		std::string name = row["name"].as<std::string>();
-		std::string tribe = row["tribe_name"].as<std::string>();
-		//long long left_date = row["left_at"].as<long long>();
-		long long left_date = row["left_at"].is_null() ? -1 : row["left_at"].as<long long>(); // Checking for null, sentinel value
-		// If first time seeing this character, set current tribe
-		if (characters.find(address) == characters.end()) {
-			nlohmann::ordered_json char_array;
-			char_array["character_address"] = address;
-			char_array["character_name"] = name;
-			char_array["current_tribe"] = tribe;
-			char_array["history"] = nlohmann::ordered_json::array();
-			characters[address] = char_array;
-		}
-		// Add the tribe to history regardless
-		nlohmann::ordered_json history_item;
-		history_item["tribe_name"] = tribe;
-		//history_item["left_date"] = left_date;
-		// If left_at is null, show "CURRENT", else show actual value
-		if (row["left_at"].is_null()) {
-			history_item["left_date"] = "CURRENT";
-		} else {
-			history_item["left_date"] = row["left_at"].as<long long>();
+void format_characters(JsonWriter& out, const pqxx::result& resChars) {
+	character_rows(out, resChars);
+}
+// Name totals from the per-character stats, current tribes from the dimension cache.
+void format_top_names(JsonWriter& out, const std::vector<CharacterTotals>& totals, const DimensionSnapshot& dims) {
+	out.begin_array();
+	for (const CharacterTotals& row : totals) {
+		std::string_view tribe_name;
+		auto character = dims.characters->find(row.id);
+		if (character != dims.characters->end()) {
+			for (const MembershipDim& membership : character->second->memberships) {
+				if (!membership.current) continue;
+				auto tribe = dims.tribes->find(membership.tribe_id);
+				if (tribe != dims.tribes->end()) tribe_name = tribe->second->name;
+				break;
+			}
 		}
-		characters[address]["history"].push_back(history_item);
+		out.begin_object();
+		out.field("name", row.name);
+		out.field("tribe_name", tribe_name);
+		out.field("total_kills", row.kills);
+		out.field("total_losses", row.losses);
+		out.end_object();
+	}
+	out.end_array();
+}
+// Character tribe history from the dimension cache, same shape and order as the SQL rows.
+void format_characters(JsonWriter& out, const DimensionSnapshot& dims, const std::vector<std::string>& ids) {
+	// Membership windows per character address, a character without any still gets one empty row.
+	std::map<std::string_view, std::vector<std::pair<const CharacterDim*, const MembershipDim*>>> characters;
+	for (const std::string& id : ids) {
+		auto it = dims.characters->find(id);
+		if (it == dims.characters->end()) continue;
+		const CharacterDim* character = it->second.get();
+		auto& rows = characters[character->address];
+		if (character->memberships.empty()) rows.emplace_back(character, nullptr);
+		for (const MembershipDim& membership : character->memberships) rows.emplace_back(character, &membership);
 	}
+	// Current membership first, then the most recently joined.
+	auto newer = [](const auto& a, const auto& b) {
+		bool current_a = !a.second || a.second->current;
+		bool current_b = !b.second || b.second->current;
+		if (current_a != current_b) return current_a;
+		return (a.second ? a.second->joined_at : 0) > (b.second ? b.second->joined_at : 0);
+	};
+	auto tribe_name = [&](const MembershipDim* membership) -> std::string_view {
+		if (!membership) return {};
+		auto it = dims.tribes->find(membership->tribe_id);
+		return it == dims.tribes->end() ? std::string_view() : std::string_view(it->second->name);
+	};
 	// Put it all together
-	nlohmann::ordered_json json_array = nlohmann::ordered_json::array();
-	for (auto& [address, char_array] : characters) {
-		json_array.push_back(char_array);
+	out.begin_array();
+	for (auto& [address, rows] : characters) {
+		std::stable_sort(rows.begin(), rows.end(), newer);
+		out.begin_object();
+		out.field("character_address", address);
+		out.field("character_name", rows.front().first->name);
+		out.field("current_tribe", tribe_name(rows.front().second));
+		out.key("history");
+		out.begin_array();
+		for (const auto& [character, membership] : rows) {
+			out.begin_object();
+			out.field("tribe_name", tribe_name(membership));
+			if (!membership || membership->current) {
+				out.field("left_date", "CURRENT");
+			} else {
+				out.field("left_date", membership->left_at);
+			}
+			out.end_object();
+		}
+		out.end_array();
+		out.end_object();
+	}
+	out.end_array();
+}
+// Autocomplete matches, best first.
+void format_suggestions(JsonWriter& out, const std::vector<CharacterSuggestion>& suggestions) {
+	out.begin_array();
+	for (const CharacterSuggestion& suggestion : suggestions) {
+		out.begin_object();
+		out.field("character_id", suggestion.id);
+		out.field("character_name", suggestion.character ? std::string_view(suggestion.character->name) : std::string_view());
+		out.field("character_address", suggestion.character ? std::string_view(suggestion.character->address) : std::string_view());
+		out.field("kills", suggestion.kills);
+		out.field("losses", suggestion.losses);
+		out.end_object();
 	}
-	// Return the json
-	return json_array;
+	out.end_array();
 }
@@ -1,15 +1,40 @@
 #pragma once
 #include <pqxx/pqxx>
-#include <nlohmann/json.hpp>
-// All serializer functions
-//nlohmann::ordered_json build_health_json(const pqxx::result& res);
-nlohmann::ordered_json build_incident_json(const pqxx::result& res);
-nlohmann::ordered_json build_system_json(const pqxx::result& res);
-nlohmann::ordered_json format_top_names(const pqxx::result& resName);
-nlohmann::ordered_json format_top_killers(const pqxx::result& resKillers);
-nlohmann::ordered_json format_top_victims(const pqxx::result& resVictims);
-nlohmann::ordered_json format_top_systems(const pqxx::result& resSystems);
-nlohmann::ordered_json format_top_tribes(const pqxx::result& resTribes);
-nlohmann::ordered_json format_tribe_membership(const pqxx::result& resTribes);
-nlohmann::ordered_json format_tribes(const pqxx::result& resTribes);
-nlohmann::ordered_json format_characters(const pqxx::result& resChars);
+#include "JsonWriter.h"
+#include "IncidentRing.h"
+#include "Leaderboard.h"
+#include "StarMap.h"
+#include "Cursor.h"
+#include "DimensionCache.h"
+#include "CharacterStats.h"
+#include "PgResult.h"
+// All serializer functions, each streams straight into the writer.
+//void build_health_json(JsonWriter& out, const pqxx::result& res);
+void build_incident_json(JsonWriter& out, const pqxx::result& res);
+void build_incident_json(JsonWriter& out, const std::vector<IncidentRecord>& incidents);
+void build_incident_page(JsonWriter& out, const pqxx::result& res, long long limit);
+void build_incident_page(JsonWriter& out, const std::vector<IncidentRecord>& incidents, long long limit);
+void build_system_json(JsonWriter& out, const pqxx::result& res);
+void build_system_json(JsonWriter& out, const StarMap& map, const std::vector<std::size_t>& positions);
+void build_nearby_json(JsonWriter& out, const StarMap& map, const std::vector<std::pair<std::size_t, double>>& neighbours);
+void format_top_names(JsonWriter& out, const pqxx::result& resName);
+void format_top_names(JsonWriter& out, const std::vector<CharacterTotals>& totals, const DimensionSnapshot& dims);
+void format_top_killers(JsonWriter& out, const pqxx::result& resKillers);
+void format_top_victims(JsonWriter& out, const pqxx::result& resVictims);
+void format_top_systems(JsonWriter& out, const pqxx::result& resSystems);
+void format_top_tribes(JsonWriter& out, const pqxx::result& resTribes);
+void format_top_names(JsonWriter& out, const PgResult& resName);
+void format_top_killers(JsonWriter& out, const PgResult& resKillers);
+void format_top_victims(JsonWriter& out, const PgResult& resVictims);
+void format_top_systems(JsonWriter& out, const PgResult& resSystems);
+void format_top_tribes(JsonWriter& out, const PgResult& resTribes);
+void format_top_killers(JsonWriter& out, const std::vector<RankingEntry>& killers);
+void format_top_victims(JsonWriter& out, const std::vector<RankingEntry>& victims);
+void format_top_systems(JsonWriter& out, const std::vector<RankingEntry>& systems);
+void format_top_tribes(JsonWriter& out, const std::vector<RankingEntry>& tribes);
+void format_tribe_membership(JsonWriter& out, const pqxx::result& resTribes);
+void format_tribe_page(JsonWriter& out, const pqxx::result& resTribes, long long limit);
+void format_tribes(JsonWriter& out, const pqxx::result& resTribes);
+void format_characters(JsonWriter& out, const pqxx::result& resChars);
+void format_characters(JsonWriter& out, const DimensionSnapshot& dims, const std::vector<std::string>& ids);
+void format_suggestions(JsonWriter& out, const std::vector<CharacterSuggestion>& suggestions);
@@ -0,0 +1,369 @@
+// Serializer micro benchmark, feeds synthetic rowsets through the serializers without a database.
+// Usage: serializer_bench [rows] [milliseconds per case] [case name filter]
+#include "Serializer.h"
+#include "SerializerRows.h"
+#include <chrono>
+#include <charconv>
+#include <cstdio>
+#include <cstdlib>
+#include <functional>
+#include <new>
+#include <optional>
+#include <random>
+#include <string>
+#include <vector>
+// Every allocation the process makes, the timed loops read the difference.
+static std::size_t allocations = 0;
+void* operator new(std::size_t size) {
+	allocations++;
+	if (void* memory = std::malloc(size == 0 ? 1 : size)) return memory;
+	throw std::bad_alloc();
+}
+void operator delete(void* memory) noexcept {
+	std::free(memory);
+}
+void operator delete(void* memory, std::size_t) noexcept {
+	std::free(memory);
+}
+class FixtureRows;
+// Text of one cell, parsed on demand like pqxx does.
+class FixtureField {
+	// Public Members
+	public:
+		explicit FixtureField(const std::optional<std::string>* cell) : cell(cell) {}
+		bool is_null() const { return !cell->has_value(); }
+		std::string_view view() const { return is_null() ? std::string_view() : std::string_view(**cell); }
+		template <typename T>
+		T as() const {
+			T parsed{};
+			std::string_view text = view();
+			std::from_chars(text.data(), text.data() + text.size(), parsed);
+			return parsed;
+		}
+	// Private Members
+	private:
+		const std::optional<std::string>* cell;
+};
+// Row handle, columns are looked up by name on every access like pqxx::row.
+class FixtureRow {
+	// Public Members
+	public:
+		FixtureRow(const FixtureRows* rows, std::size_t index) : rows(rows), index(index) {}
+		FixtureField operator[](const char* column) const;
+	// Private Members
+	private:
+		const FixtureRows* rows;
+		std::size_t index;
+};
+// In memory stand in for pqxx::result, row major text cells.
+class FixtureRows {
+	// Public Members
+	public:
+		struct const_iterator {
+			const FixtureRows* rows;
+			std::size_t index;
+			FixtureRow operator*() const { return FixtureRow(rows, index); }
+			const_iterator& operator++() { index++; return *this; }
+			bool operator!=(const const_iterator& other) const { return index != other.index; }
+		};
+		explicit FixtureRows(std::vector<std::string> columns) : columns(std::move(columns)) {}
+		void add(std::vector<std::optional<std::string>> row) {
+			for (auto& cell : row) cells.push_back(std::move(cell));
+		}
+		std::size_t size() const { return columns.empty() ? 0 : cells.size() / columns.size(); }
+		FixtureRow operator[](std::size_t index) const { return FixtureRow(this, index); }
+		const_iterator begin() const { return {this, 0}; }
+		const_iterator end() const { return {this, size()}; }
+		const std::optional<std::string>* cell(std::size_t row, const char* column) const {
+			for (std::size_t c = 0; c < columns.size(); c++) {
+				if (columns[c] == column) return &cells[row * columns.size() + c];
+			}
+			std::fprintf(stderr, "Fixture has no column %s\n", column);
+			std::abort();
+		}
+	// Private Members
+	private:
+		std::vector<std::string> columns;
+		std::vector<std::optional<std::string>> cells;
+};
+FixtureField FixtureRow::operator[](const char* column) const {
+	return FixtureField(rows->cell(index, column));
+}
+// Deterministic data so runs compare against each other.
+static std::mt19937_64 random_source(42);
+static long long random_number(long long lo, long long hi) {
+	return std::uniform_int_distribution<long long>(lo, hi)(random_source);
+}
+// Hex address shaped like the real ones
+static std::string random_address() {
+	static const char hex[] = "0123456789abcdef";
+	std::string address = "0x";
+	for (int i = 0; i < 40; i++) address.push_back(hex[random_number(0, 15)]);
+	return address;
+}
+static std::string random_name(const char* prefix) {
+	return std::string(prefix) + "-" + std::to_string(random_number(1, 99999999));
+}
+// Rowset fixtures, columns as the catalog statements return them
+static FixtureRows incident_fixture(std::size_t rows) {
+	FixtureRows fixture({"id", "victim_tribe_name", "victim_address", "victim_name", "loss_type", "killer_tribe_name",
+		"killer_address", "killer_name", "time_stamp", "solar_system_id", "solar_system_name"});
+	for (std::size_t i = 0; i < rows; i++) {
+		fixture.add({std::to_string(1000000 + i), random_number(0, 3) ? random_name("tribe") : "", random_address(), random_name("victim"),
+			std::to_string(random_number(0, 2)), random_number(0, 3) ? random_name("tribe") : "", random_address(), random_name("killer"),
+			std::to_string(1700000000 - static_cast<long long>(i) * 60), std::to_string(30000000 + random_number(0, 24000)), random_name("system")});
+	}
+	return fixture;
+}
+static FixtureRows system_fixture(std::size_t rows) {
+	FixtureRows fixture({"solar_system_id", "solar_system_name", "x", "y", "z"});
+	for (std::size_t i = 0; i < rows; i++) {
+		fixture.add({std::to_string(30000000 + i), random_name("system"), std::to_string(random_number(-1000000000, 1000000000)) + "e9",
+			std::to_string(random_number(-1000000000, 1000000000)) + "e9", std::to_string(random_number(-1000000000, 1000000000)) + "e9"});
+	}
+	return fixture;
+}
+static FixtureRows top_name_fixture(std::size_t rows) {
+	FixtureRows fixture({"person", "tribe_name", "total_kills", "total_losses"});
+	for (std::size_t i = 0; i < rows; i++) {
+		fixture.add({random_name("pilot"), random_name("tribe"), std::to_string(random_number(0, 5000)), std::to_string(random_number(0, 5000))});
+	}
+	return fixture;
+}
+static FixtureRows top_count_fixture(std::size_t rows) {
+	FixtureRows fixture({"name", "incident_count"});
+	for (std::size_t i = 0; i < rows; i++) {
+		fixture.add({random_name("pilot"), std::to_string(random_number(0, 5000))});
+	}
+	return fixture;
+}
+static FixtureRows top_system_fixture(std::size_t rows) {
+	FixtureRows fixture({"solar_system_id", "solar_system_name", "incident_count"});
+	for (std::size_t i = 0; i < rows; i++) {
+		fixture.add({std::to_string(30000000 + i), random_name("system"), std::to_string(random_number(0, 5000))});
+	}
+	return fixture;
+}
+static FixtureRows top_tribe_fixture(std::size_t rows) {
+	FixtureRows fixture({"tribe_name", "kills", "losses"});
+	for (std::size_t i = 0; i < rows; i++) {
+		fixture.add({random_name("tribe"), std::to_string(random_number(0, 5000)), std::to_string(random_number(0, 5000))});
+	}
+	return fixture;
+}
+// One tribe with every row a member
+static FixtureRows member_fixture(std::size_t rows) {
+	FixtureRows fixture({"tribe_id", "tribe_name", "tribe_url", "member_count", "member_address", "member_name", "member_id"});
+	for (std::size_t i = 0; i < rows; i++) {
+		fixture.add({"98000001", "Synthetic Tribe", "https://example.com/tribe", std::to_string(rows), random_address(), random_name("pilot"),
+			std::to_string(2112000000 + i)});
+	}
+	return fixture;
+}
+static FixtureRows tribe_fixture(std::size_t rows) {
+	FixtureRows fixture({"tribe_id", "tribe_name", "tribe_url", "member_count"});
+	for (std::size_t i = 0; i < rows; i++) {
+		std::optional<std::string> url;
+		if (random_number(0, 1)) url = "https://example.com/" + std::to_string(i);
+		fixture.add({std::to_string(98000000 + i), random_name("tribe"), url, std::to_string(random_number(1, 500))});
+	}
+	return fixture;
+}
+// Characters with one to four memberships each, the current one first.
+static FixtureRows character_fixture(std::size_t rows) {
+	FixtureRows fixture({"character_address", "name", "tribe_name", "left_at"});
+	std::size_t added = 0;
+	while (added < rows) {
+		std::string address = random_address();
+		std::string name = random_name("pilot");
+		long long history = random_number(1, 4);
+		for (long long h = 0; h < history && added < rows; h++, added++) {
+			std::optional<std::string> left_at;
+			if (h > 0) left_at = std::to_string(1700000000 - h * 86400);
+			fixture.add({address, name, random_name("tribe"), left_at});
+		}
+	}
+	return fixture;
+}
+// Typed fixtures for the in-memory overloads
+static std::vector<IncidentRecord> incident_records(std::size_t rows) {
+	std::vector<IncidentRecord> records(rows);
+	for (std::size_t i = 0; i < rows; i++) {
+		IncidentRecord& record = records[i];
+		record.id = 1000000 + static_cast<long long>(i);
+		record.victim_name = random_name("victim");
+		record.victim_address = random_address();
+		record.victim_tribe_name = random_number(0, 3) ? random_name("tribe") : "";
+		record.killer_name = random_name("killer");
+		record.killer_address = random_address();
+		record.killer_tribe_name = random_number(0, 3) ? random_name("tribe") : "";
+		record.solar_system_id = 30000000 + random_number(0, 24000);
+		record.solar_system_name = random_name("system");
+		record.loss_type = static_cast<int>(random_number(0, 2));
+		record.time_stamp = 1700000000 - static_cast<long long>(i) * 60;
+	}
+	return records;
+}
+static std::vector<RankingEntry> ranking_entries(std::size_t rows) {
+	std::vector<RankingEntry> entries(rows);
+	for (auto& entry : entries) {
+		entry.key = random_address();
+		entry.label = random_name("pilot");
+		entry.primary = random_number(0, 5000);
+		entry.secondary = random_number(0, 5000);
+	}
+	return entries;
+}
+// Only the public columns, the serializers never touch the k-d tree.
+static void fill_star_map(StarMap& map, std::size_t rows) {
+	for (std::size_t i = 0; i < rows; i++) {
+		map.ids.push_back(30000000 + static_cast<long long>(i));
+		map.names.push_back(random_name("system"));
+		map.x_text.push_back(std::to_string(random_number(-1000000000, 1000000000)) + "e9");
+		map.y_text.push_back(std::to_string(random_number(-1000000000, 1000000000)) + "e9");
+		map.z_text.push_back(std::to_string(random_number(-1000000000, 1000000000)) + "e9");
+	}
+}
+// Characters with one to four memberships, the newest current, rows counts the memberships like the SQL rowset.
+static DimensionSnapshot dimension_snapshot(std::size_t rows, std::vector<std::string>& ids) {
+	auto characters = std::make_shared<CharacterMap>();
+	auto tribes = std::make_shared<TribeMap>();
+	for (long long t = 0; t < 500; t++) {
+		tribes->emplace(98000000 + t, std::make_shared<const TribeDim>(TribeDim{random_name("tribe"), "https://example.com/" + std::to_string(t)}));
+	}
+	std::size_t added = 0;
+	while (added < rows) {
+		auto character = std::make_shared<CharacterDim>();
+		character->name = random_name("pilot");
+		character->address = random_address();
+		long long history = random_number(1, 4);
+		for (long long h = 0; h < history && added < rows; h++, added++) {
+			MembershipDim membership;
+			membership.tribe_id = 98000000 + random_number(0, 499);
+			membership.joined_at = 1700000000 - (h + 1) * 86400;
+			membership.left_at = h > 0 ? 1700000000 - h * 86400 : 0;
+			membership.current = h == 0;
+			character->memberships.push_back(membership);
+		}
+		ids.push_back(std::to_string(2112000000 + ids.size()));
+		characters->emplace(ids.back(), std::move(character));
+	}
+	DimensionSnapshot dims;
+	dims.characters = std::move(characters);
+	dims.tribes = std::move(tribes);
+	return dims;
+}
+static std::vector<CharacterSuggestion> character_suggestions(const DimensionSnapshot& dims, const std::vector<std::string>& ids, std::size_t rows) {
+	std::vector<CharacterSuggestion> suggestions(rows);
+	for (std::size_t i = 0; i < rows; i++) {
+		CharacterSuggestion& suggestion = suggestions[i];
+		suggestion.id = ids[i % ids.size()];
+		suggestion.character = dims.characters->at(suggestion.id).get();
+		suggestion.kills = random_number(0, 5000);
+		suggestion.losses = random_number(0, 5000);
+	}
+	return suggestions;
+}
+// Name totals for characters the snapshot knows, so every row looks up a current tribe.
+static std::vector<CharacterTotals> character_totals(const DimensionSnapshot& dims, const std::vector<std::string>& ids, std::size_t rows) {
+	std::vector<CharacterTotals> totals(rows);
+	for (std::size_t i = 0; i < rows; i++) {
+		CharacterTotals& row = totals[i];
+		row.id = ids[i % ids.size()];
+		row.name = dims.characters->at(row.id)->name;
+		row.kills = random_number(0, 5000);
+		row.losses = random_number(0, 5000);
+	}
+	return totals;
+}
+// One benchmark case, rows is what the per row figures divide by.
+struct BenchCase {
+	std::string name;
+	std::size_t rows;
+	std::function<void(JsonWriter&)> serialize;
+};
+// Run a case until the time budget is used and print its figures.
+static void run_case(const BenchCase& bench, std::chrono::milliseconds budget) {
+	std::string& buffer = response_buffer();
+	// Warm up, so the buffer already has its capacity like on a busy worker.
+	buffer.clear();
+	{
+		JsonWriter out(buffer);
+		bench.serialize(out);
+	}
+	std::size_t iterations = 0;
+	std::size_t allocations_before = allocations;
+	auto start = std::chrono::steady_clock::now();
+	auto elapsed = std::chrono::steady_clock::duration::zero();
+	while (elapsed < budget || iterations == 0) {
+		buffer.clear();
+		JsonWriter out(buffer);
+		bench.serialize(out);
+		iterations++;
+		elapsed = std::chrono::steady_clock::now() - start;
+	}
+	std::size_t allocated = allocations - allocations_before;
+	double rows = static_cast<double>(iterations) * (bench.rows == 0 ? 1 : bench.rows);
+	double ns = static_cast<double>(std::chrono::duration_cast<std::chrono::nanoseconds>(elapsed).count());
+	std::printf("%-34s %8zu %10zu %12.1f %12.2f %12zu %10.1f\n", bench.name.c_str(), bench.rows, iterations, ns / rows,
+		allocated / rows, buffer.size(), static_cast<double>(buffer.size()) / (bench.rows == 0 ? 1 : bench.rows));
+}
+int main(int argc, char* argv[]) {
+	std::size_t rows = argc > 1 ? std::strtoull(argv[1], nullptr, 10) : 1000;
+	std::chrono::milliseconds budget(argc > 2 ? std::strtoll(argv[2], nullptr, 10) : 250);
+	std::string filter = argc > 3 ? argv[3] : "";
+	if (rows == 0) rows = 1;
+	// Fixtures are built once, outside the timed loops.
+	FixtureRows incidents = incident_fixture(rows);
+	FixtureRows systems = system_fixture(rows);
+	FixtureRows top_names = top_name_fixture(rows);
+	FixtureRows top_counts = top_count_fixture(rows);
+	FixtureRows top_systems = top_system_fixture(rows);
+	FixtureRows top_tribes = top_tribe_fixture(rows);
+	FixtureRows members = member_fixture(rows);
+	FixtureRows tribes = tribe_fixture(rows);
+	FixtureRows characters = character_fixture(rows);
+	std::vector<IncidentRecord> records = incident_records(rows);
+	std::vector<RankingEntry> ranking = ranking_entries(rows);
+	StarMap map;
+	fill_star_map(map, rows);
+	std::vector<std::string> character_ids;
+	DimensionSnapshot dims = dimension_snapshot(rows, character_ids);
+	std::vector<CharacterSuggestion> suggestions = character_suggestions(dims, character_ids, rows);
+	std::vector<CharacterTotals> totals = character_totals(dims, character_ids, rows);
+	std::vector<std::size_t> positions(rows);
+	std::vector<std::pair<std::size_t, double>> neighbours(rows);
+	for (std::size_t i = 0; i < rows; i++) {
+		positions[i] = i;
+		neighbours[i] = {i, static_cast<double>(random_number(0, 1000000000)) / 7.0};
+	}
+	long long limit = static_cast<long long>(rows);
+	std::vector<BenchCase> cases = {
+		{"build_incident_json/rows", rows, [&](JsonWriter& out) { incident_rows(out, incidents); }},
+		{"build_incident_json/ring", rows, [&](JsonWriter& out) { build_incident_json(out, records); }},
+		{"build_incident_page/rows", rows, [&](JsonWriter& out) { incident_page_rows(out, incidents, limit); }},
+		{"build_incident_page/ring", rows, [&](JsonWriter& out) { build_incident_page(out, records, limit); }},
+		{"build_system_json/rows", rows, [&](JsonWriter& out) { system_rows(out, systems); }},
+		{"build_system_json/star_map", rows, [&](JsonWriter& out) { build_system_json(out, map, positions); }},
+		{"build_nearby_json", rows, [&](JsonWriter& out) { build_nearby_json(out, map, neighbours); }},
+		{"format_top_names/rows", rows, [&](JsonWriter& out) { top_name_rows(out, top_names); }},
+		{"format_top_names/totals", rows, [&](JsonWriter& out) { format_top_names(out, totals, dims); }},
+		{"format_top_killers/rows", rows, [&](JsonWriter& out) { top_killer_rows(out, top_counts); }},
+		{"format_top_killers/ranking", rows, [&](JsonWriter& out) { format_top_killers(out, ranking); }},
+		{"format_top_victims/rows", rows, [&](JsonWriter& out) { top_victim_rows(out, top_counts); }},
+		{"format_top_systems/rows", rows, [&](JsonWriter& out) { top_system_rows(out, top_systems); }},
+		{"format_top_tribes/rows", rows, [&](JsonWriter& out) { top_tribe_rows(out, top_tribes); }},
+		{"format_tribe_membership", rows, [&](JsonWriter& out) { tribe_membership_rows(out, members); }},
+		{"format_tribe_page", rows, [&](JsonWriter& out) { tribe_page_rows(out, members, limit); }},
+		{"format_tribes", rows, [&](JsonWriter& out) { tribe_rows(out, tribes); }},
+		{"format_characters/rows", rows, [&](JsonWriter& out) { character_rows(out, characters); }},
+		{"format_characters/dimensions", rows, [&](JsonWriter& out) { format_characters(out, dims, character_ids); }},
+		{"format_suggestions", rows, [&](JsonWriter& out) { format_suggestions(out, suggestions); }},
+	};
+	std::printf("%-34s %8s %10s %12s %12s %12s %10s\n", "case", "rows", "iters", "ns/row", "allocs/row", "bytes", "bytes/row");
+	for (const auto& bench : cases) {
+		if (!filter.empty() && bench.name.find(filter) == std::string::npos) continue;
+		run_case(bench, budget);
+	}
+	return 0;
+}
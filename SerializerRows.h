@@ -0,0 +1,256 @@
+#pragma once
+#include <map>
+#include <vector>
+#include <string_view>
+#include "JsonWriter.h"
+#include "Cursor.h"
+// Row walking serializers behind the pqxx::result overloads in Serializer.h. Rows is anything shaped like a
+// pqxx::result, rows indexed by column name with fields offering view(), as<long long>() and is_null(), so the
+// serializer bench can feed synthetic rowsets through exactly the code the routes run.
+// Integer column, spelled out once so the templates do not need .template everywhere.
+template <typename Field>
+long long number_field(const Field& field) {
+	return field.template as<long long>();
+}
+// Coordinates object shared by the system serializers.
+inline void write_coordinates(JsonWriter& out, std::string_view x, std::string_view y, std::string_view z) {
+	out.key("coordinates");
+	out.begin_object();
+	out.field("x", x);
+	out.field("y", y);
+	out.field("z", z);
+	out.end_object();
+}
+// Build incident json
+template <typename Rows>
+void incident_rows(JsonWriter& out, const Rows& res) {
+	out.begin_array();
+	for (const auto& row : res) {
+		out.begin_object();
+		out.field("id", number_field(row["id"]));
+		//out.field("victim_tribe_name", row["victim_tribe_name"].view()); // Empty if none presented
+		std::string_view victim_tribe_name = row["victim_tribe_name"].view();
+		out.field("victim_tribe_name", victim_tribe_name.empty() ? "NONE" : victim_tribe_name);
+		out.field("victim_address", row["victim_address"].view());
+		out.field("victim_name", row["victim_name"].view());
+		// Hard write "ship" if loss_type is 0
+		std::string_view loss_type = row["loss_type"].view();
+		out.field("loss_type", loss_type == "0" ? "ship/structure" : loss_type);
+		std::string_view killer_tribe_name = row["killer_tribe_name"].view();
+		out.field("killer_tribe_name", killer_tribe_name.empty() ? "NONE" : killer_tribe_name);
+		out.field("killer_address", row["killer_address"].view());
+		out.field("killer_name", row["killer_name"].view());
+		out.field("time_stamp", number_field(row["time_stamp"]));
+		out.field("solar_system_id", number_field(row["solar_system_id"]));
+		out.field("solar_system_name", row["solar_system_name"].view());
+		out.end_object();
+	}
+	out.end_array();
+}
+// Keyset page of incidents, next_cursor is null once a short page shows the end was reached.
+template <typename Rows>
+void incident_page_rows(JsonWriter& out, const Rows& res, long long limit) {
+	out.begin_object();
+	out.key("incidents");
+	incident_rows(out, res);
+	out.key("next_cursor");
+	if (limit > 0 && static_cast<long long>(res.size()) == limit) {
+		const auto& last = res[res.size() - 1];
+		IncidentCursor cursor;
+		cursor.time_stamp = number_field(last["time_stamp"]);
+		cursor.id = number_field(last["id"]);
+		out.value(encode_cursor(cursor));
+	} else {
+		out.null();
+	}
+	out.end_object();
+}
+// Build system json
+template <typename Rows>
+void system_rows(JsonWriter& out, const Rows& res) {
+	out.begin_array();
+	for (const auto& row : res) {
+		out.begin_object();
+		out.field("solar_system_id", number_field(row["solar_system_id"]));
+		out.field("solar_system_name", row["solar_system_name"].view());
+		write_coordinates(out, row["x"].view(), row["y"].view(), row["z"].view());
+		out.end_object();
+	}
+	out.end_array();
+}
+// Format the name json
+template <typename Rows>
+void top_name_rows(JsonWriter& out, const Rows& resName) {
+	out.begin_array();
+	for (const auto& row : resName) {
+		out.begin_object();
+		out.field("name", row["person"].view());
+		out.field("tribe_name", row["tribe_name"].view());
+		out.field("total_kills", number_field(row["total_kills"]));
+		out.field("total_losses", number_field(row["total_losses"]));
+		out.end_object();
+	}
+	out.end_array();
+}
+// Format top killers
+template <typename Rows>
+void top_killer_rows(JsonWriter& out, const Rows& resKillers) {
+	out.begin_array();
+	for (const auto& row : resKillers) {
+		out.begin_object();
+		out.field("name", row["name"].view());
+		out.field("kills", number_field(row["incident_count"]));
+		out.end_object();
+	}
+	out.end_array();
+}
+// Format top victims
+template <typename Rows>
+void top_victim_rows(JsonWriter& out, const Rows& resVictims) {
+	out.begin_array();
+	for (const auto& row : resVictims) {
+		out.begin_object();
+		out.field("name", row["name"].view());
+		out.field("losses", number_field(row["incident_count"]));
+		out.end_object();
+	}
+	out.end_array();
+}
+// Format top systems
+template <typename Rows>
+void top_system_rows(JsonWriter& out, const Rows& resSystems) {
+	out.begin_array();
+	for (const auto& row : resSystems) {
+		out.begin_object();
+		out.field("solar_system_id", row["solar_system_id"].view());
+		out.field("solar_system_name", row["solar_system_name"].view());
+		out.field("incident_count", number_field(row["incident_count"]));
+		out.end_object();
+	}
+	out.end_array();
+}
+// Format top tribes
+template <typename Rows>
+void top_tribe_rows(JsonWriter& out, const Rows& resTribes) {
+	out.begin_array();
+	for (const auto& row : resTribes) {
+		out.begin_object();
+		out.field("tribe_name", row["tribe_name"].view());
+		out.field("total_kills", number_field(row["kills"]));
+		out.field("total_losses", number_field(row["losses"]));
+		out.end_object();
+	}
+	out.end_array();
+}
+// Member rows of a tribe listing
+template <typename Rows>
+void member_rows(JsonWriter& out, const Rows& resTribes) {
+	out.key("members");
+	out.begin_array();
+	for (const auto& row : resTribes) {
+		out.begin_object();
+		out.field("member_address", row["member_address"].view());
+		out.field("member_name", row["member_name"].view());
+		out.end_object();
+	}
+	out.end_array();
+}
+// Format tribe characters
+template <typename Rows>
+void tribe_membership_rows(JsonWriter& out, const Rows& resTribes) {
+	// Check if empty.
+	if (resTribes.size() == 0) {
+		out.begin_object();
+		out.field("error", "Not found!");
+		out.end_object();
+		return; // Just in case
+	}
+	// Use the first row for tribe_id, tribe_name, tribe_url
+	const auto& first_row = resTribes[0];
+	out.begin_object();
+	out.field("tribe_id", number_field(first_row["tribe_id"]));
+	out.field("tribe_name", first_row["tribe_name"].view());
+	out.field("tribe_url", first_row["tribe_url"].view());
+	// Run through all names that are members for display, there is at least one row here.
+	member_rows(out, resTribes);
+	out.field("member_count", number_field(first_row["member_count"]));
+	out.end_object();
+}
+// Keyset page of tribe members, the tribe fields come from the page's first row.
+template <typename Rows>
+void tribe_page_rows(JsonWriter& out, const Rows& resTribes, long long limit) {
+	out.begin_object();
+	if (resTribes.size() != 0) {
+		const auto& first_row = resTribes[0];
+		out.field("tribe_id", number_field(first_row["tribe_id"]));
+		out.field("tribe_name", first_row["tribe_name"].view());
+		out.field("tribe_url", first_row["tribe_url"].view());
+		out.field("member_count", number_field(first_row["member_count"]));
+	}
+	member_rows(out, resTribes);
+	out.key("next_cursor");
+	if (limit > 0 && static_cast<long long>(resTribes.size()) == limit) {
+		const auto& last = resTribes[resTribes.size() - 1];
+		TribeCursor cursor;
+		cursor.tribe_id = number_field(last["tribe_id"]);
+		cursor.member_name = std::string(last["member_name"].view());
+		cursor.member_id = std::string(last["member_id"].view());
+		out.value(encode_cursor(cursor));
+	} else {
+		out.null();
+	}
+	out.end_object();
+}
+// Format tribe information without membership listing
+template <typename Rows>
+void tribe_rows(JsonWriter& out, const Rows& resTribes) {
+	out.begin_array();
+	// Tribes without members display
+	for (const auto& row : resTribes) {
+		out.begin_object();
+		out.field("tribe_id", number_field(row["tribe_id"]));
+		out.field("tribe_name", row["tribe_name"].view());
+		out.field("tribe_url", row["tribe_url"].is_null() ? std::string_view("NONE") : row["tribe_url"].view());
+		out.field("member_count", number_field(row["member_count"]));
+		out.end_object();
+	}
+	out.end_array();
+}
+// Format character tribe history
+template <typename Rows>
+void character_rows(JsonWriter& out, const Rows& resChars) {
+	// Rows per character address, in address order like before.
+	using size_type = decltype(resChars.size());
+	std::map<std::string_view, std::vector<size_type>> characters;
+	for (size_type i = 0; i < resChars.size(); i++) {
+		characters[resChars[i]["character_address"].view()].push_back(i);
+	}
+	// Put it all together
+	out.begin_array();
+	for (const auto& [address, rows] : characters) {
+		// The first row seen sets the name and current tribe.
+		const auto& first_row = resChars[rows.front()];
+		out.begin_object();
+		out.field("character_address", address);
+		out.field("character_name", first_row["name"].view());
+		out.field("current_tribe", first_row["tribe_name"].view());
+		// Add the tribe to history regardless
+		out.key("history");
+		out.begin_array();
+		for (auto i : rows) {
+			const auto& row = resChars[i];
+			out.begin_object();
+			out.field("tribe_name", row["tribe_name"].view());
+			// If left_at is null, show "CURRENT", else show actual value
+			if (row["left_at"].is_null()) {
+				out.field("left_date", "CURRENT");
+			} else {
+				out.field("left_date", number_field(row["left_at"]));
+			}
+			out.end_object();
+		}
+		out.end_array();
+		out.end_object();
+	}
+	out.end_array();
+}
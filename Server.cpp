@@ -1,16 +1,61 @@
 #include "Server.h"
 #include "Routes.h"
 #include "pgListener.h"
+#include "ConnectionPool.h"
+#include "AsyncQuery.h"
+#include "StarMap.h"
+#include "DimensionCache.h"
+#include "Env.h"
+#include <iostream>
 #include <signal.h>
 #include <chrono>
+#include <future>
+#include <algorithm>
+#include <stdexcept>
+#include <cstdlib> // For getenv
+#ifdef __linux__
+#include <pthread.h>
+#include <sched.h>
+#endif
 // Graceful shutdown procedures, bool value set.
 std::atomic<bool> shutdown_requested(false);
 // Handle system level status signal
 void signal_handler(int signal) {
 	if (signal == SIGINT || signal == SIGTERM) shutdown_requested = true;
 }
+// SERVER_BIND, SERVER_PORT, SERVER_SHARDS, SERVER_THREADS and SERVER_CPU_AFFINITY
+static ServerConfig server_config() {
+	ServerConfig config;
+	if (const char* bind = std::getenv("SERVER_BIND")) config.bind_address = bind;
+	std::size_t port = env_size("SERVER_PORT", config.port);
+	config.shards = env_size("SERVER_SHARDS", 1);
+	// Every shard's port has to exist, a wrapped one would bind something unrelated.
+	if (port > 65535 || config.shards > 65536 - port) {
+		throw std::runtime_error("SERVER_PORT " + std::to_string(port) + " with " + std::to_string(config.shards)
+			+ " shards reaches past port 65535.");
+	}
+	config.port = static_cast<std::uint16_t>(port);
+	config.threads = env_size("SERVER_THREADS", 0);
+	const char* pin = std::getenv("SERVER_CPU_AFFINITY");
+	config.pin = pin && (std::string(pin) == "1" || std::string(pin) == "true");
+	if (config.threads == 0) {
+		config.threads = std::max<std::size_t>(1, std::max(1u, std::thread::hardware_concurrency()) / config.shards);
+	}
+	return config;
+}
+#ifdef __linux__
+// CPUs this process may run on, in order.
+static std::vector<int> allowed_cpus(const cpu_set_t& mask) {
+	std::vector<int> cpus;
+	for (int cpu = 0; cpu < CPU_SETSIZE; cpu++) {
+		if (CPU_ISSET(cpu, &mask)) cpus.push_back(cpu);
+	}
+	return cpus;
+}
+#endif
 // System level signals setup.
-Server::Server() {
+Server::Server() : config(server_config()) {
+	size_connection_pool(config.threads * config.shards);
 	signal(SIGINT, signal_handler);
 	signal(SIGTERM, signal_handler);
 	setup();
@@ -21,8 +66,11 @@ Server::~Server() {
 }
 // Step up server app for routes.
 void Server::setup() {
-	setupRoutes(app);
-	setupWebSocket(app);
+	for (std::size_t shard = 0; shard < config.shards; shard++) {
+		apps.push_back(std::make_unique<crow::SimpleApp>());
+		setupRoutes(*apps.back());
+		setupWebSocket(*apps.back());
+	}
 }
 // Set up postgresql thread.
 void Server::startPgListener() {
@@ -30,10 +78,73 @@ void Server::startPgListener() {
 }
 // Start server and run asynchronously.
 void Server::run() {
+	// Open the pooled connections before taking traffic.
+	try {
+		get_connection_pool().warm_up();
+	} catch (const std::exception& e) {
+		std::cerr << "Error: " << e.what() << std::endl;
+	}
+	// Non-blocking connections for the /totals queries.
+	async_queries().open();
+	// Systems never change at runtime, /location falls back to the database until this succeeds.
+	try {
+		auto conn = get_connection_pool().acquire();
+		star_map().load(*conn);
+	} catch (const std::exception& e) {
+		std::cerr << "Error: Star map not loaded: " << e.what() << std::endl;
+	}
+	// Characters, tribes and memberships, the listener keeps them current from here on.
+	try {
+		auto conn = get_connection_pool().acquire();
+		dimensions().load(*conn);
+	} catch (const std::exception& e) {
+		std::cerr << "Error: Dimension cache not loaded: " << e.what() << std::endl;
+	}
+	// The listener seeds the incident ring, leaderboards and character stats once it is listening.
 	startPgListener();
-	app.bindaddr("0.0.0.0").port(8080).multithreaded().run_async();
-	while (!shutdown_requested) std::this_thread::sleep_for(std::chrono::milliseconds(100));
-	app.stop();
+	// Threads inherit the affinity of the thread creating them, so each shard is started with its slice set here.
+#ifdef __linux__
+	cpu_set_t original;
+	CPU_ZERO(&original);
+	pthread_getaffinity_np(pthread_self(), sizeof(original), &original);
+	std::vector<int> cpus = allowed_cpus(original);
+#endif
+	std::vector<std::future<void>> running;
+	for (std::size_t shard = 0; shard < apps.size(); shard++) {
+		std::string placement = "any CPU";
+#ifdef __linux__
+		if (config.pin && !cpus.empty()) {
+			// Contiguous slices, a shard gets at least one CPU even when there are more shards than CPUs.
+			std::size_t first = shard * cpus.size() / apps.size();
+			std::size_t last = std::max(first + 1, (shard + 1) * cpus.size() / apps.size());
+			cpu_set_t slice;
+			CPU_ZERO(&slice);
+			placement = "CPUs";
+			for (std::size_t i = first; i < last && i < cpus.size(); i++) {
+				CPU_SET(cpus[i], &slice);
+				placement += " " + std::to_string(cpus[i]);
+			}
+			pthread_setaffinity_np(pthread_self(), sizeof(slice), &slice);
+		}
+#endif
+		std::uint16_t port = static_cast<std::uint16_t>(config.port + shard);
+		running.push_back(apps[shard]->bindaddr(config.bind_address).port(port).concurrency(static_cast<std::uint16_t>(config.threads)).run_async());
+		std::cout << "Shard " << shard << " listening on port " << port << " with " << config.threads << " workers on " << placement << "." << std::endl;
+	}
+#ifdef __linux__
+	pthread_setaffinity_np(pthread_self(), sizeof(original), &original);
+#endif
+	// Run until asked to stop, or until any shard stops on its own.
+	auto any_stopped = [&running] {
+		for (auto& shard : running) {
+			if (shard.wait_for(std::chrono::seconds(0)) == std::future_status::ready) return true;
+		}
+		return false;
+	};
+	while (!shutdown_requested && !any_stopped()) std::this_thread::sleep_for(std::chrono::milliseconds(100));
+	shutdown_requested = true;
+	for (auto& app : apps) app->stop();
+	for (auto& shard : running) shard.wait();
 	if (pg_listener.joinable()) {
 		pg_listener.join();
 	}
@@ -44,7 +155,12 @@ void Server::stop() {
 }
 // Where we tie everyting together.
 int main() {
-	Server server;
-	server.run();
+	try {
+		Server server;
+		server.run();
+	} catch (const std::exception& e) {
+		std::cerr << "Error: " << e.what() << std::endl;
+		return 1;
+	}
 	return 0;
 }
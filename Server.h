@@ -2,6 +2,17 @@
 #include "crow.h"
 #include <thread>
 #include <atomic>
+#include <memory>
+#include <string>
+#include <vector>
+// Listening setup read from the environment.
+struct ServerConfig {
+	std::string bind_address = "0.0.0.0";
+	std::uint16_t port = 8080;
+	std::size_t shards = 1; // Apps on consecutive ports, each with its own acceptor and workers
+	std::size_t threads = 0; // Workers per shard, 0 splits the hardware threads across the shards
+	bool pin = false; // Give every shard its own slice of the allowed CPUs
+};
 // Server Object
 class Server {
 	// Public Members
@@ -11,7 +22,8 @@ class Server {
 		void run();
 	// Private Members 
 	private:
-		crow::SimpleApp app;
+		ServerConfig config;
+		std::vector<std::unique_ptr<crow::SimpleApp>> apps;
 		std::thread pg_listener;
 		void setup();
 		void startPgListener();
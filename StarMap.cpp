@@ -0,0 +1,181 @@
+#include "StarMap.h"
+#include "QueryCatalog.h"
+#include <algorithm>
+#include <queue>
+#include <cctype>
+#include <cmath>
+#include <functional>
+#include <iostream>
+// Lower case copy for case insensitive matching.
+static std::string to_lower(std::string text) {
+	std::transform(text.begin(), text.end(), text.begin(), [](unsigned char c) { return std::tolower(c); });
+	return text;
+}
+// Read the systems table once and build the tree.
+void StarMap::load(pqxx::connection& conn) {
+	pqxx::work txn(conn);
+	pqxx::result res = exec_statement(txn, "systems_all");
+	txn.commit();
+	std::size_t count = res.size();
+	ids.reserve(count);
+	names.reserve(count);
+	lower_names.reserve(count);
+	x.reserve(count);
+	y.reserve(count);
+	z.reserve(count);
+	x_text.reserve(count);
+	y_text.reserve(count);
+	z_text.reserve(count);
+	for (const auto& row : res) {
+		std::size_t index = ids.size();
+		ids.push_back(row["solar_system_id"].as<long long>());
+		names.push_back(row["solar_system_name"].as<std::string>());
+		lower_names.push_back(to_lower(names.back()));
+		x_text.push_back(row["x"].as<std::string>());
+		y_text.push_back(row["y"].as<std::string>());
+		z_text.push_back(row["z"].as<std::string>());
+		x.push_back(std::stod(x_text.back()));
+		y.push_back(std::stod(y_text.back()));
+		z.push_back(std::stod(z_text.back()));
+		by_id.emplace(ids.back(), index);
+		by_name.emplace(lower_names.back(), index);
+	}
+	tree.resize(count);
+	for (std::size_t i = 0; i < count; i++) tree[i] = i;
+	build(0, count, 0);
+	ready.store(true, std::memory_order_release);
+	std::cout << "Star map loaded with " << count << " systems." << std::endl;
+}
+// Coordinate along an axis
+double StarMap::coordinate(std::size_t index, int axis) const {
+	return axis == 0 ? x[index] : (axis == 1 ? y[index] : z[index]);
+}
+double StarMap::distance_squared(std::size_t a, std::size_t b) const {
+	double dx = x[a] - x[b];
+	double dy = y[a] - y[b];
+	double dz = z[a] - z[b];
+	return dx * dx + dy * dy + dz * dz;
+}
+// Put the median of the range in the middle and recurse on both halves.
+void StarMap::build(std::size_t lo, std::size_t hi, int depth) {
+	if (hi - lo <= 1) return;
+	int axis = depth % 3;
+	std::size_t mid = lo + (hi - lo) / 2;
+	std::nth_element(tree.begin() + lo, tree.begin() + mid, tree.begin() + hi, [&](std::size_t a, std::size_t b) {
+		return coordinate(a, axis) < coordinate(b, axis);
+	});
+	build(lo, mid, depth + 1);
+	build(mid + 1, hi, depth + 1);
+}
+// Substring match on name or id, like ILIKE '%text%'.
+std::vector<std::size_t> StarMap::search(const std::string& text) const {
+	std::string needle = to_lower(text);
+	std::vector<std::size_t> matches;
+	for (std::size_t i = 0; i < ids.size(); i++) {
+		if (lower_names[i].find(needle) != std::string::npos || std::to_string(ids[i]).find(needle) != std::string::npos) {
+			matches.push_back(i);
+		}
+	}
+	return matches;
+}
+// Every system in table order
+std::vector<std::size_t> StarMap::all() const {
+	std::vector<std::size_t> positions(ids.size());
+	for (std::size_t i = 0; i < positions.size(); i++) positions[i] = i;
+	return positions;
+}
+// Position of a system by id
+bool StarMap::find(long long id, std::size_t& index) const {
+	auto it = by_id.find(id);
+	if (it == by_id.end()) return false;
+	index = it->second;
+	return true;
+}
+// Exact id first, then exact name.
+bool StarMap::resolve(const std::string& system, std::size_t& index) const {
+	try {
+		std::size_t used = 0;
+		long long id = std::stoll(system, &used);
+		auto it = by_id.find(id);
+		if (used == system.size() && it != by_id.end()) {
+			index = it->second;
+			return true;
+		}
+	} catch (const std::exception&) {
+		// Not a number, try the name.
+	}
+	auto it = by_name.find(to_lower(system));
+	if (it == by_name.end()) return false;
+	index = it->second;
+	return true;
+}
+// Every system inside the radius, closest first.
+std::vector<std::pair<std::size_t, double>> StarMap::within(std::size_t origin, double radius, std::size_t limit) const {
+	std::vector<std::pair<std::size_t, double>> found;
+	double radius_squared = radius * radius;
+	std::function<void(std::size_t, std::size_t, int)> visit = [&](std::size_t lo, std::size_t hi, int depth) {
+		if (lo >= hi) return;
+		std::size_t mid = lo + (hi - lo) / 2;
+		std::size_t node = tree[mid];
+		double d = distance_squared(origin, node);
+		if (node != origin && d <= radius_squared) found.emplace_back(node, d);
+		int axis = depth % 3;
+		double delta = coordinate(origin, axis) - coordinate(node, axis);
+		// Near side first, far side only when the sphere crosses the split.
+		if (delta <= 0) {
+			visit(lo, mid, depth + 1);
+			if (delta * delta <= radius_squared) visit(mid + 1, hi, depth + 1);
+		} else {
+			visit(mid + 1, hi, depth + 1);
+			if (delta * delta <= radius_squared) visit(lo, mid, depth + 1);
+		}
+	};
+	visit(0, tree.size(), 0);
+	std::sort(found.begin(), found.end(), [](const auto& a, const auto& b) { return a.second < b.second; });
+	if (found.size() > limit) found.resize(limit);
+	for (auto& entry : found) entry.second = std::sqrt(entry.second);
+	return found;
+}
+// The count closest systems.
+std::vector<std::pair<std::size_t, double>> StarMap::nearest(std::size_t origin, std::size_t count) const {
+	// Max heap on distance holding the best candidates so far.
+	auto farther = [](const std::pair<std::size_t, double>& a, const std::pair<std::size_t, double>& b) { return a.second < b.second; };
+	std::priority_queue<std::pair<std::size_t, double>, std::vector<std::pair<std::size_t, double>>, decltype(farther)> best(farther);
+	if (count == 0) return {};
+	std::function<void(std::size_t, std::size_t, int)> visit = [&](std::size_t lo, std::size_t hi, int depth) {
+		if (lo >= hi) return;
+		std::size_t mid = lo + (hi - lo) / 2;
+		std::size_t node = tree[mid];
+		if (node != origin) {
+			double d = distance_squared(origin, node);
+			if (best.size() < count) {
+				best.emplace(node, d);
+			} else if (d < best.top().second) {
+				best.pop();
+				best.emplace(node, d);
+			}
+		}
+		int axis = depth % 3;
+		double delta = coordinate(origin, axis) - coordinate(node, axis);
+		std::size_t near_lo = delta <= 0 ? lo : mid + 1;
+		std::size_t near_hi = delta <= 0 ? mid : hi;
+		std::size_t far_lo = delta <= 0 ? mid + 1 : lo;
+		std::size_t far_hi = delta <= 0 ? hi : mid;
+		visit(near_lo, near_hi, depth + 1);
+		if (best.size() < count || delta * delta < best.top().second) visit(far_lo, far_hi, depth + 1);
+	};
+	visit(0, tree.size(), 0);
+	std::vector<std::pair<std::size_t, double>> found;
+	found.reserve(best.size());
+	while (!best.empty()) {
+		found.emplace_back(best.top().first, std::sqrt(best.top().second));
+		best.pop();
+	}
+	std::reverse(found.begin(), found.end());
+	return found;
+}
+// Process wide star map
+StarMap& star_map() {
+	static StarMap map;
+	return map;
+}
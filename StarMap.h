@@ -0,0 +1,46 @@
+#pragma once
+#include <pqxx/pqxx>
+#include <string>
+#include <vector>
+#include <atomic>
+#include <unordered_map>
+#include <utility>
+// Solar systems as parallel columns with a 3D k-d tree over the coordinates.
+class StarMap {
+	// Public Members
+	public:
+		void load(pqxx::connection& conn);
+		bool loaded() const { return ready.load(std::memory_order_acquire); }
+		std::size_t size() const { return ids.size(); }
+		// Positions whose name or id contains the text, ignoring case.
+		std::vector<std::size_t> search(const std::string& text) const;
+		std::vector<std::size_t> all() const;
+		// Position of a system by exact id or name.
+		bool resolve(const std::string& system, std::size_t& index) const;
+		bool find(long long id, std::size_t& index) const;
+		// Neighbours of a system, closest first, the system itself excluded.
+		std::vector<std::pair<std::size_t, double>> within(std::size_t origin, double radius, std::size_t limit) const;
+		std::vector<std::pair<std::size_t, double>> nearest(std::size_t origin, std::size_t count) const;
+		// Columns
+		std::vector<long long> ids;
+		std::vector<std::string> names;
+		std::vector<double> x;
+		std::vector<double> y;
+		std::vector<double> z;
+		// Coordinates as stored, served unchanged by /location.
+		std::vector<std::string> x_text;
+		std::vector<std::string> y_text;
+		std::vector<std::string> z_text;
+	// Private Members
+	private:
+		void build(std::size_t lo, std::size_t hi, int depth);
+		double coordinate(std::size_t index, int axis) const;
+		double distance_squared(std::size_t a, std::size_t b) const;
+		std::vector<std::string> lower_names;
+		std::unordered_map<long long, std::size_t> by_id;
+		std::unordered_map<std::string, std::size_t> by_name;
+		std::vector<std::size_t> tree; // Implicit tree, the median of each range is its node.
+		std::atomic<bool> ready{false};
+};
+// Process wide star map, loaded once at startup.
+StarMap& star_map();
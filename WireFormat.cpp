@@ -0,0 +1,61 @@
+#include "WireFormat.h"
+#include "HeaderList.h"
+#include <nlohmann/json.hpp>
+#include <algorithm>
+#include <cstdint>
+#include <vector>
+// Walk the comma separated media ranges, a binary format has to beat JSON outright to be picked.
+WireFormat negotiate_format(const std::string& accept) {
+	double json_q = -1.0;
+	double msgpack_q = -1.0;
+	double cbor_q = -1.0;
+	double any_q = -1.0;
+	for (const WeightedToken& entry : weighted_tokens(accept)) {
+		const std::string& range = entry.token;
+		double q = entry.q;
+		if (range == "application/json") json_q = q;
+		else if (range == "application/msgpack" || range == "application/x-msgpack" || range == "application/vnd.msgpack") msgpack_q = std::max(msgpack_q, q);
+		else if (range == "application/cbor") cbor_q = q;
+		else if (range == "*/*" || range == "application/*") any_q = std::max(any_q, q);
+	}
+	// Wildcards only ever stand in for JSON.
+	if (json_q < 0) json_q = any_q;
+	if (msgpack_q <= 0 && cbor_q <= 0) return WireFormat::Json;
+	if (msgpack_q >= cbor_q) return msgpack_q > json_q ? WireFormat::MsgPack : WireFormat::Json;
+	return cbor_q > json_q ? WireFormat::Cbor : WireFormat::Json;
+}
+std::optional<WireFormat> format_from_name(std::string_view name) {
+	if (name == "json") return WireFormat::Json;
+	if (name == "msgpack") return WireFormat::MsgPack;
+	if (name == "cbor") return WireFormat::Cbor;
+	return std::nullopt;
+}
+const char* format_name(WireFormat format) {
+	switch (format) {
+		case WireFormat::MsgPack: return "msgpack";
+		case WireFormat::Cbor: return "cbor";
+		default: return "json";
+	}
+}
+const char* format_content_type(WireFormat format) {
+	switch (format) {
+		case WireFormat::MsgPack: return "application/msgpack";
+		case WireFormat::Cbor: return "application/cbor";
+		default: return "application/json";
+	}
+}
+// One parse, one encode. JSON goes back out as it came in.
+std::string transcode_json(const std::string& json, WireFormat format) {
+	if (format == WireFormat::Json) return json;
+	return encode_document(nlohmann::ordered_json::parse(json), format);
+}
+// Only the public byte vector overloads, the frames are then carried as strings.
+std::string encode_document(const nlohmann::ordered_json& document, WireFormat format) {
+	std::vector<std::uint8_t> bytes;
+	switch (format) {
+		case WireFormat::MsgPack: bytes = nlohmann::ordered_json::to_msgpack(document); break;
+		case WireFormat::Cbor: bytes = nlohmann::ordered_json::to_cbor(document); break;
+		default: return document.dump(4);
+	}
+	return std::string(bytes.begin(), bytes.end());
+}
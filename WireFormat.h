@@ -0,0 +1,23 @@
+#pragma once
+#include <string>
+#include <string_view>
+#include <optional>
+#include <nlohmann/json_fwd.hpp>
+// Payload formats we can send, JSON is always the default.
+enum class WireFormat {
+	Json,
+	MsgPack,
+	Cbor
+};
+constexpr std::size_t wire_format_count = 3;
+// Pick MessagePack or CBOR from an Accept header when it ranks them above JSON, honouring q=0.
+WireFormat negotiate_format(const std::string& accept);
+// Format from its short name, json, msgpack or cbor.
+std::optional<WireFormat> format_from_name(std::string_view name);
+const char* format_name(WireFormat format);
+// Content-Type header value
+const char* format_content_type(WireFormat format);
+// Re-encode a JSON document, key order is kept so binary maps read like the JSON objects.
+std::string transcode_json(const std::string& json, WireFormat format);
+// Encode a parsed document, JSON comes out pretty printed like the REST bodies.
+std::string encode_document(const nlohmann::ordered_json& document, WireFormat format);
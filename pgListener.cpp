@@ -5,9 +5,23 @@
 #include <mutex>
 #include <thread>
 #include <iostream>
-#include "Routes.h" // for ws_connections and ws_mutex
+#include "Broadcaster.h"
+#include "ConnectionPool.h"
+#include "QueryCatalog.h"
+#include "IncidentRing.h"
+#include "Leaderboard.h"
+#include "CharacterStats.h"
+#include "DimensionCache.h"
+#include "ResponseCache.h"
+#include "Metrics.h"
+#include "Env.h"
 #include <cstdlib> // For getenv
 #include <string>
+#include <optional>
+#include <algorithm>
+#include <unordered_map>
+#include <deque>
+#include <chrono>
 // Direct Connection
 std::string get_direct_connection_string() {
 	const char* dbname = std::getenv("PGDIRECT_DB");
@@ -26,145 +40,426 @@ std::string get_direct_connection_string() {
            	" host=" + std::string(host) +
            	" port=" + std::string(port);
 }
-// Notification Object is public
+// Text form of an id the trigger may send as a number or a string.
+static std::string id_text(const nlohmann::ordered_json& value) {
+	if (value.is_string()) return value.get<std::string>();
+	if (value.is_number_integer()) return std::to_string(value.get<long long>());
+	return "";
+}
+// Largest batch drained before enriching, from LISTENER_BATCH_SIZE.
+static std::size_t listener_batch_limit() {
+	static const std::size_t limit = env_size("LISTENER_BATCH_SIZE", 500);
+	return limit;
+}
+// Parsed payload and when it came off the socket, for the broadcast lag histogram.
+struct ReceivedIncident {
+	nlohmann::ordered_json payload;
+	std::chrono::steady_clock::time_point received_at;
+};
+// Receive stage, only parses and queues so a burst is drained before any enrichment.
 class NotifyListener : public pqxx::notification_receiver {
 	// Public members
 	public:
-		NotifyListener(pqxx::connection_base &conn, const std::string &channel)
-        		: pqxx::notification_receiver(conn, channel) {}
+		NotifyListener(pqxx::connection_base &conn, const std::string &channel, std::vector<ReceivedIncident>& batch)
+        		: pqxx::notification_receiver(conn, channel), batch(batch) {}
 	// Operations method overriden
 	void operator()(const std::string &payload, int) override {
-        	std::lock_guard<std::mutex> lock(ws_mutex);
-        	nlohmann::ordered_json filtered_json;
-        	nlohmann::ordered_json parsed_json;
 		// Try loading json to serialize
 		try {
-			parsed_json = nlohmann::json::parse(payload);
+			batch.push_back(ReceivedIncident{nlohmann::ordered_json::parse(payload), std::chrono::steady_clock::now()});
 		} catch (const nlohmann::json::parse_error& e) {
-			throw std::runtime_error("Failed to parse JSON: " + std::string(e.what()));
+			std::cerr << "Error: Failed to parse JSON: " << e.what() << std::endl;
 		}
-		// Check json string from incident trigger channel in postgresql
-		//std::cout << parsed_json.dump(4) << std::endl;
-		// Time to initialize the postgresql connection
-		pqxx::connection conn(get_pool_connection_string());
-		pqxx::work txn(conn);
-		// Get victim information
-		std::string victim_name, victim_tribe_name, victim_address;
+	}
+	// Private members
+	private:
+		std::vector<ReceivedIncident>& batch;
+};
+// How long character changes are held back to be applied together, from DIMENSION_REFRESH_MS.
+static std::chrono::milliseconds dimension_refresh_interval() {
+	static const std::chrono::milliseconds interval(env_size("DIMENSION_REFRESH_MS", 1000));
+	return interval;
+}
+// Ids named by dimension change notifications, collected until the next refresh.
+struct DimensionChanges {
+	std::vector<std::string> characters;
+	std::vector<long long> tribes;
+	bool reload = false;
+	std::chrono::steady_clock::time_point since; // When the oldest pending change arrived
+	bool empty() const { return characters.empty() && tribes.empty() && !reload; }
+};
+// Receive stage for character, membership and tribe changes. The payload is the id, bare or as {"id": ...}.
+class DimensionListener : public pqxx::notification_receiver {
+	// Public members
+	public:
+		DimensionListener(pqxx::connection_base &conn, const std::string &channel, const std::string &id_key, DimensionChanges& changes)
+        		: pqxx::notification_receiver(conn, channel), id_key(id_key), changes(changes) {}
+	// Operations method overriden
+	void operator()(const std::string &payload, int) override {
+		if (changes.empty()) changes.since = std::chrono::steady_clock::now();
+		std::string id;
 		try {
-			pqxx::result v_res = txn.exec_params("SELECT c.name, t.name, encode(c.address, 'hex') "
-						"FROM characters c "
-						"LEFT JOIN character_tribe_membership ctm "
-						"ON c.id = ctm.character_id "
-						"AND ctm.joined_at <= $2 "
-						"AND (ctm.left_at IS NULL OR ctm.left_at > $2) "
-						"LEFT JOIN tribes t ON ctm.tribe_id = t.id "
-						"WHERE c.id = $1 LIMIT 1;",
-						parsed_json["victim_id"].get<std::string>(),
-						parsed_json["time_stamp"].get<long long>());
-			// Check query information and store.
-			if (!v_res.empty()) {
-				victim_name = v_res[0][0].as<std::string>();
-				victim_tribe_name = v_res[0][1].is_null() ? "" : v_res[0][1].as<std::string>();
-				victim_address = v_res[0][2].is_null() ? "" : v_res[0][2].as<std::string>();
-			}
-		} catch (const std::exception& e) {
-			// Default in case there is an issue with database.
-			victim_name = "";
-			victim_tribe_name = "";
-			victim_address = "";
-			std::cerr << "Error: " << e.what() << std::endl;
+			nlohmann::ordered_json parsed = nlohmann::ordered_json::parse(payload);
+			id = parsed.is_object() ? id_text(parsed.contains(id_key) ? parsed[id_key] : parsed["id"]) : id_text(parsed);
+		} catch (const nlohmann::json::parse_error&) {
+			id = payload;
 		}
-		// Get killer information
-		std::string killer_name, killer_tribe_name, killer_address;
-		try {
-			pqxx::result k_res = txn.exec_params("SELECT c.name, t.name, encode(c.address, 'hex') "
-						"FROM characters c "
-						"LEFT JOIN character_tribe_membership ctm "
-						"ON c.id = ctm.character_id "
-						"AND ctm.joined_at <= $2 "
-						"AND (ctm.left_at IS NULL OR ctm.left_at > $2) "
-						"LEFT JOIN tribes t ON ctm.tribe_id = t.id "
-						"WHERE c.id = $1 LIMIT 1;",
-						parsed_json["killer_id"].get<std::string>(),
-						parsed_json["time_stamp"].get<long long>());
-			// Check query information and store.
-			if (!k_res.empty()) {
-				killer_name = k_res[0][0].as<std::string>();
-				killer_tribe_name = k_res[0][1].is_null() ? "" : k_res[0][1].as<std::string>();
-				killer_address = k_res[0][2].is_null() ? "" : k_res[0][2].as<std::string>();
+		// Nothing we can target, read everything again.
+		if (id.empty() || id.find_first_not_of("0123456789") != std::string::npos) {
+			changes.reload = true;
+			return;
+		}
+		if (id_key == "tribe_id") {
+			changes.tribes.push_back(std::stoll(id));
+		} else {
+			changes.characters.push_back(id);
+		}
+	}
+	// Private members
+	private:
+		std::string id_key;
+		DimensionChanges& changes;
+};
+// A tribe membership window of one character.
+struct Membership {
+	long long joined_at = 0;
+	long long left_at = 0;
+	bool current = false;
+	std::string tribe_name;
+};
+// Character names, addresses and memberships for a batch.
+struct CharacterInfo {
+	std::string name;
+	std::string address;
+	std::vector<Membership> memberships;
+};
+// Names for everything a batch refers to, from one round trip.
+struct BatchLookup {
+	std::unordered_map<std::string, CharacterInfo> characters;
+	std::unordered_map<std::string, std::string> systems;
+};
+// Tribe the character belonged to when the incident happened, empty when none.
+static std::string tribe_at(const CharacterInfo& character, long long time_stamp) {
+	for (const auto& membership : character.memberships) {
+		if (membership.joined_at <= time_stamp && (membership.current || membership.left_at > time_stamp)) {
+			return membership.tribe_name;
+		}
+	}
+	return "";
+}
+// Ids, loss type and time from the trigger payload, the enrich stage fills in the names.
+static IncidentRecord record_from_payload(const nlohmann::ordered_json& parsed_json) {
+	IncidentRecord record;
+	record.id = parsed_json["id"].is_string() ? std::stoll(parsed_json["id"].get<std::string>()) : parsed_json["id"].get<long long>();
+	record.victim_id = id_text(parsed_json["victim_id"]);
+	record.killer_id = id_text(parsed_json["killer_id"]);
+	record.solar_system_id = std::stoll(id_text(parsed_json["solar_system_id"]));
+	record.loss_type = parsed_json["loss_type"].is_number_integer()
+		? parsed_json["loss_type"].get<int>()
+		: std::stoi(parsed_json["loss_type"].get<std::string>());
+	record.time_stamp = parsed_json["time_stamp"].is_string() ? std::stoll(parsed_json["time_stamp"].get<std::string>()) : parsed_json["time_stamp"].get<long long>();
+	return record;
+}
+// Enrich stage without the dimension cache, victims, killers, memberships and systems for the whole batch in a single query.
+static BatchLookup enrich_batch(pqxx::connection& conn, const std::vector<IncidentRecord>& records) {
+	std::vector<std::string> character_ids;
+	std::vector<std::string> system_ids;
+	long long earliest = 0;
+	long long latest = 0;
+	for (const auto& record : records) {
+		character_ids.push_back(record.victim_id);
+		character_ids.push_back(record.killer_id);
+		system_ids.push_back(std::to_string(record.solar_system_id));
+		earliest = (earliest == 0) ? record.time_stamp : std::min(earliest, record.time_stamp);
+		latest = std::max(latest, record.time_stamp);
+	}
+	pqxx::work txn(conn);
+	pqxx::result res = exec_statement(txn, "listener_batch", character_ids, system_ids, latest, earliest);
+	txn.commit();
+	BatchLookup lookup;
+	for (const auto& row : res) {
+		std::string_view kind = row["kind"].view();
+		std::string key = row["key"].as<std::string>();
+		if (kind == "character") {
+			CharacterInfo& character = lookup.characters[key];
+			character.name = row["name"].is_null() ? "" : row["name"].as<std::string>();
+			character.address = row["address"].is_null() ? "" : row["address"].as<std::string>();
+		} else if (kind == "membership") {
+			Membership membership;
+			membership.joined_at = row["joined_at"].as<long long>();
+			membership.current = row["left_at"].is_null();
+			membership.left_at = membership.current ? 0 : row["left_at"].as<long long>();
+			membership.tribe_name = row["name"].is_null() ? "" : row["name"].as<std::string>();
+			lookup.characters[key].memberships.push_back(std::move(membership));
+		} else {
+			lookup.systems[key] = row["name"].is_null() ? "" : row["name"].as<std::string>();
+		}
+	}
+	return lookup;
+}
+// Copy the batch query's names onto an incident.
+static void apply_lookup(IncidentRecord& record, const BatchLookup& lookup) {
+	auto victim_it = lookup.characters.find(record.victim_id);
+	if (victim_it != lookup.characters.end()) {
+		record.victim_name = victim_it->second.name;
+		record.victim_address = victim_it->second.address;
+		record.victim_tribe_name = tribe_at(victim_it->second, record.time_stamp);
+	}
+	auto killer_it = lookup.characters.find(record.killer_id);
+	if (killer_it != lookup.characters.end()) {
+		record.killer_name = killer_it->second.name;
+		record.killer_address = killer_it->second.address;
+		record.killer_tribe_name = tribe_at(killer_it->second, record.time_stamp);
+	}
+	auto system_it = lookup.systems.find(std::to_string(record.solar_system_id));
+	if (system_it != lookup.systems.end()) record.solar_system_name = system_it->second;
+}
+// Enrich stage, the dimension cache answers when loaded and only characters it has not seen yet are read.
+// False when the database could not be asked, the names are then incomplete.
+static bool enrich_records(std::optional<PooledConnection>& lease, std::vector<IncidentRecord>& records) {
+	try {
+		if (std::shared_ptr<const DimensionSnapshot> view = dimensions().snapshot()) {
+			std::vector<std::string> missing;
+			for (auto& record : records) {
+				if (view->resolve(record)) continue;
+				missing.push_back(record.victim_id);
+				missing.push_back(record.killer_id);
 			}
-		} catch (const std::exception& e) {
-			// Default in case there is an issue with database.
-			killer_name = "";
-			killer_tribe_name = "";
-			killer_address = "";
-			std::cerr << "Error: " << e.what() << std::endl;
+			if (missing.empty()) return true;
+			if (!lease) lease.emplace(get_connection_pool().acquire());
+			dimensions().refresh_characters(**lease, missing);
+			view = dimensions().snapshot();
+			for (auto& record : records) view->resolve(record);
+			return true;
 		}
-		// Get system information
-		std::string solar_system_name;
-		try {
-			pqxx::result s_res = txn.exec_params("SELECT solar_system_name FROM systems WHERE solar_system_id::text ILIKE $1;",
-						parsed_json["solar_system_id"].is_number_integer() 
-						? std::to_string(parsed_json["solar_system_id"].get<long long>())
-						: parsed_json["solar_system_id"].get<std::string>());
-			// Check and set string
-			if (!s_res.empty()) {
-				solar_system_name = s_res[0][0].as<std::string>();
+		if (!lease) lease.emplace(get_connection_pool().acquire());
+		BatchLookup lookup = enrich_batch(**lease, records);
+		for (auto& record : records) apply_lookup(record, lookup);
+		return true;
+	} catch (const std::exception& e) {
+		// Issue with database, a fresh lease is taken next batch.
+		std::cerr << "Error: " << e.what() << std::endl;
+		if (lease) lease->mark_broken();
+		lease.reset();
+		return false;
+	}
+}
+// Ids of the newest incidents the listener counted, and whether each also went out on /mails. A seed counts
+// incidents nobody was sent, so a notification still queued for one is broadcast but not counted again.
+class PublishedIds {
+	// Public Members
+	public:
+		explicit PublishedIds(std::size_t capacity) : capacity(capacity) {}
+		bool counted(long long id) const { return sent.count(id) > 0; }
+		bool broadcast(long long id) const {
+			auto it = sent.find(id);
+			return it != sent.end() && it->second;
+		}
+		// Remember an id, a broadcast one stays broadcast. The oldest remembered id is forgotten first.
+		void mark(long long id, bool broadcast) {
+			auto [it, inserted] = sent.try_emplace(id, broadcast);
+			if (!inserted) {
+				it->second = it->second || broadcast;
+			} else {
+				order.push_back(id);
+				if (order.size() > capacity) {
+					sent.erase(order.front());
+					order.pop_front();
+				}
 			}
-		} catch (const std::exception& e) {
-			// Default in case there is an issue with database.
-			solar_system_name = "";
-			std::cerr << "Error: " << e.what() << std::endl;
+			newest = std::max(newest, id);
 		}
-		// Order json before stringify
-		filtered_json["id"] = parsed_json["id"];
-		filtered_json["victim_tribe_name"] = victim_tribe_name;
-		filtered_json["victim_name"] = victim_name;
-		filtered_json["victim_address"] = victim_address;
-		// Check loss type
-		std::string loss_type;
-		if (parsed_json["loss_type"].is_string()) {
-			std::string loss_type_value = parsed_json["loss_type"].get<std::string>();
-			loss_type = (loss_type_value == "0") ? "ship/structure" : loss_type_value; // Make sure we are not "0"
-		} else if (parsed_json["loss_type"].is_number_integer()) {
-			int loss_type_val = parsed_json["loss_type"].get<int>();
-			loss_type = (loss_type_val == 0) ? "ship/structure" : std::to_string(loss_type_val);
+		long long newest = 0; // Where catching up starts after a reconnect.
+	// Private Members
+	private:
+		std::size_t capacity;
+		std::unordered_map<long long, bool> sent;
+		std::deque<long long> order;
+};
+// Publish stage, in the order the notifications arrived. False when the incident was counted and sent before.
+static bool publish_incident(IncidentRecord record, std::chrono::steady_clock::time_point received_at, PublishedIds& published) {
+	bool count = !published.counted(record.id);
+	bool send = !published.broadcast(record.id);
+	if (!count && !send) return false;
+	published.mark(record.id, true);
+	if (count) {
+		// Keep the newest incidents, the leaderboards and the character stats in memory for /incident and /totals
+		recent_incidents().push(record);
+		leaderboards().record(record);
+		character_stats().record(record);
+		// Only once the ring and leaderboards hold it, so no stale page can be cached again.
+		response_cache().invalidate(record);
+	}
+	if (send) {
+		mail_broadcaster().publish(mail_broadcaster().frames(record), record);
+		observe_broadcast_lag(std::chrono::steady_clock::now() - received_at);
+	}
+	return true;
+}
+// Ids are handed out before commit, so an incident missed while reconnecting can sit this far below the newest one seen.
+static const long long catch_up_margin = 1000;
+// Remembered ids, enough for a full ring seed and the catch up margin.
+static const std::size_t published_memory = 10 * catch_up_margin;
+// Publish whatever was committed while the listener was away. Runs after LISTEN, so nothing falls between the two.
+// Anything already counted was either published or part of a seed.
+static void catch_up(std::optional<PooledConnection>& lease, PublishedIds& published_ids) {
+	if (published_ids.newest <= 0) return;
+	if (!lease) lease.emplace(get_connection_pool().acquire());
+	long long after = std::max(0LL, published_ids.newest - catch_up_margin);
+	long long limit = std::max<long long>(1, static_cast<long long>(listener_batch_limit()));
+	std::size_t published = 0;
+	while (true) {
+		pqxx::work txn(**lease);
+		pqxx::result res = exec_statement(txn, "incident_catch_up", after, limit);
+		txn.commit();
+		for (const auto& row : res) {
+			IncidentRecord record = record_from_row(row);
+			after = record.id;
+			if (published_ids.counted(record.id)) continue;
+			if (publish_incident(std::move(record), std::chrono::steady_clock::now(), published_ids)) published++;
+		}
+		if (static_cast<long long>(res.size()) < limit) break;
+	}
+	std::cout << "Listener caught up on " << published << " missed incidents." << std::endl;
+}
+// Whether an incident in the batch names a character with a pending change.
+static bool batch_references(const std::vector<ReceivedIncident>& batch, const std::vector<std::string>& characters) {
+	for (const auto& incident : batch) {
+		const nlohmann::ordered_json& payload = incident.payload;
+		for (const char* key : {"victim_id", "killer_id"}) {
+			if (!payload.contains(key)) continue;
+			if (std::binary_search(characters.begin(), characters.end(), id_text(payload[key]))) return true;
+		}
+	}
+	return false;
+}
+// Apply dimension changes ahead of the incidents that may depend on them. Character changes are held back
+// until the refresh interval passes, so a burst of membership updates is one copy and at most one index rebuild.
+// Reloads and tribe changes go at once, and so does anything an incident in this batch is about to be named from.
+static void process_changes(std::optional<PooledConnection>& lease, DimensionChanges& changes, const std::vector<ReceivedIncident>& batch) {
+	if (changes.empty()) return;
+	std::sort(changes.characters.begin(), changes.characters.end());
+	changes.characters.erase(std::unique(changes.characters.begin(), changes.characters.end()), changes.characters.end());
+	if (!changes.reload && changes.tribes.empty()
+			&& std::chrono::steady_clock::now() - changes.since < dimension_refresh_interval()
+			&& !batch_references(batch, changes.characters)) {
+		return;
+	}
+	try {
+		if (!lease) lease.emplace(get_connection_pool().acquire());
+		if (changes.reload) {
+			dimensions().load(**lease);
 		} else {
-			loss_type = "";
+			dimensions().refresh_characters(**lease, changes.characters);
+			std::sort(changes.tribes.begin(), changes.tribes.end());
+			changes.tribes.erase(std::unique(changes.tribes.begin(), changes.tribes.end()), changes.tribes.end());
+			dimensions().refresh_tribes(**lease, changes.tribes);
 		}
-		filtered_json["loss_type"] = loss_type;
-		filtered_json["killer_tribe_name"] = killer_tribe_name;
-		filtered_json["killer_name"] = killer_name;
-		filtered_json["killer_address"] = killer_address;
-		filtered_json["time_stamp"] = parsed_json["time_stamp"];
-		filtered_json["solar_system_id"] = parsed_json["solar_system_id"];
-		filtered_json["solar_system_name"] = solar_system_name;
-		// Dump that json back as a string for send off
-		std::string json_string = filtered_json.dump(4);
-		// Run through all json string packages
-		for (auto* ws : ws_connections) {
-			ws->send_text(json_string); // Send out string across websocket mutex.
+		response_cache().invalidate_all();
+		changes = DimensionChanges();
+	} catch (const std::exception& e) {
+		// The ids stay pending, so the next pass tries them again.
+		std::cerr << "Error: Dimension cache not refreshed: " << e.what() << std::endl;
+		if (lease) lease->mark_broken();
+		lease.reset();
+	}
+}
+// Ring, leaderboards and character stats from one snapshot taken after LISTEN. A later notification is either in it,
+// and counted already, or still queued. Run on every connect, so counts off by a missed notification are replaced
+// from the table. /incident and /totals fall back to the database until the first seed succeeds.
+static void seed_incidents(std::optional<PooledConnection>& lease, PublishedIds& published) {
+	try {
+		if (!lease) lease.emplace(get_connection_pool().acquire());
+		pqxx::transaction<pqxx::isolation_level::repeatable_read, pqxx::write_policy::read_only> txn(**lease);
+		std::vector<long long> seeded = recent_incidents().seed(txn);
+		leaderboards().seed(txn);
+		character_stats().seed(txn);
+		txn.commit();
+		// Newest last, so the oldest are forgotten first.
+		for (auto it = seeded.rbegin(); it != seeded.rend(); ++it) published.mark(*it, false);
+	} catch (const std::exception& e) {
+		std::cerr << "Error: Incidents not seeded: " << e.what() << std::endl;
+		if (lease) lease->mark_broken();
+		lease.reset();
+	}
+}
+// Lookups that may fail in a row before the listener reconnects and reads the held incidents back from the table.
+static const int enrich_attempts = 3;
+// Enrich a drained batch on the listener's lease and publish it. A batch whose lookup fails is held for the next pass
+// rather than published without names.
+static void process_batch(std::optional<PooledConnection>& lease, std::vector<ReceivedIncident>& batch, PublishedIds& published, int& failed_lookups) {
+	std::vector<ReceivedIncident> payloads;
+	std::vector<IncidentRecord> records;
+	for (auto& incident : batch) {
+		try {
+			records.push_back(record_from_payload(incident.payload));
+			payloads.push_back(std::move(incident));
+		} catch (const std::exception& e) {
+			std::cerr << "Error: Incident payload skipped: " << e.what() << std::endl;
 		}
-    	}
-};
+	}
+	batch.clear();
+	if (records.empty()) return;
+	if (!enrich_records(lease, records)) {
+		batch = std::move(payloads);
+		if (++failed_lookups >= enrich_attempts) throw std::runtime_error("Incident names unavailable, catching up after reconnect.");
+		return;
+	}
+	failed_lookups = 0;
+	for (std::size_t i = 0; i < records.size(); i++) {
+		try {
+			publish_incident(std::move(records[i]), payloads[i].received_at, published);
+		} catch (const std::exception& e) {
+			std::cerr << "Error: Incident not published: " << e.what() << std::endl;
+		}
+	}
+}
 // Notifications loop to stay on the database trigger.
 void listen_notifications() {
+	// Outlives the connection, catching up starts from it.
+	PublishedIds published(published_memory);
+	bool listened = false;
 	// Make sure we are still on and using those threads.
 	while (!shutdown_requested) {
 		// Get on our postgresql trigger channel
 		try {
 			pqxx::connection conn(get_direct_connection_string());
-			NotifyListener listener(conn, "incident_trigger");
+			std::vector<ReceivedIncident> batch;
+			NotifyListener listener(conn, "incident_trigger", batch);
+			// Dimension changes keep the cache current.
+			DimensionChanges changes;
+			DimensionListener character_listener(conn, "character_change", "id", changes);
+			DimensionListener membership_listener(conn, "membership_change", "character_id", changes);
+			DimensionListener tribe_listener(conn, "tribe_change", "tribe_id", changes);
+			// Enrichment stays on one pooled connection for as long as the listener lives.
+			std::optional<PooledConnection> lease;
 			{
 				pqxx::work txn(conn);
 				txn.exec("LISTEN incident_trigger;");
+				txn.exec("LISTEN character_change;");
+				txn.exec("LISTEN membership_change;");
+				txn.exec("LISTEN tribe_change;");
 				txn.commit();
-				std::cout << "Listening on channel 'incident_trigger'..." << std::endl;
+				std::cout << "Listening on channels 'incident_trigger', 'character_change', 'membership_change' and 'tribe_change'..." << std::endl;
+			}
+			// Only now that notifications queue up. Missed incidents go before the seed, which would take them in unpublished.
+			catch_up(lease, published);
+			seed_incidents(lease, published);
+			// Changes made while the listener was away were never notified, read the dimensions again.
+			if (listened) {
+				changes.since = std::chrono::steady_clock::now();
+				changes.reload = true;
 			}
+			listened = true;
+			int failed_lookups = 0;
 			// Check we are open for business and not wasting threads
 			while (conn.is_open() && !shutdown_requested) {
 				// Flag
 				bool notification_received = conn.await_notification(1,0);
+				// Batch stage, drain whatever else already arrived before enriching.
+				while (notification_received && batch.size() < listener_batch_limit() && conn.get_notifs() > 0) {}
+				process_changes(lease, changes, batch);
+				process_batch(lease, batch, published, failed_lookups);
 				// Not received
 				if (!notification_received) {
 					// Heartbeat